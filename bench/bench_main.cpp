@@ -0,0 +1,23 @@
+// bench_main.cpp
+#include <benchmark/benchmark.h>
+#include <vector>
+
+void register_throughput_benchmarks();
+
+int main(int argc, char* argv[]) {
+    // Report JSON by default so runs can be compared between builds; an explicit
+    // --benchmark_format later on the command line still wins
+    static char json_format[] = "--benchmark_format=json";
+    std::vector<char*> args(argv, argv + argc);
+    args.insert(args.begin() + 1, json_format);
+    int count = static_cast<int>(args.size());
+
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+        return 1;
+    }
+    register_throughput_benchmarks();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
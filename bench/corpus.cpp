@@ -0,0 +1,82 @@
+#include "corpus.h"
+#include <map>
+#include <random>
+#include <string_view>
+
+namespace {
+
+constexpr size_t kCorpusSize = 8 * 1024 * 1024;
+
+constexpr std::string_view kAsciiWords[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel", "india",
+    "juliet", "kilo", "lima", "mike", "november", "oscar", "papa", "quebec", "romeo",
+    "sierra", "tango", "uniform", "victor", "whiskey", "xray", "yankee", "zulu",
+    "GET", "POST", "status=200", "user_id", "timeout", "/var/log", "[info]", "0x7f3a",
+};
+
+constexpr std::string_view kUtf8Words[] = {
+    "naïve", "café", "größe", "straße", "über", "façade", "smörgåsbord", "привет",
+    "мир", "данные", "日本語", "テキスト", "検索", "ελληνικά", "κόσμος", "😀",
+};
+
+} // namespace
+
+const std::vector<CorpusSpec>& corpus_specs() {
+    static const std::vector<CorpusSpec> specs = [] {
+        std::vector<CorpusSpec> result;
+        for (size_t line_length : {60, 2000}) {
+            for (double hit_rate : {0.001, 0.5}) {
+                for (bool utf8 : {false, true}) {
+                    std::string name = line_length < 100 ? "short" : "long";
+                    name += hit_rate < 0.01 ? "_sparse" : "_dense";
+                    name += utf8 ? "_utf8" : "_ascii";
+                    result.push_back({name, line_length, hit_rate, utf8});
+                }
+            }
+        }
+        return result;
+    }();
+    return specs;
+}
+
+std::string generate_corpus(const CorpusSpec& spec, size_t size) {
+    std::mt19937_64 rng(0x5eed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::uniform_int_distribution<size_t> ascii_word(0, std::size(kAsciiWords) - 1);
+    std::uniform_int_distribution<size_t> utf8_word(0, std::size(kUtf8Words) - 1);
+    std::uniform_int_distribution<unsigned> number(0, 99999);
+
+    std::string corpus;
+    corpus.reserve(size + spec.line_length * 2);
+    while (corpus.size() < size) {
+        size_t line_start = corpus.size();
+        bool hit = chance(rng) < spec.hit_rate;
+        // Place the needle somewhere in the middle of the line rather than always at the front
+        size_t needle_at = line_start + spec.line_length / 2;
+
+        while (corpus.size() - line_start < spec.line_length) {
+            if (hit && corpus.size() >= needle_at) {
+                corpus += kNeedle;
+                corpus += ' ';
+                corpus += std::to_string(number(rng));
+                hit = false;
+            } else if (spec.utf8 && chance(rng) < 0.5) {
+                corpus += kUtf8Words[utf8_word(rng)];
+            } else {
+                corpus += kAsciiWords[ascii_word(rng)];
+            }
+            corpus += ' ';
+        }
+        corpus.back() = '\n';
+    }
+    return corpus;
+}
+
+const std::string& cached_corpus(const CorpusSpec& spec) {
+    static std::map<std::string, std::string> corpora;
+    auto found = corpora.find(spec.name);
+    if (found == corpora.end()) {
+        found = corpora.emplace(spec.name, generate_corpus(spec, kCorpusSize)).first;
+    }
+    return found->second;
+}
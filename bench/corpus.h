@@ -0,0 +1,29 @@
+// corpus.h
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Shape of a generated benchmark input
+struct CorpusSpec {
+    std::string name;
+    size_t line_length;  // Approximate bytes per line
+    double hit_rate;     // Fraction of lines containing the needle
+    bool utf8;           // Mix multi-byte UTF-8 words into the text
+};
+
+// Every hit line contains kNeedle followed by a space and a number; other lines never contain it
+inline constexpr const char* kNeedle = "needle";
+
+// The short/long lines x sparse/dense hits x ASCII/UTF-8 grid used by the throughput benchmarks
+const std::vector<CorpusSpec>& corpus_specs();
+
+// Builds about `size` bytes of '\n'-terminated lines from a fixed seed, so runs are comparable
+std::string generate_corpus(const CorpusSpec& spec, size_t size);
+
+// Generates each corpus once per process
+const std::string& cached_corpus(const CorpusSpec& spec);
+
+#endif // CORPUS_H
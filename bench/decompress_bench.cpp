@@ -0,0 +1,78 @@
+// -z pipeline: how close searching a gzip input gets to merely decompressing it
+#include <benchmark/benchmark.h>
+#ifdef GREP_HAVE_ZLIB
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "corpus.h"
+#include "decompress.h"
+#include "grep_funcs.h"
+#include "line_reader.h"
+#include "search.h"
+
+namespace {
+
+// The first corpus gzipped into an in-memory file, built once per process
+int compressed_corpus_fd() {
+    static const int fd = [] {
+        const std::string& corpus = cached_corpus(corpus_specs()[0]);
+        z_stream stream{};
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Cannot initialize zlib");
+        }
+        std::string compressed(deflateBound(&stream, corpus.size()), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(corpus.data()));
+        stream.avail_in = static_cast<uInt>(corpus.size());
+        stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+        stream.avail_out = static_cast<uInt>(compressed.size());
+        deflate(&stream, Z_FINISH);
+        compressed.resize(stream.total_out);
+        deflateEnd(&stream);
+
+        int file = ::memfd_create("corpus.gz", 0);
+        if (file < 0 || ::write(file, compressed.data(), compressed.size()) != static_cast<ssize_t>(compressed.size())) {
+            throw std::runtime_error("Cannot write the compressed corpus");
+        }
+        return file;
+    }();
+    ::lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+// The ceiling: the producer thread alone, with a consumer that only takes the blocks
+void BM_decompress_only(benchmark::State& state) {
+    compressed_corpus_fd();
+    size_t bytes = 0;
+    for (auto _ : state) {
+        DecompressingReader reader(compressed_corpus_fd());
+        std::string_view block;
+        bytes = 0;
+        while (reader.next_block(block)) {
+            bytes += block.size();
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+
+void BM_search_decompressed(benchmark::State& state, const char* pattern) {
+    compressed_corpus_fd();
+    const CompiledPattern compiled(pattern);
+    SearchOptions options;
+    options.decompress = true;
+    OutputBuffer out;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_fd(compiled, compressed_corpus_fd(), "corpus.gz", options, out));
+        out.take();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * cached_corpus(corpus_specs()[0]).size()));
+}
+
+// Most of the work is on the producer thread, so rates are per wall-clock second
+BENCHMARK(BM_decompress_only)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_search_decompressed, literal, "needle")->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_search_decompressed, regex, "need[a-z]+ \\d+")->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
+#endif
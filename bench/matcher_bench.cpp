@@ -0,0 +1,83 @@
+// Microbenchmarks for each public matcher on a single line, with the hit placed at the end
+// so that a hit and a miss both scan the whole line
+#include <benchmark/benchmark.h>
+#include <string>
+#include <string_view>
+#include "grep_funcs.h"
+
+namespace {
+
+const std::string kLine = "the quick brown fox jumps over the lazy dog while the hungry owl "
+                          "watches from the old oak tree ";
+
+template <typename Matcher>
+void run_matcher(benchmark::State& state, std::string_view suffix, Matcher matcher) {
+    const std::string line = kLine + std::string(suffix);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(matcher(line));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * line.size()));
+}
+
+// One benchmark function per matcher so the names in the report say what was measured
+#define DEFINE_PATTERN_BENCHMARK(matcher)                                                   \
+    void BM_##matcher(benchmark::State& state, std::string_view suffix, std::string pattern) { \
+        run_matcher(state, suffix, [&](std::string_view line) { return matcher(line, pattern); }); \
+    }
+
+#define DEFINE_CLASS_BENCHMARK(matcher)                                     \
+    void BM_##matcher(benchmark::State& state, std::string_view suffix) {   \
+        run_matcher(state, suffix, [](std::string_view line) { return matcher(line); }); \
+    }
+
+DEFINE_PATTERN_BENCHMARK(match_character)
+DEFINE_CLASS_BENCHMARK(match_digit)
+DEFINE_CLASS_BENCHMARK(match_alnum)
+DEFINE_PATTERN_BENCHMARK(match_pos_char_groups)
+DEFINE_PATTERN_BENCHMARK(match_one_or_more)
+DEFINE_PATTERN_BENCHMARK(match_zero_or_one)
+DEFINE_PATTERN_BENCHMARK(match_wildcard)
+DEFINE_PATTERN_BENCHMARK(match_alternation)
+DEFINE_PATTERN_BENCHMARK(match_pattern)
+
+// The compiled engine on the same inputs, for comparison with match_pattern
+void BM_compiled_match(benchmark::State& state, std::string_view suffix, std::string pattern) {
+    const CompiledPattern compiled(pattern);
+    run_matcher(state, suffix, [&](std::string_view line) { return compiled.match(line); });
+}
+
+} // namespace
+
+BENCHMARK_CAPTURE(BM_match_character, miss, "", "#");
+BENCHMARK_CAPTURE(BM_match_character, hit, "#", "#");
+
+BENCHMARK_CAPTURE(BM_match_digit, miss, "");
+BENCHMARK_CAPTURE(BM_match_digit, hit, "7");
+BENCHMARK_CAPTURE(BM_match_alnum, miss, "");
+
+BENCHMARK_CAPTURE(BM_match_pos_char_groups, miss, "", "[#@!]");
+BENCHMARK_CAPTURE(BM_match_pos_char_groups, hit, "!", "[#@!]");
+
+BENCHMARK_CAPTURE(BM_match_one_or_more, miss, "", "ca+t");
+BENCHMARK_CAPTURE(BM_match_one_or_more, hit, "caaat", "ca+t");
+
+BENCHMARK_CAPTURE(BM_match_zero_or_one, miss, "", "ca?t");
+BENCHMARK_CAPTURE(BM_match_zero_or_one, hit, "cat", "ca?t");
+
+BENCHMARK_CAPTURE(BM_match_wildcard, miss, "", "c.t");
+BENCHMARK_CAPTURE(BM_match_wildcard, hit, "cut", "c.t");
+
+BENCHMARK_CAPTURE(BM_match_alternation, miss, "", "(cat|cow) x");
+BENCHMARK_CAPTURE(BM_match_alternation, hit, "cow x", "(cat|cow) x");
+
+BENCHMARK_CAPTURE(BM_match_pattern, digit, "7", "\\d");
+BENCHMARK_CAPTURE(BM_match_pattern, negated_group, "", "[^a-z ]");
+BENCHMARK_CAPTURE(BM_match_pattern, end_anchor, "", "tree $");
+BENCHMARK_CAPTURE(BM_match_pattern, escapes, "id 42", "\\w\\w \\d\\d");
+BENCHMARK_CAPTURE(BM_match_pattern, alternation, "cow x", "(cat|cow) x");
+
+BENCHMARK_CAPTURE(BM_compiled_match, digit, "7", "\\d");
+BENCHMARK_CAPTURE(BM_compiled_match, negated_group, "", "[^a-z ]");
+BENCHMARK_CAPTURE(BM_compiled_match, end_anchor, "", "tree $");
+BENCHMARK_CAPTURE(BM_compiled_match, escapes, "id 42", "\\w\\w \\d\\d");
+BENCHMARK_CAPTURE(BM_compiled_match, alternation, "cow x", "(cat|cow) x");
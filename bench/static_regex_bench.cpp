@@ -0,0 +1,62 @@
+// Compile-time matchers against CompiledPattern on the same lines
+#include <benchmark/benchmark.h>
+#include <string_view>
+#include <vector>
+#include "corpus.h"
+#include "grep_funcs.h"
+#include "static_regex.h"
+
+namespace {
+
+const std::vector<std::string_view>& corpus_lines() {
+    static const std::vector<std::string_view> lines = [] {
+        std::vector<std::string_view> result;
+        std::string_view corpus = cached_corpus(corpus_specs()[0]);
+        size_t start = 0;
+        for (size_t end = corpus.find('\n'); end != std::string_view::npos; end = corpus.find('\n', start)) {
+            result.push_back(corpus.substr(start, end - start));
+            start = end + 1;
+        }
+        return result;
+    }();
+    return lines;
+}
+
+template <typename Matcher>
+void run_lines(benchmark::State& state, Matcher matcher) {
+    const std::vector<std::string_view>& lines = corpus_lines();
+    size_t bytes = 0;
+    for (std::string_view line : lines) {
+        bytes += line.size();
+    }
+    for (auto _ : state) {
+        size_t matched = 0;
+        for (std::string_view line : lines) {
+            matched += matcher(line);
+        }
+        benchmark::DoNotOptimize(matched);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+
+template <grep::fixed_string Pattern>
+void BM_static_regex(benchmark::State& state) {
+    run_lines(state, grep::static_regex<Pattern>());
+}
+
+template <grep::fixed_string Pattern>
+void BM_runtime_regex(benchmark::State& state) {
+    const CompiledPattern compiled(Pattern.view());
+    run_lines(state, [&](std::string_view line) { return compiled.match(line); });
+}
+
+} // namespace
+
+BENCHMARK(BM_static_regex<"^error_\\d+$">);
+BENCHMARK(BM_runtime_regex<"^error_\\d+$">);
+BENCHMARK(BM_static_regex<"need[a-z]+ \\d+">);
+BENCHMARK(BM_runtime_regex<"need[a-z]+ \\d+">);
+BENCHMARK(BM_static_regex<"(GET|POST) /var/\\w+">);
+BENCHMARK(BM_runtime_regex<"(GET|POST) /var/\\w+">);
+BENCHMARK(BM_static_regex<"[0-9]+ [a-z]+x">);
+BENCHMARK(BM_runtime_regex<"[0-9]+ [a-z]+x">);
@@ -0,0 +1,73 @@
+// End-to-end throughput: search a whole generated corpus the way the executable searches a
+// mapped file, output formatting included
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+#include "corpus.h"
+#include "grep_funcs.h"
+#include "line_reader.h"
+#include "search.h"
+
+namespace {
+
+struct ThroughputPattern {
+    const char* name;
+    const char* pattern;
+};
+
+// A pure literal (prefilter only), a regex verified by the DFA, and a pattern with no literal
+constexpr ThroughputPattern kPatterns[] = {
+    {"literal", "needle"},
+    {"regex", "need[a-z]+ \\d+"},
+    {"no_literal", "[a-z]+ [0-9][0-9][0-9]x"},
+};
+
+void BM_search_corpus(benchmark::State& state, const CorpusSpec& spec, const char* pattern) {
+    const std::string& corpus = cached_corpus(spec);
+    const CompiledPattern compiled(pattern);
+    SearchOptions options;
+    OutputBuffer out;
+    size_t output_bytes = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_buffer(compiled, corpus, "corpus", options, out));
+        output_bytes = out.take().size();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus.size()));
+    state.counters["output_bytes"] = static_cast<double>(output_bytes);
+}
+
+// Many IOC-style literals plus one regex, searched as a single combined matcher
+void BM_search_pattern_set(benchmark::State& state, const CorpusSpec& spec) {
+    const std::string& corpus = cached_corpus(spec);
+    std::vector<std::string> patterns;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        patterns.push_back("ioc" + std::to_string(i * 7919 % 100000) + "x");
+    }
+    patterns.push_back("need[a-z]+ \\d+");
+    const CompiledPattern compiled(patterns);
+    SearchOptions options;
+    OutputBuffer out;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_buffer(compiled, corpus, "corpus", options, out));
+        out.take();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus.size()));
+}
+
+} // namespace
+
+void register_throughput_benchmarks() {
+    benchmark::RegisterBenchmark("BM_search_pattern_set/short_sparse_ascii", BM_search_pattern_set,
+                                 corpus_specs()[0])
+        ->Arg(10)
+        ->Arg(1000)
+        ->Unit(benchmark::kMillisecond);
+
+    for (const CorpusSpec& spec : corpus_specs()) {
+        for (const ThroughputPattern& pattern : kPatterns) {
+            std::string name = "BM_search_corpus/" + spec.name + "/" + pattern.name;
+            benchmark::RegisterBenchmark(name.c_str(), BM_search_corpus, spec, pattern.pattern)
+                ->Unit(benchmark::kMillisecond);
+        }
+    }
+}
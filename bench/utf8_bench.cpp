@@ -0,0 +1,56 @@
+// --utf8: what the code-point automata cost, and how much of it the ASCII fast path recovers
+#include <benchmark/benchmark.h>
+#include <string>
+#include "char_class.h"
+#include "corpus.h"
+#include "grep_funcs.h"
+#include "line_reader.h"
+#include "search.h"
+
+namespace {
+
+// The short-line, dense-hit corpus in its ASCII or its UTF-8 variant
+const std::string& dense_corpus(bool utf8) {
+    for (const CorpusSpec& spec : corpus_specs()) {
+        if (spec.line_length < 100 && spec.hit_rate > 0.01 && spec.utf8 == utf8) {
+            return cached_corpus(spec);
+        }
+    }
+    return cached_corpus(corpus_specs()[0]);
+}
+
+// The per-window check that picks the fast path
+void BM_is_ascii(benchmark::State& state) {
+    const std::string& corpus = dense_corpus(false);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(is_ascii(corpus));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus.size()));
+}
+
+// Arguments: UTF-8 corpus or not, then the compile flags. Bytewise and UTF-8 mode on ASCII
+// text should be level; on UTF-8 text the difference is the automaton's cost.
+void BM_search_utf8(benchmark::State& state, const char* pattern) {
+    const std::string& corpus = dense_corpus(state.range(0) != 0);
+    const CompiledPattern compiled(pattern, static_cast<uint32_t>(state.range(1)));
+    SearchOptions options;
+    OutputBuffer out;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(search_buffer(compiled, corpus, "corpus", options, out));
+        out.take();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * corpus.size()));
+}
+
+BENCHMARK(BM_is_ascii);
+BENCHMARK_CAPTURE(BM_search_utf8, regex, "need[a-z]+ \\d+")
+    ->ArgsProduct({{0, 1}, {0, kUtf8Mode}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_search_utf8, word_run, "\\w+ \\w+ \\d+")
+    ->ArgsProduct({{0, 1}, {0, kUtf8Mode}})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_search_utf8, negated_class, "[^a-z ][^a-z ]\\d")
+    ->ArgsProduct({{0, 1}, {0, kUtf8Mode}})
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
@@ -1,40 +1,110 @@
 // main.cpp
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "grep_funcs.h"
+#include "indexed_search.h"
+#include "line_reader.h"
+#include "options.h"
+#include "parallel_search.h"
+#include "pattern_cache.h"
+#include "recursive_search.h"
+#include "search.h"
+#include "search_stats.h"
+#include "trigram_index.h"
 
 int main(int argc, char* argv[]) {
-    // Flush after every std::cout / std::cerr
-    std::cout << std::unitbuf;
+    // Flush after every std::cerr; matching lines go through a batched OutputBuffer instead
     std::cerr << std::unitbuf;
 
-    // You can use print statements as follows for debugging
-    std::cout << "Logs from your program will appear here" << std::endl;
-
-    if (argc != 3) {
-        std::cerr << "Expected two arguments" << std::endl;
-        return 1;
-    }
+    try {
+        auto started = std::chrono::steady_clock::now();
+        if (argc > 1 && std::string_view(argv[1]) == "index") {
+            IndexOptions index_options = parse_index_options(argc, argv);
+            IndexUpdate update = update_index(index_options.index_path, index_options.paths);
+            std::cerr << index_options.index_path << ": " << update.unchanged << " unchanged, " << update.appended
+                      << " appended, " << update.indexed << " indexed, " << update.removed << " removed; "
+                      << update.bytes << " bytes read" << std::endl;
+            return 0;
+        }
 
-    std::string flag = argv[1];
-    std::string pattern = argv[2];
+        GrepOptions grep_options = parse_options(argc, argv);
+        if (grep_options.stats) {
+            enable_search_stats();
+        }
 
-    if (flag != "-E") {
-        std::cerr << "Expected first argument to be '-E'" << std::endl;
-        return 1;
-    }
+        // Compile the patterns once, or map them from an earlier run, and reuse them for every
+        // input line on every thread
+        PatternCache cache(grep_options.use_cache ? PatternCache::default_directory() : std::string());
+        std::unique_ptr<CompiledPattern> compiled_patterns = cache.load(grep_options.patterns, grep_options.utf8 ? kUtf8Mode : 0);
+        const CompiledPattern& compiled = *compiled_patterns;
+        if (grep_options.cache_stats) {
+            std::cerr << "pattern cache: " << cache.hits() << " hits, " << cache.misses() << " misses, "
+                      << cache.evictions() << " evicted" << std::endl;
+        }
 
-    std::string input_line;
-    std::getline(std::cin, input_line);
+        SearchOptions options;
+        options.with_filename = grep_options.files.size() > 1;
+        if (grep_options.recursive && grep_options.files.size() <= 1) {
+            // Files found below a directory are always labelled; a lone file operand is not
+            struct stat info;
+            options.with_filename = grep_options.files.empty() ||
+                                    (::stat(grep_options.files[0].c_str(), &info) == 0 && S_ISDIR(info.st_mode));
+        }
+        options.pattern_ids = grep_options.pattern_ids;
+        options.only_matching = grep_options.only_matching;
+        options.byte_offset = grep_options.byte_offset;
+        options.line_number = grep_options.line_number;
+        options.count_only = grep_options.count_only;
+        options.decompress = grep_options.decompress;
+        OutputBuffer out(STDOUT_FILENO);
 
-    try {
-        if (match_pattern(input_line, pattern)) {
-            return 0;
+        bool any_match = false;
+        if (!grep_options.index_path.empty()) {
+            TrigramIndex index(grep_options.index_path);
+            if (grep_options.files.empty()) {
+                options.with_filename = index.files().size() > 1;
+            }
+            any_match = indexed_search(compiled, index, grep_options.files, options, out);
+        } else if (grep_options.recursive) {
+            WalkOptions walk;
+            walk.include = grep_options.include;
+            walk.exclude = grep_options.exclude;
+            walk.exclude_dir = grep_options.exclude_dir;
+            walk.use_ignore_files = grep_options.use_ignore_files;
+            any_match = recursive_search(compiled, grep_options.files, options, walk, grep_options.jobs, out);
+        } else if (grep_options.files.empty()) {
+            any_match = search_fd(compiled, STDIN_FILENO, "(standard input)", options, out) > 0;
+        } else if (grep_options.jobs > 1) {
+            any_match = parallel_search(compiled, grep_options.files, options, grep_options.jobs, out);
         } else {
-            return 1;
+            for (const std::string& file : grep_options.files) {
+                try {
+                    any_match |= search_file(compiled, file, options, out) > 0;
+                } catch (const std::runtime_error& e) {
+                    out.flush();
+                    std::cerr << file << ": " << e.what() << std::endl;
+                }
+            }
+        }
+        out.flush();
+
+        if (grep_options.stats) {
+            // Every worker has finished, so the per-thread counters are final
+            SearchStats stats = merged_search_stats();
+            compiled.add_engine_stats(stats);
+            auto wall = std::chrono::steady_clock::now() - started;
+            write_search_stats(stats, compiled.strategy(),
+                               std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count(),
+                               grep_options.stats_json, std::cerr);
         }
+        return any_match ? 0 : 1;
     } catch (const std::runtime_error& e) {
         std::cerr << e.what() << std::endl;
         return 1;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,237 @@
+#include "aho_corasick.h"
+#include <algorithm>
+#include <stdexcept>
+
+AhoCorasick::AhoCorasick(const std::vector<std::string>& literals, const std::vector<uint32_t>& ids,
+                         Arena& arena) {
+    if (literals.empty()) {
+        return;
+    }
+
+    // Only bytes that occur in some literal need a class of their own
+    std::array<bool, 256> used{};
+    for (const std::string& literal : literals) {
+        for (char c : literal) {
+            used[static_cast<unsigned char>(c)] = true;
+        }
+    }
+    uint16_t next_class = 1;
+    for (int c = 0; c < 256; c++) {
+        byte_class_[c] = used[c] ? next_class++ : 0;
+    }
+    stride_ = next_class;
+
+    // Trie with state 0 as the root; kNone marks edges the failure links fill in later
+    std::vector<uint32_t> trie(stride_, kNone);
+    std::vector<std::vector<uint32_t>> own_outputs(1);
+    std::vector<std::vector<uint32_t>> own_lengths(1);
+    for (size_t i = 0; i < literals.size(); i++) {
+        uint32_t state = 0;
+        for (char c : literals[i]) {
+            size_t edge = static_cast<size_t>(state) * stride_ + byte_class_[static_cast<unsigned char>(c)];
+            if (trie[edge] == kNone) {
+                trie[edge] = static_cast<uint32_t>(own_outputs.size());
+                own_outputs.emplace_back();
+                own_lengths.emplace_back();
+                trie.resize(trie.size() + stride_, kNone);
+            }
+            state = trie[edge];
+        }
+        own_outputs[state].push_back(ids[i]);
+        own_lengths[state].push_back(static_cast<uint32_t>(literals[i].length()));
+        longest_ = std::max(longest_, static_cast<uint32_t>(literals[i].length()));
+    }
+    size_t state_count = own_outputs.size();
+
+    // Breadth-first, so a state's failure target is finished before the state itself
+    std::vector<uint32_t> failure(state_count, 0);
+    std::vector<uint32_t> links(state_count, kNone);
+    std::vector<uint32_t> queue;
+    queue.reserve(state_count);
+    for (uint32_t c = 0; c < stride_; c++) {
+        if (trie[c] == kNone) {
+            trie[c] = 0;
+        } else {
+            queue.push_back(trie[c]);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); head++) {
+        uint32_t state = queue[head];
+        uint32_t fail = failure[state];
+        links[state] = own_outputs[fail].empty() ? links[fail] : fail;
+
+        size_t row = static_cast<size_t>(state) * stride_;
+        size_t fail_row = static_cast<size_t>(fail) * stride_;
+        for (uint32_t c = 0; c < stride_; c++) {
+            if (trie[row + c] == kNone) {
+                trie[row + c] = trie[fail_row + c];
+            } else {
+                failure[trie[row + c]] = trie[fail_row + c];
+                queue.push_back(trie[row + c]);
+            }
+        }
+    }
+
+    // Flatten: entries hold the target's row offset and whether it ends a literal
+    for (size_t i = 0; i < trie.size(); i++) {
+        uint32_t target = trie[i];
+        bool ends_literal = !own_outputs[target].empty() || links[target] != kNone;
+        trie[i] = target * stride_ | (ends_literal ? kMatchTag : 0);
+    }
+    transitions_ = arena.copy(trie);
+    dictionary_links_ = arena.copy(links);
+
+    ByteSet first_bytes;
+    for (const std::string& literal : literals) {
+        first_bytes.set(static_cast<unsigned char>(literal[0]));
+    }
+    accelerate_ = first_bytes.count() <= kMaxAccelerationBytes;
+    if (accelerate_) {
+        first_bytes_ = ClassScanner(first_bytes);
+    }
+
+    std::vector<uint32_t> outputs_begin;
+    std::vector<uint32_t> output_ids;
+    std::vector<uint32_t> output_lengths;
+    outputs_begin.reserve(state_count + 1);
+    for (size_t state = 0; state < state_count; state++) {
+        outputs_begin.push_back(static_cast<uint32_t>(output_ids.size()));
+        output_ids.insert(output_ids.end(), own_outputs[state].begin(), own_outputs[state].end());
+        output_lengths.insert(output_lengths.end(), own_lengths[state].begin(), own_lengths[state].end());
+    }
+    outputs_begin.push_back(static_cast<uint32_t>(output_ids.size()));
+    outputs_begin_ = arena.copy(outputs_begin);
+    output_ids_ = arena.copy(output_ids);
+    output_lengths_ = arena.copy(output_lengths);
+}
+
+size_t AhoCorasick::find(std::string_view text, size_t from) const {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+    uint32_t row = 0;
+    for (size_t i = from; i < text.length(); i++) {
+        if (row == 0 && accelerate_) {
+            i = first_bytes_.find(text, i);
+            if (i == std::string_view::npos) {
+                break;
+            }
+        }
+        uint32_t entry = transitions_[row + byte_class_[data[i]]];
+        if (entry & kMatchTag) {
+            return i;
+        }
+        row = entry;
+    }
+    return std::string_view::npos;
+}
+
+void AhoCorasick::collect(std::string_view text, std::vector<uint32_t>& ids) const {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+    uint32_t row = 0;
+    for (size_t i = 0; i < text.length(); i++) {
+        uint32_t entry = transitions_[row + byte_class_[data[i]]];
+        row = entry & ~kMatchTag;
+        if (entry & kMatchTag) {
+            // The state's own literals, then those of every suffix that also ends a literal
+            for (uint32_t state = row / stride_; state != kNone; state = dictionary_links_[state]) {
+                ids.insert(ids.end(), output_ids_.begin() + outputs_begin_[state],
+                           output_ids_.begin() + outputs_begin_[state + 1]);
+            }
+        }
+    }
+}
+
+bool AhoCorasick::find_span(std::string_view text, size_t from, size_t& start, size_t& end) const {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+    size_t best_start = std::string_view::npos;
+    size_t best_end = 0;
+    uint32_t row = 0;
+    for (size_t i = from; i < text.length(); i++) {
+        // No occurrence ending here or later can start at or before best_start
+        if (best_start != std::string_view::npos && i >= best_start + longest_) {
+            break;
+        }
+        uint32_t entry = transitions_[row + byte_class_[data[i]]];
+        row = entry & ~kMatchTag;
+        if (!(entry & kMatchTag)) {
+            continue;
+        }
+        for (uint32_t state = row / stride_; state != kNone; state = dictionary_links_[state]) {
+            for (uint32_t k = outputs_begin_[state]; k < outputs_begin_[state + 1]; k++) {
+                size_t occurrence = i + 1 - output_lengths_[k];
+                if (occurrence < from) {
+                    continue;  // Began before the search did
+                }
+                if (best_start == std::string_view::npos || occurrence < best_start ||
+                    (occurrence == best_start && i + 1 > best_end)) {
+                    best_start = occurrence;
+                    best_end = i + 1;
+                }
+            }
+        }
+    }
+    if (best_start == std::string_view::npos) {
+        return false;
+    }
+    start = best_start;
+    end = best_end;
+    return true;
+}
+
+AhoCorasick::AhoCorasick(BinaryReader& in, Arena& arena) {
+    byte_class_ = in.get<std::array<uint16_t, 256>>();
+    stride_ = in.get<uint32_t>();
+    transitions_ = in.get_span<uint32_t>(arena);
+    outputs_begin_ = in.get_span<uint32_t>(arena);
+    output_ids_ = in.get_span<uint32_t>(arena);
+    output_lengths_ = in.get_span<uint32_t>(arena);
+    dictionary_links_ = in.get_span<uint32_t>(arena);
+    if (transitions_.empty()) {
+        return;
+    }
+
+    // The scan loops index with these values directly
+    size_t state_count = stride_ == 0 ? 0 : transitions_.size() / stride_;
+    bool consistent = state_count > 0 && transitions_.size() == state_count * stride_ &&
+                      outputs_begin_.size() == state_count + 1 && dictionary_links_.size() == state_count &&
+                      outputs_begin_.front() == 0 && outputs_begin_.back() == output_ids_.size() &&
+                      output_lengths_.size() == output_ids_.size();
+    for (uint32_t length : output_lengths_) {
+        longest_ = std::max(longest_, length);
+    }
+    for (uint16_t byte_class : byte_class_) {
+        consistent = consistent && byte_class < stride_;
+    }
+    for (size_t i = 0; consistent && i < transitions_.size(); i++) {
+        uint32_t row = transitions_[i] & ~kMatchTag;
+        consistent = row % stride_ == 0 && row / stride_ < state_count;
+    }
+    for (size_t i = 0; consistent && i < state_count; i++) {
+        consistent = outputs_begin_[i] <= outputs_begin_[i + 1] &&
+                     (dictionary_links_[i] == kNone || dictionary_links_[i] < state_count);
+    }
+    if (!consistent) {
+        throw std::runtime_error("Inconsistent Aho-Corasick tables");
+    }
+
+    // Bytes that leave the root are those whose root transition is not back to row 0
+    ByteSet first_bytes;
+    for (int c = 0; c < 256; c++) {
+        if ((transitions_[byte_class_[c]] & ~kMatchTag) != 0) {
+            first_bytes.set(static_cast<unsigned char>(c));
+        }
+    }
+    accelerate_ = first_bytes.count() <= kMaxAccelerationBytes;
+    if (accelerate_) {
+        first_bytes_ = ClassScanner(first_bytes);
+    }
+}
+
+void AhoCorasick::save(BinaryWriter& out) const {
+    out.put(byte_class_);
+    out.put(stride_);
+    out.put_span(transitions_);
+    out.put_span(outputs_begin_);
+    out.put_span(output_ids_);
+    out.put_span(output_lengths_);
+    out.put_span(dictionary_links_);
+}
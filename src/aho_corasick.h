@@ -0,0 +1,65 @@
+// aho_corasick.h
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "arena.h"
+#include "binary_io.h"
+#include "char_class.h"
+
+// Finds any of a large set of literals in a single pass over the text. The trie and its
+// failure links are flattened into a dense automaton over byte classes, so every input byte
+// costs one table lookup no matter how many literals there are. When few bytes can start a
+// literal, runs through the root state are skipped with a SIMD class scan.
+// The tables live in an arena supplied by the owner, which must outlive the automaton.
+class AhoCorasick {
+public:
+    AhoCorasick() = default;
+
+    // Occurrences of literals[i] are reported as ids[i]; the literals must not be empty
+    AhoCorasick(const std::vector<std::string>& literals, const std::vector<uint32_t>& ids, Arena& arena);
+
+    // Reads tables written by save(), throwing std::runtime_error if they are inconsistent
+    AhoCorasick(BinaryReader& in, Arena& arena);
+
+    void save(BinaryWriter& out) const;
+
+    bool active() const { return !transitions_.empty(); }
+
+    // Returns the offset of the last byte of the earliest-ending occurrence that starts at or
+    // after `from`, or std::string_view::npos
+    size_t find(std::string_view text, size_t from) const;
+
+    // Appends the id of every literal occurring in `text`, once per occurrence
+    void collect(std::string_view text, std::vector<uint32_t>& ids) const;
+
+    // Finds the leftmost-longest literal occurrence starting at or after `from` and sets
+    // [start, end) to it. Returns false if there is none.
+    bool find_span(std::string_view text, size_t from, size_t& start, size_t& end) const;
+
+    size_t state_count() const { return stride_ == 0 ? 0 : transitions_.size() / stride_; }
+
+private:
+    static constexpr uint32_t kMatchTag = 1u << 31;  // The target state ends some literal
+    static constexpr uint32_t kNone = UINT32_MAX;
+    static constexpr int kMaxAccelerationBytes = 64;  // Skipping pays off only for narrow sets
+
+    std::array<uint16_t, 256> byte_class_{};  // Bytes absent from every literal share class 0
+    uint32_t stride_ = 0;                     // Classes per state
+    std::span<const uint32_t> transitions_;       // Target row offset (state * stride_), tagged
+    std::span<const uint32_t> outputs_begin_;     // Per state, start of its own ids in output_ids_
+    std::span<const uint32_t> output_ids_;
+    std::span<const uint32_t> output_lengths_;    // Length of the literal behind each output id
+    uint32_t longest_ = 0;                        // Length of the longest literal
+    std::span<const uint32_t> dictionary_links_;  // Longest proper suffix state that ends a literal
+    bool accelerate_ = false;
+    ClassScanner first_bytes_;                // Bytes that leave the root state
+};
+
+#endif // AHO_CORASICK_H
@@ -0,0 +1,41 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+Arena::~Arena() {
+    while (head_ != nullptr) {
+        Block* previous = head_->previous;
+        ::operator delete(head_);
+        head_ = previous;
+    }
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment) {
+    uintptr_t cursor = reinterpret_cast<uintptr_t>(cursor_);
+    uintptr_t aligned = (cursor + alignment - 1) & ~(uintptr_t{alignment} - 1);
+    if (cursor_ == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(limit_)) {
+        return allocate_slow(bytes, alignment);
+    }
+    bytes_used_ += aligned + bytes - cursor;
+    cursor_ = reinterpret_cast<char*>(aligned + bytes);
+    return reinterpret_cast<void*>(aligned);
+}
+
+// Starts a new block big enough for the request. Whatever was left in the old one is abandoned:
+// the tables placed here are few and large, so the waste stays small.
+void* Arena::allocate_slow(size_t bytes, size_t alignment) {
+    size_t needed = sizeof(Block) + bytes + alignment;
+    size_t size = std::max(next_block_size_, needed);
+    next_block_size_ = std::min(next_block_size_ * 2, kMaxBlockSize);
+
+    Block* block = static_cast<Block*>(::operator new(size));
+    block->previous = head_;
+    block->size = size;
+    head_ = block;
+    bytes_reserved_ += size;
+
+    cursor_ = reinterpret_cast<char*>(block + 1);
+    limit_ = reinterpret_cast<char*>(block) + size;
+    return allocate(bytes, alignment);
+}
@@ -0,0 +1,82 @@
+// arena.h
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Bump-pointer allocator for memory that lives exactly as long as its owner, such as the
+// tables of a compiled pattern. Allocation advances a cursor through the current block and
+// takes a new, larger block when it runs out; nothing is freed on its own, and the destructor
+// releases every block at once. Only trivially destructible objects may be placed here,
+// since their destructors never run.
+class Arena {
+public:
+    Arena() = default;
+    ~Arena();
+
+    // Spans into the arena would dangle in a copy
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Returns `bytes` of uninitialized memory aligned to `alignment` (a power of two)
+    void* allocate(size_t bytes, size_t alignment);
+
+    // Returns `count` value-initialized elements
+    template <typename T>
+    std::span<T> allocate_array(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T> && std::is_trivially_copyable_v<T>);
+        if (count == 0) {
+            return std::span<T>();
+        }
+        T* values = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < count; i++) {
+            new (values + i) T();
+        }
+        return std::span<T>(values, count);
+    }
+
+    template <typename T>
+    std::span<const T> copy(std::span<const T> values) {
+        static_assert(std::is_trivially_destructible_v<T> && std::is_trivially_copyable_v<T>);
+        if (values.empty()) {
+            return std::span<const T>();
+        }
+        T* copied = static_cast<T*>(allocate(values.size_bytes(), alignof(T)));
+        std::memcpy(copied, values.data(), values.size_bytes());
+        return std::span<const T>(copied, values.size());
+    }
+
+    template <typename T>
+    std::span<const T> copy(const std::vector<T>& values) {
+        return copy(std::span<const T>(values));
+    }
+
+    size_t bytes_used() const { return bytes_used_; }          // Handed out, including alignment padding
+    size_t bytes_reserved() const { return bytes_reserved_; }  // Obtained from the heap
+
+private:
+    static constexpr size_t kFirstBlockSize = 4096;
+    static constexpr size_t kMaxBlockSize = 1 << 20;  // Blocks stop doubling here
+
+    // Each block starts with this header; the usable bytes follow it
+    struct Block {
+        Block* previous;
+        size_t size;
+    };
+
+    Block* head_ = nullptr;
+    char* cursor_ = nullptr;
+    char* limit_ = nullptr;
+    size_t next_block_size_ = kFirstBlockSize;
+    size_t bytes_used_ = 0;
+    size_t bytes_reserved_ = 0;
+
+    void* allocate_slow(size_t bytes, size_t alignment);
+};
+
+#endif // ARENA_H
@@ -0,0 +1,270 @@
+#include "backtracker.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+size_t hash_key(const size_t* key, size_t width) {
+    size_t hash = width;
+    for (size_t i = 0; i < width; i++) {
+        hash = hash * 31 + key[i];
+    }
+    return hash ^ (hash >> 29);
+}
+
+} // namespace
+
+Backtracker::Backtracker(ProgramView program) : program_(program) {
+    for (const Inst& inst : program_.insts) {
+        if (inst.op == OpCode::Save) {
+            slot_count_ = std::max<size_t>(slot_count_, inst.x + 1);
+        } else if (inst.op == OpCode::Backref) {
+            slot_count_ = std::max<size_t>(slot_count_, size_t{inst.x} * 2 + 2);
+        }
+    }
+    referenced_slot_.assign(slot_count_, false);
+    for (const Inst& inst : program_.insts) {
+        if (inst.op == OpCode::Backref) {
+            referenced_slot_[inst.x * 2] = true;
+            referenced_slot_[inst.x * 2 + 1] = true;
+        }
+    }
+    for (bool referenced : referenced_slot_) {
+        key_width_ += referenced ? 1 : 0;
+    }
+
+    // Bytes that can begin a match, treating assertions as if they held
+    if (program_.insts.empty()) {
+        return;
+    }
+    ByteSet first;
+    bool may_be_empty = false;
+    std::vector<bool> seen(program_.insts.size(), false);
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        uint32_t pc = stack.back();
+        stack.pop_back();
+        if (seen[pc]) {
+            continue;
+        }
+        seen[pc] = true;
+        const Inst& inst = program_.insts[pc];
+        switch (inst.op) {
+            case OpCode::Byte: first.set(inst.byte); break;
+            case OpCode::Class: first.merge(program_.classes[inst.x]); break;
+            case OpCode::Any:
+            case OpCode::Match:
+            case OpCode::Backref: may_be_empty = true; break;
+            case OpCode::Split:
+                stack.push_back(inst.x);
+                stack.push_back(inst.y);
+                break;
+            case OpCode::Jmp: stack.push_back(inst.x); break;
+            case OpCode::LineStart:
+            case OpCode::LineEnd:
+            case OpCode::Save: stack.push_back(pc + 1); break;
+        }
+    }
+    skip_starts_ = !may_be_empty && first.count() <= kMaxSkipBytes;
+    if (skip_starts_) {
+        first_bytes_ = ClassScanner(first);
+    }
+}
+
+bool Backtracker::search(std::string_view input_line) {
+    reset(input_line);
+    for (size_t start = next_start(0); start <= input_line.length(); start = next_start(start + 1)) {
+        if (run(start, Mode::First)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Backtracker::find_span(std::string_view input_line, size_t from, size_t& start, size_t& end) {
+    reset(input_line);
+    for (size_t begin = next_start(from); begin <= input_line.length(); begin = next_start(begin + 1)) {
+        found_ = false;
+        best_end_ = 0;
+        run(begin, Mode::Longest);
+        if (found_) {
+            start = begin;
+            end = best_end_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Backtracker::collect_matches(std::string_view input_line, std::vector<uint32_t>& ids) {
+    size_t first = ids.size();
+    reset(input_line);
+    ids_ = &ids;
+    for (size_t start = next_start(0); start <= input_line.length(); start = next_start(start + 1)) {
+        run(start, Mode::Collect);
+    }
+    ids_ = nullptr;
+    std::sort(ids.begin() + first, ids.end());
+    ids.erase(std::unique(ids.begin() + first, ids.end()), ids.end());
+}
+
+void Backtracker::reset(std::string_view input_line) {
+    line_ = input_line;
+    slots_.assign(slot_count_, std::string_view::npos);
+    words_per_context_ = (program_.insts.size() * (input_line.length() + 1) + 63) / 64;
+    visited_.clear();
+    context_keys_.clear();
+    context_count_ = 0;
+    context_slots_.assign(kMinContextSlots, kNoContext);
+}
+
+// The first position at or after `start` where a match could begin; past the end if none
+size_t Backtracker::next_start(size_t start) const {
+    if (!skip_starts_ || start >= line_.length()) {
+        return start;
+    }
+    size_t next = first_bytes_.find(line_, start);
+    return next == std::string_view::npos ? line_.length() + 1 : next;
+}
+
+// Visit bits carry over from one start position to the next: a state already explored leads
+// to the same outcomes whichever start reached it, as the start is not part of the state
+uint32_t Backtracker::current_context() {
+    key_.clear();
+    for (size_t slot = 0; slot < slot_count_; slot++) {
+        if (referenced_slot_[slot]) {
+            key_.push_back(slots_[slot]);
+        }
+    }
+    size_t mask = context_slots_.size() - 1;
+    size_t slot = hash_key(key_.data(), key_width_) & mask;
+    for (; context_slots_[slot] != kNoContext; slot = (slot + 1) & mask) {
+        uint32_t context = context_slots_[slot];
+        if (std::equal(key_.begin(), key_.end(), context_keys_.begin() + context * key_width_)) {
+            return context;
+        }
+    }
+
+    if (visited_.size() + words_per_context_ > kMaxVisitedBits / 64) {
+        throw std::runtime_error("Back-reference search exceeded its memory limit");
+    }
+    visited_.resize(visited_.size() + words_per_context_, 0);
+    context_keys_.insert(context_keys_.end(), key_.begin(), key_.end());
+    uint32_t context = context_count_++;
+    context_slots_[slot] = context;
+    if (context_count_ * 2 > context_slots_.size()) {
+        grow_contexts();
+    }
+    return context;
+}
+
+// Doubles the context index and re-inserts every context of the line
+void Backtracker::grow_contexts() {
+    context_slots_.assign(context_slots_.size() * 2, kNoContext);
+    size_t mask = context_slots_.size() - 1;
+    for (uint32_t context = 0; context < context_count_; context++) {
+        size_t slot = hash_key(context_keys_.data() + context * key_width_, key_width_) & mask;
+        while (context_slots_[slot] != kNoContext) {
+            slot = (slot + 1) & mask;
+        }
+        context_slots_[slot] = context;
+    }
+}
+
+// Marks the state visited; returns false if it already was
+bool Backtracker::visit(uint32_t context, uint32_t pc, size_t pos) {
+    size_t bit = static_cast<size_t>(pc) * (line_.length() + 1) + pos;
+    uint64_t& word = visited_[context * words_per_context_ + bit / 64];
+    uint64_t mask = uint64_t{1} << (bit % 64);
+    if (word & mask) {
+        return false;
+    }
+    word |= mask;
+    return true;
+}
+
+// Explores every path from `start`; in Mode::First, returns true at the first Match
+bool Backtracker::run(size_t start, Mode mode) {
+    const size_t length = line_.length();
+    jobs_.clear();
+    jobs_.push_back({0, 0, start, current_context()});
+    while (!jobs_.empty()) {
+        Job job = jobs_.back();
+        jobs_.pop_back();
+        if (job.pc == kRestore) {
+            slots_[job.slot] = job.pos;
+            continue;
+        }
+
+        uint32_t pc = job.pc;
+        size_t pos = job.pos;
+        uint32_t context = job.context;
+        bool alive = true;
+        while (alive && visit(context, pc, pos)) {
+            const Inst& inst = program_.insts[pc];
+            switch (inst.op) {
+                case OpCode::Byte:
+                    alive = pos < length && static_cast<unsigned char>(line_[pos]) == inst.byte;
+                    pos++;
+                    pc++;
+                    break;
+                case OpCode::Class:
+                    alive = pos < length && program_.classes[inst.x].test(static_cast<unsigned char>(line_[pos]));
+                    pos++;
+                    pc++;
+                    break;
+                case OpCode::Any:
+                    alive = pos < length;
+                    pos++;
+                    pc++;
+                    break;
+                case OpCode::LineStart:
+                    alive = pos == 0;
+                    pc++;
+                    break;
+                case OpCode::LineEnd:
+                    alive = pos == length;
+                    pc++;
+                    break;
+                case OpCode::Split:
+                    jobs_.push_back({inst.y, 0, pos, context});
+                    pc = inst.x;
+                    break;
+                case OpCode::Jmp:
+                    pc = inst.x;
+                    break;
+                case OpCode::Save:
+                    // Undone once every path through here has been explored
+                    jobs_.push_back({kRestore, inst.x, slots_[inst.x], 0});
+                    slots_[inst.x] = pos;
+                    if (referenced_slot_[inst.x]) {
+                        context = current_context();
+                    }
+                    pc++;
+                    break;
+                case OpCode::Backref: {
+                    size_t begin = slots_[inst.x * 2];
+                    size_t end = slots_[inst.x * 2 + 1];
+                    alive = begin != std::string_view::npos && end != std::string_view::npos && begin <= end &&
+                            line_.substr(pos).starts_with(line_.substr(begin, end - begin));
+                    pos += alive ? end - begin : 0;
+                    pc++;
+                    break;
+                }
+                case OpCode::Match:
+                    found_ = true;
+                    if (mode == Mode::First) {
+                        return true;
+                    }
+                    if (mode == Mode::Longest) {
+                        best_end_ = std::max(best_end_, pos);
+                    } else {
+                        ids_->push_back(inst.x);
+                    }
+                    alive = false;
+                    break;
+            }
+        }
+    }
+    return false;
+}
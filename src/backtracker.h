@@ -0,0 +1,83 @@
+// backtracker.h
+#ifndef BACKTRACKER_H
+#define BACKTRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "char_class.h"
+#include "regex_program.h"
+
+// Runs programs compiled with captures, which back-references put beyond any automaton.
+// The search is a depth-first walk over (instruction, position) that never enters the same
+// state twice: a bit per state records the visits. A state's future also depends on what the
+// referenced groups have captured, so there is one bit set per distinct assignment of those
+// captures ("context"). That bounds the work by instructions x positions x contexts, and the
+// memory by kMaxVisitedBits, past which the search gives up with std::runtime_error.
+// Only lines an automaton has already accepted are meant to get here. The per-line tables are
+// cleared but never shrunk, so once they have grown to fit the input a search allocates nothing.
+class Backtracker {
+public:
+    static constexpr size_t kMaxVisitedBits = size_t{1} << 28;  // 32 MiB of visit bits per line
+
+    explicit Backtracker(ProgramView program);
+
+    // Returns true if any substring of input_line matches
+    bool search(std::string_view input_line);
+
+    // Finds the leftmost-longest match starting at or after `from` and sets [start, end) to it;
+    // ^ and $ still refer to the whole line. Returns false if there is none.
+    bool find_span(std::string_view input_line, size_t from, size_t& start, size_t& end);
+
+    // Appends the number of every pattern (Match operand) that matches somewhere in input_line
+    void collect_matches(std::string_view input_line, std::vector<uint32_t>& ids);
+
+private:
+    enum class Mode { First, Longest, Collect };
+
+    static constexpr uint32_t kRestore = UINT32_MAX;  // Job that puts a capture slot back
+    static constexpr int kMaxSkipBytes = 64;          // Skipping pays off only for narrow first-byte sets
+    static constexpr uint32_t kNoContext = UINT32_MAX;
+    static constexpr size_t kMinContextSlots = 16;
+
+    // A thread to explore, or an undo record for a capture slot
+    struct Job {
+        uint32_t pc;       // kRestore for undo records
+        uint32_t slot;
+        size_t pos;        // Thread position, or the slot's previous value
+        uint32_t context;  // Context to continue in
+    };
+
+    ProgramView program_;
+    std::vector<bool> referenced_slot_;  // Slots some Backref reads; only they make up a context
+    size_t slot_count_ = 0;
+    size_t key_width_ = 0;               // Referenced slots, so values in each context's key
+    bool skip_starts_ = false;  // Only positions holding one of first_bytes_ can start a match
+    ClassScanner first_bytes_;
+
+    // Per-line scratch
+    std::string_view line_;
+    std::vector<size_t> slots_;
+    std::vector<Job> jobs_;
+    std::vector<uint64_t> visited_;        // One bit per (pc, position), words_per_context_ words per context
+    size_t words_per_context_ = 0;
+    uint32_t context_count_ = 0;
+    std::vector<size_t> context_keys_;     // key_width_ captured positions per context
+    std::vector<uint32_t> context_slots_;  // Open-addressing index from key to context; kNoContext if empty
+    std::vector<size_t> key_;
+
+    // What the current search found
+    size_t best_end_ = 0;
+    bool found_ = false;
+    std::vector<uint32_t>* ids_ = nullptr;
+
+    void reset(std::string_view input_line);
+    size_t next_start(size_t start) const;
+    uint32_t current_context();
+    void grow_contexts();
+    bool visit(uint32_t context, uint32_t pc, size_t pos);
+    bool run(size_t start, Mode mode);
+};
+
+#endif // BACKTRACKER_H
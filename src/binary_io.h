@@ -0,0 +1,124 @@
+// binary_io.h
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "arena.h"
+
+// 64-bit FNV-1a, for checksums in the files these classes read and write
+inline uint64_t hash_bytes(std::string_view data, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (char c : data) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Appends values to a byte string in host byte order; the pattern cache is local to one machine
+class BinaryWriter {
+public:
+    template <typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        data_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // Element count, then the elements; T must have no padding
+    template <typename T>
+    void put_span(std::span<const T> values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        put<uint64_t>(values.size());
+        data_.append(reinterpret_cast<const char*>(values.data()), values.size_bytes());
+    }
+
+    template <typename T>
+    void put_vector(const std::vector<T>& values) {
+        put_span(std::span<const T>(values));
+    }
+
+    void put_string(std::string_view text) {
+        put<uint64_t>(text.length());
+        data_.append(text);
+    }
+
+    const std::string& data() const { return data_; }
+
+private:
+    std::string data_;
+};
+
+// Reads back what a BinaryWriter wrote, throwing std::runtime_error instead of reading past the end
+class BinaryReader {
+public:
+    explicit BinaryReader(std::string_view data) : data_(data) {}
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    std::vector<T> get_vector() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint64_t count = get<uint64_t>();
+        if (count > (data_.length() - position_) / sizeof(T)) {
+            throw std::runtime_error("Truncated binary data");
+        }
+        std::vector<T> values(count);
+        std::memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+        return values;
+    }
+
+    // Reads what put_span or put_vector wrote into memory owned by `arena`
+    template <typename T>
+    std::span<const T> get_span(Arena& arena) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint64_t count = get<uint64_t>();
+        if (count > (data_.length() - position_) / sizeof(T)) {
+            throw std::runtime_error("Truncated binary data");
+        }
+        std::span<T> values = arena.allocate_array<T>(count);
+        if (count > 0) {
+            std::memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+        }
+        return values;
+    }
+
+    // Bytes not read yet
+    size_t remaining() const { return data_.length() - position_; }
+
+    std::string get_string() {
+        uint64_t length = get<uint64_t>();
+        if (length > data_.length() - position_) {
+            throw std::runtime_error("Truncated binary data");
+        }
+        return std::string(take(length), length);
+    }
+
+    bool at_end() const { return position_ == data_.length(); }
+
+private:
+    std::string_view data_;
+    size_t position_ = 0;
+
+    const char* take(size_t length) {
+        if (length > data_.length() - position_) {
+            throw std::runtime_error("Truncated binary data");
+        }
+        const char* start = data_.data() + position_;
+        position_ += length;
+        return start;
+    }
+};
+
+#endif // BINARY_IO_H
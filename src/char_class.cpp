@@ -0,0 +1,229 @@
+#include "char_class.h"
+#include <bit>
+#ifdef GREP_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+
+enum class Kernel { Scalar, Ssse3, Avx2 };
+
+Kernel detect_kernel() {
+#ifdef GREP_HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernel::Avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return Kernel::Ssse3;
+    }
+#endif
+    return Kernel::Scalar;
+}
+
+const Kernel kKernel = detect_kernel();
+
+size_t count_byte_scalar(const char* data, size_t length, unsigned char byte) {
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        count += static_cast<unsigned char>(data[i]) == byte ? 1 : 0;
+    }
+    return count;
+}
+
+bool is_ascii_scalar(const char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (static_cast<unsigned char>(data[i]) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef GREP_HAVE_X86_SIMD
+// Byte compares yield 0xFF per hit, so subtracting them counts hits in 8-bit lanes; those are
+// widened with a sum of absolute differences before any lane can overflow
+constexpr size_t kMaxLaneIterations = 255;
+
+// Used with the SSSE3 kernel, so SSE2 is known to be there even on 32-bit x86
+__attribute__((target("sse2")))
+size_t count_byte_sse2(const char* data, size_t length, unsigned char byte) {
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(byte));
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 16 <= length) {
+        __m128i lanes = _mm_setzero_si128();
+        for (size_t round = 0; round < kMaxLaneIterations && i + 16 <= length; round++, i += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(chunk, needle));
+        }
+        __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+        count += static_cast<size_t>(_mm_cvtsi128_si32(sums)) + static_cast<size_t>(_mm_extract_epi16(sums, 4));
+    }
+    return count + count_byte_scalar(data + i, length - i, byte);
+}
+
+__attribute__((target("avx2")))
+size_t count_byte_avx2(const char* data, size_t length, unsigned char byte) {
+    const __m256i needle = _mm256_set1_epi8(static_cast<char>(byte));
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 32 <= length) {
+        __m256i lanes = _mm256_setzero_si256();
+        for (size_t round = 0; round < kMaxLaneIterations && i + 32 <= length; round++, i += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            lanes = _mm256_sub_epi8(lanes, _mm256_cmpeq_epi8(chunk, needle));
+        }
+        __m256i sums = _mm256_sad_epu8(lanes, _mm256_setzero_si256());
+        // Each 64-bit sum is below 2^16, so its low 32 bits hold all of it
+        count += static_cast<size_t>(_mm256_extract_epi32(sums, 0) + _mm256_extract_epi32(sums, 2) +
+                                     _mm256_extract_epi32(sums, 4) + _mm256_extract_epi32(sums, 6));
+    }
+    return count + count_byte_sse2(data + i, length - i, byte);
+}
+
+// OR-ing chunks together keeps any top bit set; one movemask per 64 or 128 bytes tests them all
+__attribute__((target("sse2")))
+bool is_ascii_sse2(const char* data, size_t length) {
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0) {
+            return false;
+        }
+    }
+    for (; i + 16 <= length; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))) != 0) {
+            return false;
+        }
+    }
+    return is_ascii_scalar(data + i, length - i);
+}
+
+__attribute__((target("avx2")))
+bool is_ascii_avx2(const char* data, size_t length) {
+    size_t i = 0;
+    for (; i + 128 <= length; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 96));
+        if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d))) != 0) {
+            return false;
+        }
+    }
+    return is_ascii_sse2(data + i, length - i);
+}
+
+// One bit per value of the byte's high nibble bits 4-6
+alignas(16) constexpr uint8_t kHighBits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+#endif
+
+} // namespace
+
+// Visits only the members, so building a scanner for a small set costs a few steps per byte
+ClassScanner::ClassScanner(const ByteSet& set) : set_(set) {
+    for (unsigned word = 0; word < set.bits.size(); word++) {
+        for (uint64_t bits = set.bits[word]; bits != 0; bits &= bits - 1) {
+            unsigned c = word * 64 + static_cast<unsigned>(std::countr_zero(bits));
+            uint8_t bit = static_cast<uint8_t>(1u << ((c >> 4) & 7));
+            (c < 0x80 ? top_clear_ : top_set_)[c & 0x0F] |= bit;
+        }
+    }
+}
+
+size_t ClassScanner::find(std::string_view text, size_t from) const {
+#ifdef GREP_HAVE_X86_SIMD
+    switch (kKernel) {
+        case Kernel::Avx2: return find_avx2(text.data(), from, text.length());
+        case Kernel::Ssse3: return find_ssse3(text.data(), from, text.length());
+        case Kernel::Scalar: break;
+    }
+#endif
+    return find_scalar(text.data(), from, text.length());
+}
+
+size_t ClassScanner::find_scalar(const char* data, size_t from, size_t length) const {
+    for (size_t i = from; i < length; i++) {
+        if (set_.test(static_cast<unsigned char>(data[i]))) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+#ifdef GREP_HAVE_X86_SIMD
+// pshufb yields zero for lanes whose index has the top bit set, so looking up the byte itself
+// hits top_clear_ only for 0x00-0x7F and looking up byte ^ 0x80 hits top_set_ only for 0x80-0xFF
+__attribute__((target("ssse3")))
+size_t ClassScanner::find_ssse3(const char* data, size_t from, size_t length) const {
+    const __m128i clear_table = _mm_load_si128(reinterpret_cast<const __m128i*>(top_clear_.data()));
+    const __m128i set_table = _mm_load_si128(reinterpret_cast<const __m128i*>(top_set_.data()));
+    const __m128i high_bits = _mm_load_si128(reinterpret_cast<const __m128i*>(kHighBits));
+    const __m128i top_bit = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i low_three = _mm_set1_epi8(0x07);
+
+    size_t i = from;
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i rows = _mm_or_si128(_mm_shuffle_epi8(clear_table, chunk),
+                                    _mm_shuffle_epi8(set_table, _mm_xor_si128(chunk, top_bit)));
+        __m128i column = _mm_shuffle_epi8(high_bits, _mm_and_si128(_mm_srli_epi16(chunk, 4), low_three));
+        __m128i hits = _mm_cmpeq_epi8(_mm_and_si128(rows, column), _mm_setzero_si128());
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(hits)) & 0xFFFF;
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return find_scalar(data, i, length);
+}
+
+__attribute__((target("avx2")))
+size_t ClassScanner::find_avx2(const char* data, size_t from, size_t length) const {
+    const __m256i clear_table = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(top_clear_.data())));
+    const __m256i set_table = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(top_set_.data())));
+    const __m256i high_bits = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(kHighBits)));
+    const __m256i top_bit = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i low_three = _mm256_set1_epi8(0x07);
+
+    size_t i = from;
+    for (; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i rows = _mm256_or_si256(_mm256_shuffle_epi8(clear_table, chunk),
+                                       _mm256_shuffle_epi8(set_table, _mm256_xor_si256(chunk, top_bit)));
+        __m256i column = _mm256_shuffle_epi8(high_bits, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), low_three));
+        __m256i hits = _mm256_cmpeq_epi8(_mm256_and_si256(rows, column), _mm256_setzero_si256());
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask != 0) {
+            return i + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return find_ssse3(data, i, length);
+}
+#endif
+
+size_t count_byte(std::string_view text, unsigned char byte) {
+#ifdef GREP_HAVE_X86_SIMD
+    if (kKernel == Kernel::Avx2) {
+        return count_byte_avx2(text.data(), text.length(), byte);
+    }
+    if (kKernel == Kernel::Ssse3) {
+        return count_byte_sse2(text.data(), text.length(), byte);
+    }
+#endif
+    return count_byte_scalar(text.data(), text.length(), byte);
+}
+
+bool is_ascii(std::string_view text) {
+#ifdef GREP_HAVE_X86_SIMD
+    if (kKernel == Kernel::Avx2) {
+        return is_ascii_avx2(text.data(), text.length());
+    }
+    if (kKernel == Kernel::Ssse3) {
+        return is_ascii_sse2(text.data(), text.length());
+    }
+#endif
+    return is_ascii_scalar(text.data(), text.length());
+}
@@ -0,0 +1,118 @@
+// char_class.h
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// The SSE2, SSSE3 and AVX2 kernels exist only on x86; elsewhere every scan takes the scalar path
+#if defined(__x86_64__) || defined(__i386__)
+#define GREP_HAVE_X86_SIMD
+#endif
+
+// 256-bit set of bytes used for \d, \w, . and [...] groups.
+// Everything is constexpr so patterns can also be compiled at compile time (static_regex.h).
+struct ByteSet {
+    std::array<uint64_t, 4> bits{};
+
+    constexpr void set(unsigned char c) { bits[c >> 6] |= uint64_t{1} << (c & 63); }
+    constexpr void reset(unsigned char c) { bits[c >> 6] &= ~(uint64_t{1} << (c & 63)); }
+    constexpr bool test(unsigned char c) const { return (bits[c >> 6] >> (c & 63)) & 1; }
+
+    constexpr void set_range(unsigned char lo, unsigned char hi) {
+        for (unsigned c = lo; c <= hi; c++) {
+            set(static_cast<unsigned char>(c));
+        }
+    }
+
+    constexpr void merge(const ByteSet& other) {
+        for (size_t i = 0; i < bits.size(); i++) {
+            bits[i] |= other.bits[i];
+        }
+    }
+
+    constexpr void invert() {
+        for (uint64_t& word : bits) {
+            word = ~word;
+        }
+    }
+
+    constexpr int count() const {
+        int total = 0;
+        for (uint64_t word : bits) {
+            total += std::popcount(word);
+        }
+        return total;
+    }
+};
+
+// [0-9]
+constexpr ByteSet digit_set() {
+    ByteSet set;
+    set.set_range('0', '9');
+    return set;
+}
+
+// [A-Za-z0-9]
+constexpr ByteSet alnum_set() {
+    ByteSet set;
+    set.set_range('a', 'z');
+    set.set_range('A', 'Z');
+    set.set_range('0', '9');
+    return set;
+}
+
+// [A-Za-z0-9_]
+constexpr ByteSet word_set() {
+    ByteSet set = alnum_set();
+    set.set('_');
+    return set;
+}
+
+// [ \t\n\r\f\v]
+constexpr ByteSet space_set() {
+    ByteSet set;
+    for (char c : std::string_view(" \t\n\r\f\v")) {
+        set.set(static_cast<unsigned char>(c));
+    }
+    return set;
+}
+
+// Finds bytes belonging to a ByteSet 16 or 32 at a time. The set is split by nibbles into
+// two 16-byte shuffle tables (one per value of the top bit), so any set classifies in a few
+// pshufb instructions. The AVX2, SSSE3 or scalar kernel is picked once from the running CPU;
+// other architectures always use the scalar one.
+class ClassScanner {
+public:
+    ClassScanner() = default;
+    explicit ClassScanner(const ByteSet& set);
+
+    // Returns the offset of the first byte at or after `from` that is in the set, or npos
+    size_t find(std::string_view text, size_t from = 0) const;
+
+    const ByteSet& set() const { return set_; }
+
+private:
+    ByteSet set_;
+    alignas(16) std::array<uint8_t, 16> top_clear_{};  // Rows for bytes 0x00-0x7F, indexed by low nibble
+    alignas(16) std::array<uint8_t, 16> top_set_{};    // Rows for bytes 0x80-0xFF, indexed by low nibble
+
+    size_t find_scalar(const char* data, size_t from, size_t length) const;
+#ifdef GREP_HAVE_X86_SIMD
+    size_t find_ssse3(const char* data, size_t from, size_t length) const;
+    size_t find_avx2(const char* data, size_t from, size_t length) const;
+#endif
+};
+
+// Number of occurrences of `byte` in text, 16 or 32 bytes at a time; used to number lines
+// by counting '\n' over whole regions instead of line by line
+size_t count_byte(std::string_view text, unsigned char byte);
+
+// True if every byte of text is below 0x80, checked 16 or 32 bytes at a time; UTF-8 mode runs
+// the plain byte automata on such text
+bool is_ascii(std::string_view text);
+
+#endif // CHAR_CLASS_H
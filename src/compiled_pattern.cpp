@@ -0,0 +1,426 @@
+#include "grep_funcs.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include "search_stats.h"
+
+namespace {
+
+std::atomic<uint64_t> next_pattern_id{1};
+
+// Only '.', escapes, groups and non-ASCII bytes can parse differently in UTF-8 mode
+bool depends_on_utf8_mode(const std::string& pattern) {
+    return std::any_of(pattern.begin(), pattern.end(), [](char c) {
+        return c == '.' || c == '\\' || c == '[' || static_cast<unsigned char>(c) >= 0x80;
+    });
+}
+
+} // namespace
+
+CompiledPattern::CompiledPattern(std::string_view pattern, uint32_t flags)
+    : CompiledPattern(std::vector<std::string>{std::string(pattern)}, flags) {}
+
+CompiledPattern::CompiledPattern(const std::vector<std::string>& patterns, uint32_t flags)
+    : patterns_(patterns), id_(next_pattern_id++) {
+    bool utf8 = (flags & kUtf8Mode) != 0 && std::any_of(patterns_.begin(), patterns_.end(), depends_on_utf8_mode);
+    if (utf8) {
+        ascii_ = std::make_unique<CompiledPattern>(patterns_);
+    }
+
+    std::vector<RegexAst> asts;
+    std::vector<RequiredLiterals> literals;
+    size_t literal_count = 0;
+    for (const std::string& pattern : patterns_) {
+        asts.push_back(parse_regex(pattern, utf8));
+        literals.push_back(extract_required_literals(asts.back()));
+        if (literals.back().exact) {
+            literal_count += literals.back().alternatives.size();
+        }
+    }
+
+    // A pattern with an exact literal set matches exactly the lines containing one of them
+    bool split_literals = literal_count > LiteralPrefilter::kMaxLiterals;
+    std::vector<RegexAst> program_asts;
+    std::vector<uint32_t> program_ids;
+    std::vector<std::string> set_literals;
+    std::vector<uint32_t> set_ids;
+    for (size_t i = 0; i < asts.size(); i++) {
+        uint32_t index = static_cast<uint32_t>(i);
+        if (split_literals && literals[i].exact) {
+            for (const std::string& literal : literals[i].alternatives) {
+                set_literals.push_back(literal);
+                set_ids.push_back(index);
+            }
+        } else {
+            program_asts.push_back(std::move(asts[i]));
+            program_ids.push_back(index);
+        }
+    }
+    literal_set_ = AhoCorasick(set_literals, set_ids, arena_);
+    if (program_asts.empty()) {
+        return;
+    }
+
+    // The program and the literal prefilter are both derived from the merged parse
+    RegexSet set = merge_regex_asts(program_asts, program_ids);
+    has_program_ = true;
+    program_ = copy_program(compile_regex_set(set), arena_);
+    has_backrefs_ = set.ast.has_backrefs;
+    if (has_backrefs_) {
+        backtrack_program_ = copy_program(compile_regex_set(set, true), arena_);
+    }
+    prefilter_ = LiteralPrefilter(extract_required_literals(set.ast));
+
+    // x, (x) and x+ all match exactly the lines containing some byte of class x
+    const RegexAst& ast = set.ast;
+    int node = ast.root;
+    while (ast.nodes[node].type == RegexNodeType::Group || ast.nodes[node].type == RegexNodeType::Plus) {
+        node = ast.nodes[node].children[0];
+    }
+    if (ast.nodes[node].type == RegexNodeType::Class) {
+        ByteSet class_set = ast.classes[ast.nodes[node].class_index];
+        class_set.reset('\n');  // Never part of a line, even for negated groups
+        class_only_ = true;
+        class_scanner_ = ClassScanner(class_set);
+    }
+}
+
+CompiledPattern::CompiledPattern(BinaryReader& in) : id_(next_pattern_id++) {
+    uint64_t count = in.get<uint64_t>();
+    for (uint64_t i = 0; i < count; i++) {
+        patterns_.push_back(in.get_string());
+    }
+    if (in.get<uint8_t>() != 0) {
+        ascii_ = std::make_unique<CompiledPattern>(in);
+    }
+    literal_set_ = AhoCorasick(in, arena_);
+    has_program_ = in.get<uint8_t>() != 0;
+    if (!has_program_) {
+        return;
+    }
+    program_ = read_program(in, arena_);
+    has_backrefs_ = in.get<uint8_t>() != 0;
+    if (has_backrefs_) {
+        backtrack_program_ = read_program(in, arena_);
+    }
+
+    RequiredLiterals literals;
+    uint64_t literal_count = in.get<uint64_t>();
+    for (uint64_t i = 0; i < literal_count; i++) {
+        literals.alternatives.push_back(in.get_string());
+    }
+    literals.exact = in.get<uint8_t>() != 0;
+    prefilter_ = LiteralPrefilter(literals);
+
+    class_only_ = in.get<uint8_t>() != 0;
+    ByteSet class_set = in.get<ByteSet>();
+    if (class_only_) {
+        class_scanner_ = ClassScanner(class_set);
+    }
+}
+
+void CompiledPattern::save(BinaryWriter& out) const {
+    out.put<uint64_t>(patterns_.size());
+    for (const std::string& pattern : patterns_) {
+        out.put_string(pattern);
+    }
+    out.put<uint8_t>(ascii_ != nullptr);
+    if (ascii_ != nullptr) {
+        ascii_->save(out);
+    }
+    literal_set_.save(out);
+    out.put<uint8_t>(has_program_);
+    if (!has_program_) {
+        return;
+    }
+    write_program(out, program_);
+    out.put<uint8_t>(has_backrefs_);
+    if (has_backrefs_) {
+        write_program(out, backtrack_program_);
+    }
+
+    // The prefilter and the class scanner rebuild their SIMD tables from these in microseconds
+    out.put<uint64_t>(prefilter_.literals().size());
+    for (const std::string& literal : prefilter_.literals()) {
+        out.put_string(literal);
+    }
+    out.put<uint8_t>(prefilter_.exact());
+    out.put<uint8_t>(class_only_);
+    out.put(class_scanner_.set());
+}
+
+bool CompiledPattern::match(std::string_view input_line) const {
+    if (ascii_ != nullptr && is_ascii(input_line)) {
+        return ascii_->match(input_line);
+    }
+    if (literal_set_.active() && literal_set_.find(input_line, 0) != std::string_view::npos) {
+        return true;
+    }
+    return has_program_ && match_program(input_line);
+}
+
+bool CompiledPattern::match_program(std::string_view input_line) const {
+    if (class_only_) {
+        return class_scanner_.find(input_line) != std::string_view::npos;
+    }
+    if (prefilter_.active()) {
+        bool has_literal = prefilter_.find(input_line, 0) != std::string_view::npos;
+        if (!has_literal || prefilter_.exact()) {
+            return has_literal;
+        }
+    }
+    if (!has_backrefs_) {
+        return thread_engines().dfa.search(input_line);
+    }
+    Engines& engines = thread_engines();
+    return engines.dfa.search(input_line) && engines.backtracker.search(input_line);
+}
+
+size_t CompiledPattern::find_line(std::string_view buffer, size_t from) const {
+    LineCursor cursor;
+    return find_line(buffer, from, cursor);
+}
+
+size_t CompiledPattern::find_line(std::string_view buffer, size_t from, LineCursor& cursor) const {
+    if (ascii_ == nullptr) {
+        return find_line_in(buffer, from, cursor);
+    }
+    while (from < buffer.length()) {
+        if (from >= cursor.window_end) {
+            // Windows end just past a '\n', so every line lies wholly within one
+            size_t end = from + kAsciiWindow;
+            if (end >= buffer.length()) {
+                end = buffer.length();
+            } else {
+                const void* newline = std::memchr(buffer.data() + end, '\n', buffer.length() - end);
+                end = newline ? static_cast<const char*>(newline) - buffer.data() + 1 : buffer.length();
+            }
+            cursor.window_end = end;
+            cursor.window_ascii = is_ascii(buffer.substr(from, end - from));
+            cursor.literals_scanned = false;  // Whatever it remembers lies within the previous window
+            if (search_stats_enabled()) {
+                (cursor.window_ascii ? thread_stats().ascii_windows : thread_stats().utf8_windows)++;
+            }
+        }
+        const CompiledPattern& engine = cursor.window_ascii ? *ascii_ : *this;
+        size_t hit = engine.find_line_in(buffer.substr(0, cursor.window_end), from, cursor);
+        if (hit != std::string_view::npos) {
+            return hit;
+        }
+        from = cursor.window_end;
+    }
+    return std::string_view::npos;
+}
+
+size_t CompiledPattern::find_line_in(std::string_view buffer, size_t from, LineCursor& cursor) const {
+    if (!literal_set_.active()) {
+        return has_program_ ? find_program_line(buffer, from) : std::string_view::npos;
+    }
+    // A remembered hit on a later line is still the first one: nothing before it matched
+    if (!cursor.literals_scanned || (cursor.literal_hit != std::string_view::npos && cursor.literal_hit < from)) {
+        cursor.literal_hit = literal_set_.find(buffer, from);
+        cursor.literals_scanned = true;
+    }
+    size_t literal_hit = cursor.literal_hit;
+    if (!has_program_) {
+        return literal_hit;
+    }
+
+    // The automaton only has to beat the literal hit, so it stops at the end of that line
+    size_t limit = buffer.length();
+    if (literal_hit != std::string_view::npos) {
+        const void* after = std::memchr(buffer.data() + literal_hit, '\n', buffer.length() - literal_hit);
+        limit = after ? static_cast<const char*>(after) - buffer.data() : buffer.length();
+    }
+    size_t program_hit = find_program_line(buffer.substr(0, limit), from);
+    return program_hit != std::string_view::npos ? program_hit : literal_hit;
+}
+
+// With back-references, each line the automaton finds is only a candidate for the Backtracker
+size_t CompiledPattern::find_program_line(std::string_view buffer, size_t from) const {
+    if (!has_backrefs_) {
+        return find_candidate_line(buffer, from);
+    }
+    const char* data = buffer.data();
+    Backtracker& backtracker = thread_engines().backtracker;
+    while (from < buffer.length()) {
+        size_t hit = find_candidate_line(buffer, from);
+        if (hit == std::string_view::npos) {
+            break;
+        }
+        const void* before = hit > from ? ::memrchr(data + from, '\n', hit - from) : nullptr;
+        size_t line_start = before ? static_cast<const char*>(before) - data + 1 : from;
+        const void* after = std::memchr(data + hit, '\n', buffer.length() - hit);
+        size_t line_end = after ? static_cast<const char*>(after) - data : buffer.length();
+
+        // In UTF-8 mode an ASCII line can be decided by the bytewise twin, whose programs are far smaller
+        std::string_view line = buffer.substr(line_start, line_end - line_start);
+        bool ascii_line = ascii_ != nullptr && is_ascii(line);
+        if (search_stats_enabled() && !ascii_line) {
+            thread_stats().backtracked_lines++;
+        }
+        if (ascii_line ? ascii_->match(line) : backtracker.search(line)) {
+            return hit;
+        }
+        from = line_end + 1;
+    }
+    return std::string_view::npos;
+}
+
+// With a prefilter, only lines containing a required literal are delimited and run through the DFA
+size_t CompiledPattern::find_candidate_line(std::string_view buffer, size_t from) const {
+    if (class_only_) {
+        return class_scanner_.find(buffer, from);
+    }
+    LazyDfa& dfa = thread_engines().dfa;
+    if (!prefilter_.active()) {
+        return dfa.find(buffer, from);
+    }
+
+    const char* data = buffer.data();
+    while (from < buffer.length()) {
+        size_t hit = prefilter_.find(buffer, from);
+        if (hit == std::string_view::npos || prefilter_.exact()) {
+            return hit;
+        }
+
+        const void* before = hit > from ? ::memrchr(data + from, '\n', hit - from) : nullptr;
+        size_t line_start = before ? static_cast<const char*>(before) - data + 1 : from;
+        const void* after = std::memchr(data + hit, '\n', buffer.length() - hit);
+        size_t line_end = after ? static_cast<const char*>(after) - data : buffer.length();
+
+        bool confirmed = dfa.search(buffer.substr(line_start, line_end - line_start));
+        if (search_stats_enabled()) {
+            SearchStats& stats = thread_stats();
+            stats.candidate_lines++;
+            stats.confirmed_lines += confirmed;
+        }
+        if (confirmed) {
+            return hit;
+        }
+        from = line_end + 1;
+    }
+    return std::string_view::npos;
+}
+
+void CompiledPattern::matching_patterns(std::string_view input_line, std::vector<uint32_t>& ids) const {
+    if (ascii_ != nullptr && is_ascii(input_line)) {
+        ascii_->matching_patterns(input_line, ids);
+        return;
+    }
+    size_t first = ids.size();
+    if (literal_set_.active()) {
+        literal_set_.collect(input_line, ids);
+    }
+    if (has_program_ && has_backrefs_) {
+        thread_engines().backtracker.collect_matches(input_line, ids);
+    } else if (has_program_) {
+        thread_engines().dfa.collect_matches(input_line, ids);
+    }
+    std::sort(ids.begin() + first, ids.end());
+    ids.erase(std::unique(ids.begin() + first, ids.end()), ids.end());
+}
+
+bool CompiledPattern::find_span(std::string_view input_line, size_t from, MatchSpan& span) const {
+    if (ascii_ != nullptr && is_ascii(input_line)) {
+        return ascii_->find_span(input_line, from, span);
+    }
+    MatchSpan literal;
+    bool found_literal = literal_set_.active() && literal_set_.find_span(input_line, from, literal.start, literal.end);
+    MatchSpan program;
+    bool found_program = false;
+    if (has_program_ && has_backrefs_) {
+        found_program = thread_engines().backtracker.find_span(input_line, from, program.start, program.end);
+    } else if (has_program_) {
+        found_program = thread_engines().dfa.find_span(input_line, from, program.start, program.end);
+    }
+    if (found_literal && found_program) {
+        bool literal_wins = literal.start < program.start ||
+                            (literal.start == program.start && literal.end > program.end);
+        span = literal_wins ? literal : program;
+        return true;
+    }
+    if (found_literal || found_program) {
+        span = found_literal ? literal : program;
+        return true;
+    }
+    return false;
+}
+
+RequiredLiterals CompiledPattern::required_literals() const {
+    RequiredLiterals merged;
+    for (const std::string& pattern : patterns_) {
+        RequiredLiterals literals = extract_required_literals(parse_regex(pattern, ascii_ != nullptr));
+        if (literals.alternatives.empty()) {
+            return RequiredLiterals();
+        }
+        merged.alternatives.insert(merged.alternatives.end(), literals.alternatives.begin(),
+                                   literals.alternatives.end());
+    }
+    return merged;
+}
+
+std::string CompiledPattern::strategy() const {
+    if (ascii_ != nullptr) {
+        return "utf8: " + own_strategy() + "; ascii windows: " + ascii_->strategy();
+    }
+    return own_strategy();
+}
+
+// The engines of this object alone, leaving out the bytewise twin
+std::string CompiledPattern::own_strategy() const {
+    std::string engines;
+    if (literal_set_.active()) {
+        engines = "aho-corasick literal set";
+    }
+    if (!has_program_) {
+        return engines.empty() ? "none" : engines;
+    }
+    if (!engines.empty()) {
+        engines += " + ";
+    }
+    if (class_only_) {
+        return engines + "simd class scan";
+    }
+    if (prefilter_.active()) {
+        engines += prefilter_.literals().size() == 1 ? "memchr prefilter" : "teddy prefilter";
+        if (prefilter_.exact()) {
+            return engines + " (exact)";
+        }
+        engines += " + ";
+    }
+    engines += "lazy dfa";
+    return has_backrefs_ ? engines + " + backtracker" : engines;
+}
+
+void CompiledPattern::add_engine_stats(SearchStats& stats) const {
+    if (ascii_ != nullptr) {
+        ascii_->add_engine_stats(stats);
+    }
+    std::lock_guard<std::mutex> lock(caches_mutex_);
+    for (const auto& [thread, engines] : caches_) {
+        stats.dfa_states += engines->dfa.states_built();
+        stats.dfa_flushes += engines->dfa.flush_count();
+        stats.nfa_fallbacks += engines->dfa.fallback_count();
+    }
+}
+
+// The last pattern used on this thread is remembered, so the pattern's own map is only
+// consulted on a switch. Ids are never reused, so the remembered pointer of a destroyed
+// pattern is never followed.
+CompiledPattern::Engines& CompiledPattern::thread_engines() const {
+    thread_local uint64_t last_id = 0;
+    thread_local Engines* last_engines = nullptr;
+    if (last_id == id_) {
+        return *last_engines;
+    }
+
+    std::lock_guard<std::mutex> lock(caches_mutex_);
+    std::unique_ptr<Engines>& engines = caches_[std::this_thread::get_id()];
+    if (engines == nullptr) {
+        engines = std::make_unique<Engines>(program_, backtrack_program_);
+    }
+    last_id = id_;
+    last_engines = engines.get();
+    return *engines;
+}
@@ -0,0 +1,320 @@
+#include "decompress.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <unistd.h>
+#ifdef GREP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GREP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr size_t kMagicLength = 4;  // Enough bytes to tell every supported format apart
+
+// Turns the raw bytes of one input into its uncompressed bytes, a piece at a time
+class Decoder {
+public:
+    virtual ~Decoder() = default;
+
+    // Decodes from the front of `input` into `output`, dropping what it consumed from `input`;
+    // returns the number of bytes written
+    virtual size_t decode(std::string_view& input, char* output, size_t capacity) = 0;
+
+    // Called once the input is exhausted; throws if it stopped in the middle of a stream
+    virtual void finish() const {}
+};
+
+class PlainDecoder : public Decoder {
+public:
+    size_t decode(std::string_view& input, char* output, size_t capacity) override {
+        size_t length = std::min(input.length(), capacity);
+        std::memcpy(output, input.data(), length);
+        input.remove_prefix(length);
+        return length;
+    }
+};
+
+#ifdef GREP_HAVE_ZLIB
+class GzipDecoder : public Decoder {
+public:
+    GzipDecoder() {
+        // 16 + MAX_WBITS: a gzip header and trailer around the deflate data
+        if (inflateInit2(&stream_, 16 + MAX_WBITS) != Z_OK) {
+            throw std::runtime_error("Cannot initialize zlib");
+        }
+    }
+
+    ~GzipDecoder() override { inflateEnd(&stream_); }
+
+    size_t decode(std::string_view& input, char* output, size_t capacity) override {
+        if (member_ended_) {
+            // Another member may follow, as with `cat a.gz b.gz`; anything else is padding,
+            // which gzip ignores too
+            if (input.empty() || static_cast<unsigned char>(input[0]) != 0x1f) {
+                input = std::string_view();
+                return 0;
+            }
+            inflateReset(&stream_);
+            member_ended_ = false;
+        }
+        stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream_.avail_in = static_cast<uInt>(std::min<size_t>(input.length(), UINT_MAX));
+        stream_.next_out = reinterpret_cast<Bytef*>(output);
+        stream_.avail_out = static_cast<uInt>(std::min<size_t>(capacity, UINT_MAX));
+        uInt offered = stream_.avail_in;
+        int status = inflate(&stream_, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            throw std::runtime_error(std::string("Invalid gzip data: ") + (stream_.msg ? stream_.msg : "inflate failed"));
+        }
+        member_ended_ = status == Z_STREAM_END;
+        input.remove_prefix(offered - stream_.avail_in);
+        return static_cast<size_t>(reinterpret_cast<char*>(stream_.next_out) - output);
+    }
+
+    void finish() const override {
+        if (!member_ended_) {
+            throw std::runtime_error("Unexpected end of gzip data");
+        }
+    }
+
+private:
+    z_stream stream_{};
+    bool member_ended_ = false;
+};
+#endif
+
+#ifdef GREP_HAVE_ZSTD
+class ZstdDecoder : public Decoder {
+public:
+    ZstdDecoder() : stream_(ZSTD_createDStream()) {
+        if (stream_ == nullptr) {
+            throw std::runtime_error("Cannot initialize zstd");
+        }
+    }
+
+    ~ZstdDecoder() override { ZSTD_freeDStream(stream_); }
+
+    size_t decode(std::string_view& input, char* output, size_t capacity) override {
+        ZSTD_inBuffer in{input.data(), input.length(), 0};
+        ZSTD_outBuffer out{output, capacity, 0};
+        size_t status = ZSTD_decompressStream(stream_, &out, &in);
+        if (ZSTD_isError(status)) {
+            throw std::runtime_error(std::string("Invalid zstd data: ") + ZSTD_getErrorName(status));
+        }
+        // 0 means a frame is complete and fully flushed; the next one, if any, starts afresh.
+        // A call that moves nothing, as at the end of input, leaves the frame state alone.
+        if (in.pos > 0 || out.pos > 0) {
+            frame_ended_ = status == 0;
+        }
+        input.remove_prefix(in.pos);
+        return out.pos;
+    }
+
+    void finish() const override {
+        if (!frame_ended_) {
+            throw std::runtime_error("Unexpected end of zstd data");
+        }
+    }
+
+private:
+    ZSTD_DStream* stream_;
+    bool frame_ended_ = false;
+};
+#endif
+
+std::unique_ptr<Decoder> make_decoder(Compression format) {
+    switch (format) {
+        case Compression::Gzip:
+#ifdef GREP_HAVE_ZLIB
+            return std::make_unique<GzipDecoder>();
+#else
+            throw std::runtime_error("gzip input, but this build has no zlib support");
+#endif
+        case Compression::Zstd:
+#ifdef GREP_HAVE_ZSTD
+            return std::make_unique<ZstdDecoder>();
+#else
+            throw std::runtime_error("zstd input, but this build has no zstd support");
+#endif
+        case Compression::None:
+            break;
+    }
+    return std::make_unique<PlainDecoder>();
+}
+
+// One read(2), retried on EINTR; returns 0 at end of input
+size_t read_some(int fd, char* data, size_t capacity) {
+    while (true) {
+        ssize_t count = ::read(fd, data, capacity);
+        if (count >= 0) {
+            return static_cast<size_t>(count);
+        }
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("Read error: ") + std::strerror(errno));
+        }
+    }
+}
+
+} // namespace
+
+Compression detect_compression(std::string_view head) {
+    auto starts_with = [&](std::initializer_list<unsigned char> magic) {
+        return head.length() >= magic.size() &&
+               std::equal(magic.begin(), magic.end(), head.begin(),
+                          [](unsigned char expected, char actual) { return expected == static_cast<unsigned char>(actual); });
+    };
+    if (starts_with({0x1f, 0x8b})) {
+        return Compression::Gzip;
+    }
+    if (starts_with({0x28, 0xb5, 0x2f, 0xfd})) {
+        return Compression::Zstd;
+    }
+    return Compression::None;
+}
+
+DecompressingReader::DecompressingReader(int fd) : fd_(fd), ring_(kRingSize) {
+    producer_ = std::thread(&DecompressingReader::run_producer, this);
+}
+
+DecompressingReader::~DecompressingReader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    producer_.join();
+}
+
+bool DecompressingReader::next_block(std::string_view& block) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (holding_) {
+        // The caller is done with the previous block, so its buffer can be refilled
+        ring_[next_].full = false;
+        next_ = (next_ + 1) % kRingSize;
+        holding_ = false;
+        changed_.notify_all();
+    }
+    changed_.wait(lock, [&]() { return ring_[next_].full || finished_; });
+    if (!ring_[next_].full) {
+        if (!error_.empty()) {
+            throw std::runtime_error(error_);
+        }
+        return false;
+    }
+    holding_ = true;
+    block = std::string_view(ring_[next_].data.data(), ring_[next_].length);
+    return true;
+}
+
+// Errors surface in next_block once the buffers produced before them are consumed
+void DecompressingReader::run_producer() {
+    std::string error;
+    try {
+        produce();
+    } catch (const std::runtime_error& e) {
+        error = e.what();
+    } catch (const std::bad_alloc&) {
+        error = "Out of memory";
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        error_ = error;
+    }
+    changed_.notify_all();
+}
+
+void DecompressingReader::produce() {
+    // The magic bytes may arrive over several reads from a pipe
+    std::vector<char> raw(kInputChunk);
+    size_t head = 0;
+    bool input_ended = false;
+    while (head < kMagicLength && !input_ended) {
+        size_t count = read_some(fd_, raw.data() + head, raw.size() - head);
+        input_ended = count == 0;
+        head += count;
+    }
+    std::string_view input(raw.data(), head);
+    std::unique_ptr<Decoder> decoder = make_decoder(detect_compression(input));
+
+    std::string carry;  // Partial last line of the previous buffer
+    for (size_t index = 0; ; index = (index + 1) % kRingSize) {
+        Buffer* buffer = acquire(index);
+        if (buffer == nullptr) {
+            return;
+        }
+        if (buffer->data.size() < std::max(kBufferSize, carry.length() * 2)) {
+            buffer->data.resize(std::max(kBufferSize, carry.length() * 2));
+        }
+        std::memcpy(buffer->data.data(), carry.data(), carry.length());
+        size_t length = carry.length();
+
+        bool ended = false;
+        size_t split = 0;  // Bytes up to and including the buffer's last '\n'
+        while (true) {
+            while (length < buffer->data.size()) {
+                if (input.empty() && !input_ended) {
+                    size_t count = read_some(fd_, raw.data(), raw.size());
+                    input_ended = count == 0;
+                    input = std::string_view(raw.data(), count);
+                    continue;
+                }
+                size_t offered = input.length();
+                size_t produced = decoder->decode(input, buffer->data.data() + length, buffer->data.size() - length);
+                length += produced;
+                if (produced == 0 && input.length() == offered) {
+                    if (!input.empty()) {
+                        throw std::runtime_error("Invalid compressed data");
+                    }
+                    ended = true;  // Nothing left to read or to flush
+                    break;
+                }
+            }
+            if (ended) {
+                break;
+            }
+            const void* newline = ::memrchr(buffer->data.data(), '\n', length);
+            if (newline != nullptr) {
+                split = static_cast<const char*>(newline) - buffer->data.data() + 1;
+                break;
+            }
+            // A line longer than the whole buffer
+            buffer->data.resize(buffer->data.size() * 2);
+        }
+
+        if (ended) {
+            buffer->length = length;
+            if (length > 0) {
+                publish(index);
+            }
+            decoder->finish();
+            return;
+        }
+        carry.assign(buffer->data.data() + split, length - split);
+        buffer->length = split;
+        publish(index);
+    }
+}
+
+// Waits until the consumer has released ring_[index]; returns nullptr if it is going away
+DecompressingReader::Buffer* DecompressingReader::acquire(size_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [&]() { return !ring_[index].full || stopping_; });
+    return stopping_ ? nullptr : &ring_[index];
+}
+
+void DecompressingReader::publish(size_t index) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ring_[index].full = true;
+    }
+    changed_.notify_all();
+}
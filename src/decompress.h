@@ -0,0 +1,73 @@
+// decompress.h
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Formats recognized by their leading magic bytes
+enum class Compression {
+    None,
+    Gzip,  // 1f 8b; concatenated members are read as one stream
+    Zstd   // 28 b5 2f fd; concatenated frames likewise
+};
+
+// Returns the format `head` (the first bytes of an input) starts with; None if it is too short
+Compression detect_compression(std::string_view head);
+
+// Reads a possibly compressed file descriptor as whole lines, like LineReader. A producer thread
+// reads and decompresses into a ring of reusable buffers while the caller matches the previous
+// one, so decompression and matching overlap. Each buffer the producer hands over ends at a
+// line boundary: the partial last line is carried to the front of the next buffer. Inputs that
+// are not compressed are passed through unchanged. Decoding gzip needs a build with zlib, and
+// zstd one with libzstd; an input in a format the build lacks is reported as an error.
+class DecompressingReader {
+public:
+    static constexpr size_t kRingSize = 4;
+    static constexpr size_t kBufferSize = 1024 * 1024;  // Grows for a line that does not fit
+    static constexpr size_t kInputChunk = 256 * 1024;
+
+    // Starts the producer thread; `fd` must stay open until the reader is destroyed
+    explicit DecompressingReader(int fd);
+    ~DecompressingReader();
+
+    DecompressingReader(const DecompressingReader&) = delete;
+    DecompressingReader& operator=(const DecompressingReader&) = delete;
+
+    // Stores the next run of whole lines, '\n' terminators included, in `block`; the last line
+    // of input may lack its '\n'. The view stays valid until the next call. Returns false at
+    // end of input. Throws std::runtime_error if reading or decompressing failed.
+    bool next_block(std::string_view& block);
+
+private:
+    struct Buffer {
+        std::vector<char> data;
+        size_t length = 0;
+        bool full = false;  // Published by the producer, not yet released by the consumer
+    };
+
+    int fd_;
+    std::vector<Buffer> ring_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool finished_ = false;  // The producer has published its last buffer; guarded by mutex_
+    bool stopping_ = false;  // The consumer is going away; guarded by mutex_
+    std::string error_;      // Why the producer stopped early; guarded by mutex_
+
+    size_t next_ = 0;          // Consumer: ring index of the next buffer to hand out
+    bool holding_ = false;     // Consumer: the previous buffer is still in use
+    std::thread producer_;
+
+    void run_producer();
+    void produce();
+    Buffer* acquire(size_t index);
+    void publish(size_t index);
+};
+
+#endif // DECOMPRESS_H
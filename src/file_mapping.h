@@ -0,0 +1,84 @@
+// file_mapping.h
+#ifndef FILE_MAPPING_H
+#define FILE_MAPPING_H
+
+#include <cstddef>
+#include <string_view>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+// Closes the descriptor when it leaves scope, including by exception; a negative one is ignored
+struct FdCloser {
+    int fd;
+
+    explicit FdCloser(int descriptor) : fd(descriptor) {}
+
+    ~FdCloser() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    FdCloser(const FdCloser&) = delete;
+    FdCloser& operator=(const FdCloser&) = delete;
+};
+
+// A private read-only mapping of the start of a file, unmapped when it leaves scope. The
+// mapping does not need the descriptor once made, so that may be closed first.
+class FileMapping {
+public:
+    FileMapping() = default;
+    ~FileMapping() { reset(); }
+
+    FileMapping(FileMapping&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), length_(std::exchange(other.length_, 0)) {}
+
+    FileMapping& operator=(FileMapping&& other) noexcept {
+        if (this != &other) {
+            reset();
+            data_ = std::exchange(other.data_, nullptr);
+            length_ = std::exchange(other.length_, 0);
+        }
+        return *this;
+    }
+
+    // Maps the first `length` bytes of `fd`, replacing any earlier mapping. Returns false,
+    // with errno set and nothing mapped, if mmap fails.
+    bool map(int fd, size_t length) {
+        reset();
+        void* data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        data_ = static_cast<const char*>(data);
+        length_ = length;
+        return true;
+    }
+
+    void reset() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char*>(data_), length_);
+            data_ = nullptr;
+            length_ = 0;
+        }
+    }
+
+    // Tells the kernel the mapping will be read front to back, so it reads ahead
+    void advise_sequential() const {
+        if (data_ != nullptr) {
+            ::madvise(const_cast<char*>(data_), length_, MADV_SEQUENTIAL);
+        }
+    }
+
+    bool mapped() const { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    size_t length() const { return length_; }
+    std::string_view contents() const { return std::string_view(data_, length_); }
+
+private:
+    const char* data_ = nullptr;
+    size_t length_ = 0;
+};
+
+#endif // FILE_MAPPING_H
@@ -1,58 +1,54 @@
 #include "grep_funcs.h"
+#include "char_class.h"
 #include <algorithm>
 #include <stdexcept>
 #include <cctype>
-#include <vector>
+#include <string>
 
 // Function definitions
 
 // Checks if a given pattern character exists anywhere in the input line
-bool match_character(const std::string& input_line, const std::string& pattern) {
+bool match_character(std::string_view input_line, std::string_view pattern) {
     // Returns true if the pattern is found in the input_line
-    return input_line.find(pattern) != std::string::npos;
+    return input_line.find(pattern) != std::string_view::npos;
 }
 
 // Checks if the input line contains at least one digit
-bool match_digit(const std::string& input_line) {
-    // Iterate over each character in the input_line
-    for (char c : input_line) {
-        // Use isdigit to check if the character is a digit
-        if (std::isdigit(static_cast<unsigned char>(c))) {
-            return true; // Return true if a digit is found
-        }
-    }
-    return false; // Return false if no digits are found
+bool match_digit(std::string_view input_line) {
+    // Scan 16-32 bytes per step with the SIMD class kernel
+    static const ClassScanner digits(digit_set());
+    return digits.find(input_line) != std::string_view::npos;
 }
 
 // Checks if the input line contains at least one alphanumeric character
-bool match_alnum(const std::string& input_line) {
-    // Use any_of to check if any character in the input_line is alphanumeric
-    return std::any_of(input_line.begin(), input_line.end(), ::isalnum);
+bool match_alnum(std::string_view input_line) {
+    static const ClassScanner alnums(alnum_set());
+    return alnums.find(input_line) != std::string_view::npos;
 }
 
 // Matches positive character groups (e.g., [abc]) in the pattern against the input line
-bool match_pos_char_groups(const std::string& input_line, const std::string& pattern) {
-    // Vector to hold the characters inside the brackets
-    std::vector<char> groups;
-    // Extract characters from the pattern, excluding the brackets
-    for (size_t i = 1; i < pattern.length() - 1; i++) {
-        groups.push_back(pattern[i]);
-    }
-
-    // Check if any character in the input_line matches any character in the group
-    for (char c : input_line) {
-        if (std::find(groups.begin(), groups.end(), c) != groups.end()) {
-            return true; // Return true if a match is found
+bool match_pos_char_groups(std::string_view input_line, std::string_view pattern) {
+    // Callers pass the same group line after line, so the scanner is built once per group
+    // and thread, from the bytes inside the brackets
+    thread_local std::string group;
+    thread_local ClassScanner scanner;
+    if (pattern != group) {
+        ByteSet groups;
+        for (size_t i = 1; i + 1 < pattern.length(); i++) {
+            groups.set(static_cast<unsigned char>(pattern[i]));
         }
+        scanner = ClassScanner(groups);
+        group.assign(pattern);
     }
 
-    return false; // Return false if no matches are found
+    // Check if any character in the input_line is in the group
+    return scanner.find(input_line) != std::string_view::npos;
 }
 
-// Helper function to match the pattern against the input_line starting from the beginning
-bool match_combined_char_classes_helper(const std::string& input_line, const std::string& pattern) {
-    int i = 0;           // Index for the pattern
-    int input_idx = 0;    // Index for the input_line
+// Helper function to match the pattern against the input_line starting at offset `start`
+bool match_combined_char_classes_helper(std::string_view input_line, size_t start, std::string_view pattern) {
+    size_t i = 0;             // Index for the pattern
+    size_t input_idx = start; // Index for the input_line
 
     // Loop through the pattern and input_line characters
     while (i < pattern.length() && input_idx < input_line.length()) {
@@ -84,11 +80,7 @@ bool match_combined_char_classes_helper(const std::string& input_line, const std
             i += 2; // Move past the escape sequence in the pattern
         } else {
             // Literal character matching
-            const std::string literal_character = std::string(1, input_line[input_idx]);
-            const std::string pattern_character = std::string(1, pattern[i]);
-
-            // Use match_character to check if the characters match
-            if (!match_character(literal_character, pattern_character)) {
+            if (input_line[input_idx] != pattern[i]) {
                 return false; // Return false if the characters do not match
             }
 
@@ -103,7 +95,7 @@ bool match_combined_char_classes_helper(const std::string& input_line, const std
 }
 
 // Attempts to match the pattern against any substring of the input_line
-bool match_combined_char_classes(const std::string& input_line, const std::string& pattern) {
+bool match_combined_char_classes(std::string_view input_line, std::string_view pattern) {
     size_t input_len = input_line.length();
 
     // Iterate over each possible starting position in the input_line
@@ -137,31 +129,29 @@ bool match_combined_char_classes(const std::string& input_line, const std::strin
             }
         }
 
-        // Call the helper function on the substring starting at position 'i'
-        if (match_combined_char_classes_helper(input_line.substr(i), pattern)) {
+        // Call the helper function from position 'i'
+        if (match_combined_char_classes_helper(input_line, i, pattern)) {
             return true; // Match found
         }
     }
     return false; // No match found
 }
 
-bool match_start_of_string(const std::string& input_line, const std::string& pattern) {
-    const std::string pattern_suffix = pattern.substr(1);
-    return match_combined_char_classes_helper(input_line, pattern_suffix);
+bool match_start_of_string(std::string_view input_line, std::string_view pattern) {
+    return match_combined_char_classes_helper(input_line, 0, pattern.substr(1));
 }
 
-bool match_end_of_string(const std::string& input_line, const std::string& pattern) {
-    const std::string pattern_suffix = pattern.substr(0, pattern.length() - 1);
+bool match_end_of_string(std::string_view input_line, std::string_view pattern) {
+    std::string_view pattern_suffix = pattern.substr(0, pattern.length() - 1);
     if (pattern_suffix.length() > input_line.length()) {
         return false; // Pattern is longer than the input line
     }
-    const std::string input = input_line.substr(input_line.length() - pattern_suffix.length());
-    return match_combined_char_classes_helper(input, pattern_suffix);
+    return match_combined_char_classes_helper(input_line, input_line.length() - pattern_suffix.length(), pattern_suffix);
 }
 
-bool match_one_or_more_helper(const std::string& input_line, const std::string& prefix_pattern, char repeated_char, const std::string& suffix_pattern) {
-    int prefix_idx = 0;
-    int input_idx = 0;
+bool match_one_or_more_helper(std::string_view input_line, size_t start, std::string_view prefix_pattern, char repeated_char, std::string_view suffix_pattern) {
+    size_t prefix_idx = 0;
+    size_t input_idx = start;
 
     // Matching the Prefix Pattern Exactly
     while (prefix_idx < prefix_pattern.length() && input_idx < input_line.length()) {
@@ -184,7 +174,7 @@ bool match_one_or_more_helper(const std::string& input_line, const std::string&
     }
 
     // Matching the Suffix Pattern Exactly
-    int suffix_idx = 0;
+    size_t suffix_idx = 0;
     while (suffix_idx < suffix_pattern.length() && input_idx < input_line.length()) {
         if (input_line[input_idx] == suffix_pattern[suffix_idx]) {
             suffix_idx++;
@@ -198,32 +188,31 @@ bool match_one_or_more_helper(const std::string& input_line, const std::string&
     return suffix_idx == suffix_pattern.length() && prefix_idx == prefix_pattern.length();
 }
 
-bool match_one_or_more(const std::string& input_line, const std::string& pattern) {
-    std::string letter = "";
+bool match_one_or_more(std::string_view input_line, std::string_view pattern) {
+    char letter = '\0';
     size_t prefix_idx = 0;
     size_t suffix_idx = 0;
 
     // Parsing the pattern to find the character before '+'
     for (size_t i = 0; i < pattern.length(); i++) {
         if (pattern[i] == '+' && i > 0) {
-            letter = pattern.substr(i - 1, 1);  // Character before '+'
-            prefix_idx = i - 1;                 // **Adjust index to exclude the character before '+'
-            suffix_idx = i + 1;                 // Index after '+'
+            letter = pattern[i - 1];  // Character before '+'
+            prefix_idx = i - 1;       // **Adjust index to exclude the character before '+'
+            suffix_idx = i + 1;       // Index after '+'
             break; // Break after finding the first '+'
         }
     }
 
-    // Extracting the prefix and suffix patterns
-    const std::string prefix_pattern = pattern.substr(0, prefix_idx);
-    const std::string suffix_pattern = pattern.substr(suffix_idx);
+    // Views of the prefix and suffix patterns
+    std::string_view prefix_pattern = pattern.substr(0, prefix_idx);
+    std::string_view suffix_pattern = pattern.substr(suffix_idx);
 
     // Attempting to match the pattern within the input_line
-    const char first_letter_of_prefix = prefix_pattern.empty() ? letter[0] : prefix_pattern[0];
+    const char first_letter_of_prefix = prefix_pattern.empty() ? letter : prefix_pattern[0];
     for (size_t i = 0; i < input_line.length(); i++) {
         char c = input_line[i];
         if (c == first_letter_of_prefix) {
-            const std::string inp = input_line.substr(i);
-            if (match_one_or_more_helper(inp, prefix_pattern, letter[0], suffix_pattern)) {
+            if (match_one_or_more_helper(input_line, i, prefix_pattern, letter, suffix_pattern)) {
                 return true;  // Match found
             }
         }
@@ -231,13 +220,13 @@ bool match_one_or_more(const std::string& input_line, const std::string& pattern
     return false;  // No match found
 }
 
-bool contains_plus(const std::string& pattern) {
-    return pattern.find('+') != std::string::npos;
+bool contains_plus(std::string_view pattern) {
+    return pattern.find('+') != std::string_view::npos;
 }
 
-bool match_zero_or_one_helper(const std::string& input_line, const std::string& prefix_pattern, char repeated_char, const std::string& suffix_pattern) {
-    int prefix_idx = 0;
-    int input_idx = 0;
+bool match_zero_or_one_helper(std::string_view input_line, size_t start, std::string_view prefix_pattern, char repeated_char, std::string_view suffix_pattern) {
+    size_t prefix_idx = 0;
+    size_t input_idx = start;
 
     // Matching the Prefix Pattern Exactly
     while (prefix_idx < prefix_pattern.length() && input_idx < input_line.length()) {
@@ -260,7 +249,7 @@ bool match_zero_or_one_helper(const std::string& input_line, const std::string&
     }
 
     // Matching the Suffix Pattern Exactly
-    int suffix_idx = 0;
+    size_t suffix_idx = 0;
     while (suffix_idx < suffix_pattern.length() && input_idx < input_line.length()) {
         if (input_line[input_idx] == suffix_pattern[suffix_idx]) {
             suffix_idx++;
@@ -274,32 +263,31 @@ bool match_zero_or_one_helper(const std::string& input_line, const std::string&
     return suffix_idx == suffix_pattern.length() && prefix_idx == prefix_pattern.length();
 }
 
-bool match_zero_or_one(const std::string& input_line, const std::string& pattern) {
-    std::string letter = "";
+bool match_zero_or_one(std::string_view input_line, std::string_view pattern) {
+    char letter = '\0';
     size_t prefix_idx = 0;
     size_t suffix_idx = 0;
 
     // Parsing the pattern to find the character before '?'
     for (size_t i = 0; i < pattern.length(); i++) {
         if (pattern[i] == '?' && i > 0) {
-            letter = pattern.substr(i - 1, 1);  // Character before '?'
-            prefix_idx = i - 1;                 // Index up to the character before '?'
-            suffix_idx = i + 1;                 // Index after '?'
+            letter = pattern[i - 1];  // Character before '?'
+            prefix_idx = i - 1;       // Index up to the character before '?'
+            suffix_idx = i + 1;       // Index after '?'
             break; // Break after finding the first '?'
         }
     }
 
-    // Extracting the prefix and suffix patterns
-    const std::string prefix_pattern = pattern.substr(0, prefix_idx);
-    const std::string suffix_pattern = pattern.substr(suffix_idx);
+    // Views of the prefix and suffix patterns
+    std::string_view prefix_pattern = pattern.substr(0, prefix_idx);
+    std::string_view suffix_pattern = pattern.substr(suffix_idx);
 
     // Attempting to match the pattern within the input_line
-    const char first_letter_of_prefix = prefix_pattern.empty() ? letter[0] : prefix_pattern[0];
+    const char first_letter_of_prefix = prefix_pattern.empty() ? letter : prefix_pattern[0];
     for (size_t i = 0; i < input_line.length(); i++) {
         char c = input_line[i];
         if (c == first_letter_of_prefix) {
-            const std::string inp = input_line.substr(i);
-            if (match_zero_or_one_helper(inp, prefix_pattern, letter[0], suffix_pattern)) {
+            if (match_zero_or_one_helper(input_line, i, prefix_pattern, letter, suffix_pattern)) {
                 return true;  // Match found
             }
         }
@@ -307,13 +295,13 @@ bool match_zero_or_one(const std::string& input_line, const std::string& pattern
     return false;  // No match found
 }
 
-bool contains_question_mark(const std::string& pattern) {
-    return pattern.find('?') != std::string::npos;
+bool contains_question_mark(std::string_view pattern) {
+    return pattern.find('?') != std::string_view::npos;
 }
 
-bool match_wildcard_helper(const std::string& input_line, const std::string& pattern) {
+bool match_wildcard_helper(std::string_view input_line, size_t start, std::string_view pattern) {
     size_t pattern_idx = 0;
-    size_t input_idx = 0;
+    size_t input_idx = start;
 
     while (pattern_idx < pattern.length() && input_idx < input_line.length()) {
         if (pattern[pattern_idx] == '.') {
@@ -335,71 +323,76 @@ bool match_wildcard_helper(const std::string& input_line, const std::string& pat
     return pattern_idx == pattern.length();
 }
 
-bool match_wildcard(const std::string& input_line, const std::string& pattern) {
+bool match_wildcard(std::string_view input_line, std::string_view pattern) {
     size_t input_length = input_line.length();
     size_t pattern_length = pattern.length();
 
     if (pattern_length == 0) {
         return true;  // Empty pattern matches any input
     }
+    if (pattern_length > input_length) {
+        return false;  // No window is long enough
+    }
 
     // Iterate over possible starting positions
     for (size_t i = 0; i <= input_length - pattern_length; i++) {
-        if (match_wildcard_helper(input_line.substr(i, pattern_length), pattern)) {
+        if (match_wildcard_helper(input_line, i, pattern)) {
             return true;  // Match found
         }
     }
     return false;  // No match found
 }
 
-bool contains_period(const std::string& pattern) {
-    return pattern.find('.') != std::string::npos;
+bool contains_period(std::string_view pattern) {
+    return pattern.find('.') != std::string_view::npos;
 }
 
-bool match_alternation(const std::string& input_line, const std::string& pattern) {
+bool match_alternation(std::string_view input_line, std::string_view pattern) {
     size_t open_paren = pattern.find('(');
     size_t close_paren = pattern.find(')', open_paren);
 
-    if (open_paren == std::string::npos || close_paren == std::string::npos) {
+    if (open_paren == std::string_view::npos || close_paren == std::string_view::npos) {
         // No parentheses found; cannot process alternation
         return false;
     }
 
-    // Extract the prefix, alternation part, and suffix
-    std::string prefix = pattern.substr(0, open_paren);
-    std::string alternation = pattern.substr(open_paren + 1, close_paren - open_paren - 1);
-    std::string suffix = pattern.substr(close_paren + 1);
+    // Views of the prefix, alternation part, and suffix
+    std::string_view prefix = pattern.substr(0, open_paren);
+    std::string_view alternation = pattern.substr(open_paren + 1, close_paren - open_paren - 1);
+    std::string_view suffix = pattern.substr(close_paren + 1);
 
-    // Split the alternation part into options
-    std::vector<std::string> options;
-    size_t start = 0;
-    size_t end = 0;
+    // Each option is spliced into one scratch string whose capacity is kept between calls
+    thread_local std::string full_pattern;
 
-    while ((end = alternation.find('|', start)) != std::string::npos) {
-        options.push_back(alternation.substr(start, end - start));
-        start = end + 1;
-    }
-
-    options.push_back(alternation.substr(start));
+    // Walk the '|'-separated options in place and attempt to match each one
+    size_t start = 0;
+    while (true) {
+        size_t end = alternation.find('|', start);
+        std::string_view option = alternation.substr(start, end == std::string_view::npos ? end : end - start);
 
-    // Construct full patterns and attempt to match
-    for (const std::string& option : options) {
-        std::string full_pattern = prefix + option + suffix;
+        full_pattern.assign(prefix);
+        full_pattern.append(option);
+        full_pattern.append(suffix);
         if (match_combined_char_classes(input_line, full_pattern)) {
             return true;  // Match found
         }
+
+        if (end == std::string_view::npos) {
+            break;
+        }
+        start = end + 1;
     }
 
     return false;  // No match found
 }
 
-bool contains_pipe(const std::string& pattern) {
-    return pattern.find('|') != std::string::npos;
+bool contains_pipe(std::string_view pattern) {
+    return pattern.find('|') != std::string_view::npos;
 }
 
 
 // Main function to match the input_line against the pattern
-bool match_pattern(const std::string& input_line, const std::string& pattern) {
+bool match_pattern(std::string_view input_line, std::string_view pattern) {
     if (pattern.length() == 1) {
         // Single character pattern
         return match_character(input_line, pattern);
@@ -416,9 +409,9 @@ bool match_pattern(const std::string& input_line, const std::string& pattern) {
     else if (pattern.front() == '[' && pattern.back() == ']') {
         // Handle character classes
         if (pattern.length() > 2 && pattern[1] == '^') {
-            // Negative character class; invert the match result
-            std::string positive_pattern = '[' + pattern.substr(2);
-            return !match_pos_char_groups(input_line, positive_pattern);
+            // Negative character class; invert the match result. Dropping the '[' leaves
+            // the '^' in the opening slot, which match_pos_char_groups skips.
+            return !match_pos_char_groups(input_line, pattern.substr(1));
         }
         else {
             // Positive character class
@@ -449,5 +442,5 @@ bool match_pattern(const std::string& input_line, const std::string& pattern) {
     }
 
     // Throw an error if the pattern type is unhandled
-    throw std::runtime_error("Unhandled pattern " + pattern);
-}
\ No newline at end of file
+    throw std::runtime_error("Unhandled pattern " + std::string(pattern));
+}
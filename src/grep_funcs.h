@@ -2,30 +2,167 @@
 #ifndef GREP_FUNCS_H
 #define GREP_FUNCS_H
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "aho_corasick.h"
+#include "arena.h"
+#include "backtracker.h"
+#include "binary_io.h"
+#include "char_class.h"
+#include "lazy_dfa.h"
+#include "prefilter.h"
+#include "regex_program.h"
+#include "search_stats.h"
+
+// What a find_line call learned about a buffer, carried into the next call on the same buffer
+// so that a multi-engine search looks at each byte at most once per engine
+struct LineCursor {
+    bool literals_scanned = false;
+    size_t literal_hit = std::string_view::npos;  // Next literal-set hit after the last `from`
+    size_t window_end = 0;      // UTF-8 mode: end of the window last checked for non-ASCII bytes
+    bool window_ascii = false;  // Whether that window is all ASCII
+};
+
+// Compile flags, for CompiledPattern and PatternCache::load
+constexpr uint32_t kUtf8Mode = 1;  // '.', classes and groups match whole UTF-8 code points
+
+// Half-open byte range [start, end) of a match within a line
+struct MatchSpan {
+    size_t start = 0;
+    size_t end = 0;
+};
+
+// A pattern, or a set of patterns, parsed and compiled once, then matched against any number
+// of lines. match() does no parsing and runs in time linear in the line length; the lazy DFA
+// only allocates while it is still discovering new states. Back-references are the exception:
+// the DFA then runs a relaxed program that can only rule lines out, and the lines it accepts
+// are decided by a Backtracker.
+// The program and literal-set tables are placed in one arena owned by the object and freed
+// with it. The object is read-only after construction and may be shared between threads:
+// each thread lazily gets its own engines, whose scratch is kept from line to line, so once
+// they are warm a match allocates nothing.
+// In UTF-8 mode the automaton runs over UTF-8 byte sequences, which costs it states and
+// steps. On ASCII text both modes match the same lines, so text found to be all ASCII runs on
+// a bytewise compilation of the same patterns instead. find_line checks each line-aligned
+// window of about kAsciiWindow bytes with one SIMD pass; the per-line calls check the line.
+class CompiledPattern {
+public:
+    explicit CompiledPattern(std::string_view pattern, uint32_t flags = 0);
+
+    // A line matches if any of `patterns` does. Every pattern that is not a pure literal is
+    // merged into one automaton, and so are the literals while the SIMD prefilter can still
+    // cover them all; past that, the literal patterns are searched with one Aho-Corasick pass.
+    // Each line is scanned once per engine however many patterns there are.
+    explicit CompiledPattern(const std::vector<std::string>& patterns, uint32_t flags = 0);
+
+    // Restores a pattern written by save() without parsing or compiling anything; throws
+    // std::runtime_error if the data is malformed
+    explicit CompiledPattern(BinaryReader& in);
+
+    void save(BinaryWriter& out) const;
+
+    // The engines and tables refer into arena_, so the object stays in place
+    CompiledPattern(const CompiledPattern&) = delete;
+    CompiledPattern& operator=(const CompiledPattern&) = delete;
+
+    bool match(std::string_view input_line) const;
+
+    // Scans a buffer of '\n'-separated lines from `from` (a line start) and returns an offset
+    // inside the first matching line, or std::string_view::npos.
+    // Successive calls on one buffer with increasing `from` should share a cursor.
+    size_t find_line(std::string_view buffer, size_t from) const;
+    size_t find_line(std::string_view buffer, size_t from, LineCursor& cursor) const;
+
+    // Appends the indices of the patterns that match input_line, in increasing order.
+    // Much slower than match(); meant for lines already known to match.
+    void matching_patterns(std::string_view input_line, std::vector<uint32_t>& ids) const;
+
+    // Finds the leftmost-longest match of any pattern that starts at or after `from` (^ and $
+    // still refer to the whole line). Returns false if there is none. Like matching_patterns(),
+    // this is meant for lines already known to match; the span may be empty.
+    bool find_span(std::string_view input_line, size_t from, MatchSpan& span) const;
+
+    const std::vector<std::string>& patterns() const { return patterns_; }
+
+    // Literals one of which every matching line contains, over all the patterns; no alternatives
+    // if some pattern has none. Parses the patterns again, so it is meant to be called once.
+    RequiredLiterals required_literals() const;
+
+    // Names the engines that do the matching, such as "memchr prefilter + lazy dfa", for --stats
+    std::string strategy() const;
+
+    // Adds the DFA counters of every thread's engines, the twin's included; call once the
+    // searches using this pattern have finished
+    void add_engine_stats(SearchStats& stats) const;
+
+private:
+    static constexpr size_t kAsciiWindow = 64 * 1024;  // Bytes find_line checks for ASCII at once
+
+    Arena arena_;                 // Owns the tables below; declared first so it is destroyed last
+    std::vector<std::string> patterns_;
+    std::unique_ptr<CompiledPattern> ascii_;  // UTF-8 mode: the bytewise twin for ASCII text
+    bool has_program_ = false;    // Some pattern runs on the automaton
+    ProgramView program_;         // All automaton patterns, each with its own Match
+    LiteralPrefilter prefilter_;  // Skips lines lacking the program's required literals
+    bool class_only_ = false;     // The program is one character class such as \d or [^abc]
+    ClassScanner class_scanner_;
+    AhoCorasick literal_set_;     // Pure-literal patterns, when there are too many for prefilter_
+    bool has_backrefs_ = false;   // program_ only approximates; backtrack_program_ decides
+    ProgramView backtrack_program_;  // The automaton patterns again, with captures
+    uint64_t id_;                 // Unique per instance; keys the per-thread cache lookup
+
+    // Matching state a thread needs for this pattern
+    struct Engines {
+        Engines(ProgramView program, ProgramView backtrack_program)
+            : dfa(program), backtracker(backtrack_program) {}
+
+        LazyDfa dfa;
+        Backtracker backtracker;
+    };
+
+    // One set of engines per thread that has used this pattern, owned and looked up here so
+    // nothing about the pattern outlives it on any thread
+    mutable std::mutex caches_mutex_;
+    mutable std::unordered_map<std::thread::id, std::unique_ptr<Engines>> caches_;
+
+    std::string own_strategy() const;
+    size_t find_line_in(std::string_view buffer, size_t from, LineCursor& cursor) const;
+    bool match_program(std::string_view input_line) const;
+    size_t find_program_line(std::string_view buffer, size_t from) const;
+    size_t find_candidate_line(std::string_view buffer, size_t from) const;
+    Engines& thread_engines() const;
+};
 
 // Function declarations
-bool match_character(const std::string& input_line, const std::string& pattern);
-bool match_digit(const std::string& input_line);
-bool match_alnum(const std::string& input_line);
-bool match_pattern(const std::string& input_line, const std::string& pattern);
-bool match_pos_char_groups(const std::string& input_line, const std::string& pattern);
-bool match_combined_char_classes(const std::string& input_line, const std::string& pattern);
-bool match_start_of_string(const std::string& input_line, const std::string& pattern);
-bool match_end_of_string(const std::string& input_line, const std::string& pattern);
-bool match_one_or_more(const std::string& input_line, const std::string& pattern);
-bool match_zero_or_one(const std::string& input_line, const std::string& pattern);
-bool match_wildcard(const std::string& input_line, const std::string& pattern);
-bool match_alternation(const std::string& input_line, const std::string& pattern);
-
-// Helper functions
-bool match_combined_char_classes_helper(const std::string& input_line, const std::string& pattern);
-bool match_one_or_more_helper(const std::string& input_line, const std::string& prefix_pattern, char letter, const std::string& suffix_pattern);
-bool match_zero_or_one_helper(const std::string& input_line, const std::string& prefix_pattern, char letter, const std::string& suffix_pattern);
-bool match_wildcard_helper(const std::string& input_line, const std::string& prefix_pattern, char letter, const std::string& suffix_pattern);
-bool contains_question_mark(const std::string& pattern);
-bool contains_plus(const std::string& pattern);
-bool contains_period(const std::string& pattern);
-bool contains_pipe(const std::string& pattern);
+// The legacy matchers take views and offsets into the caller's buffers; none of them copies
+// the input line or the pattern, so matching does no heap allocation.
+bool match_character(std::string_view input_line, std::string_view pattern);
+bool match_digit(std::string_view input_line);
+bool match_alnum(std::string_view input_line);
+bool match_pattern(std::string_view input_line, std::string_view pattern);
+bool match_pos_char_groups(std::string_view input_line, std::string_view pattern);
+bool match_combined_char_classes(std::string_view input_line, std::string_view pattern);
+bool match_start_of_string(std::string_view input_line, std::string_view pattern);
+bool match_end_of_string(std::string_view input_line, std::string_view pattern);
+bool match_one_or_more(std::string_view input_line, std::string_view pattern);
+bool match_zero_or_one(std::string_view input_line, std::string_view pattern);
+bool match_wildcard(std::string_view input_line, std::string_view pattern);
+bool match_alternation(std::string_view input_line, std::string_view pattern);
+
+// Helper functions; `start` is the offset in input_line where the match must begin
+bool match_combined_char_classes_helper(std::string_view input_line, size_t start, std::string_view pattern);
+bool match_one_or_more_helper(std::string_view input_line, size_t start, std::string_view prefix_pattern, char letter, std::string_view suffix_pattern);
+bool match_zero_or_one_helper(std::string_view input_line, size_t start, std::string_view prefix_pattern, char letter, std::string_view suffix_pattern);
+bool match_wildcard_helper(std::string_view input_line, size_t start, std::string_view pattern);
+bool contains_question_mark(std::string_view pattern);
+bool contains_plus(std::string_view pattern);
+bool contains_period(std::string_view pattern);
+bool contains_pipe(std::string_view pattern);
 
 #endif // GREP_FUNCS_H
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "ignore_rules.h"
+#include <utility>
+
+namespace {
+
+// Matches the [...] class at pattern[start] against `c`. Sets `end` just past the ']'; returns
+// false with end == start if the class is not terminated, so the '[' is then a literal.
+bool match_class(std::string_view pattern, size_t start, char c, size_t& end) {
+    size_t i = start + 1;
+    bool negated = i < pattern.length() && (pattern[i] == '!' || pattern[i] == '^');
+    if (negated) {
+        i++;
+    }
+    bool matched = false;
+    bool first = true;
+    while (i < pattern.length() && (pattern[i] != ']' || first)) {
+        first = false;
+        unsigned char low = static_cast<unsigned char>(pattern[i]);
+        if (low == '\\' && i + 1 < pattern.length()) {
+            low = static_cast<unsigned char>(pattern[++i]);
+        }
+        unsigned char high = low;
+        if (i + 2 < pattern.length() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            high = static_cast<unsigned char>(pattern[i + 2]);
+            i += 2;
+        }
+        unsigned char byte = static_cast<unsigned char>(c);
+        matched |= byte >= low && byte <= high;
+        i++;
+    }
+    if (i >= pattern.length()) {
+        end = start;
+        return false;
+    }
+    end = i + 1;
+    return matched != negated;
+}
+
+// The name after the last '/'
+std::string_view base_name(std::string_view path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+// Walks the pattern once, remembering only the last '*': on a mismatch, that '*' takes one
+// more byte and the rest of the pattern is tried again from there, so the time is at most
+// pattern length times text length. An earlier '*' never needs to move, since the last one can
+// absorb anything it could. Only a **/ component recurses, once per '/' of the text.
+bool glob_match(std::string_view pattern, std::string_view text) {
+    size_t p = 0;
+    size_t t = 0;
+    size_t star_p = std::string_view::npos;  // Pattern just past the last '*'
+    size_t star_t = 0;                       // Text where that '*' currently ends
+    while (true) {
+        if (p < pattern.length()) {
+            char c = pattern[p];
+            if (c == '*') {
+                bool whole_component = (p == 0 || pattern[p - 1] == '/') && p + 1 < pattern.length() &&
+                                       pattern[p + 1] == '*' &&
+                                       (p + 2 == pattern.length() || pattern[p + 2] == '/');
+                if (whole_component && p + 2 == pattern.length()) {
+                    return true;  // Trailing **: everything below
+                }
+                if (whole_component) {
+                    // **/ : try the rest after zero or more whole components
+                    std::string_view rest = pattern.substr(p + 3);
+                    for (size_t k = t; k <= text.length(); k++) {
+                        if ((k == t || text[k - 1] == '/') && glob_match(rest, text.substr(k))) {
+                            return true;
+                        }
+                    }
+                } else {
+                    while (p < pattern.length() && pattern[p] == '*') {
+                        p++;
+                    }
+                    star_p = p;
+                    star_t = t;
+                    continue;
+                }
+            } else if (t < text.length()) {
+                size_t next = p + 1;
+                bool matched;
+                if (c == '?') {
+                    matched = text[t] != '/';
+                } else if (c == '[') {
+                    size_t end;
+                    matched = match_class(pattern, p, text[t], end);
+                    if (end != p) {
+                        matched = matched && text[t] != '/';
+                        next = end;
+                    } else {
+                        matched = text[t] == '[';
+                    }
+                } else {
+                    if (c == '\\' && next < pattern.length()) {
+                        c = pattern[next++];
+                    }
+                    matched = text[t] == c;
+                }
+                if (matched) {
+                    p = next;
+                    t++;
+                    continue;
+                }
+            }
+        } else if (t == text.length()) {
+            return true;
+        }
+
+        // Mismatch: let the last '*' take one more byte, which may not be a '/'
+        if (star_p == std::string_view::npos || star_t == text.length() || text[star_t] == '/') {
+            return false;
+        }
+        p = star_p;
+        t = ++star_t;
+    }
+}
+
+IgnoreRules::IgnoreRules(std::string_view text, std::string base, std::shared_ptr<const IgnoreRules> parent)
+    : base_(std::move(base)), parent_(std::move(parent)) {
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.length() : newline + 1);
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        // Trailing spaces are dropped unless quoted with a backslash
+        while (!line.empty() && line.back() == ' ' && !(line.length() >= 2 && line[line.length() - 2] == '\\')) {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        Rule rule;
+        if (line[0] == '!') {
+            rule.negated = true;
+            line.remove_prefix(1);
+        } else if (line[0] == '\\' && line.length() > 1 && (line[1] == '!' || line[1] == '#')) {
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.directory_only = true;
+            line.remove_suffix(1);
+        }
+        rule.anchored = line.find('/') != std::string_view::npos;
+        if (!line.empty() && line[0] == '/') {
+            line.remove_prefix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        rule.pattern = std::string(line);
+        rules_.push_back(std::move(rule));
+    }
+}
+
+bool IgnoreRules::ignored(std::string_view path, bool is_directory) const {
+    for (const IgnoreRules* rules = this; rules != nullptr; rules = rules->parent_.get()) {
+        if (path.substr(0, rules->base_.length()) != rules->base_) {
+            continue;
+        }
+        std::string_view relative = path.substr(rules->base_.length());
+        for (auto rule = rules->rules_.rbegin(); rule != rules->rules_.rend(); ++rule) {
+            if (rule->directory_only && !is_directory) {
+                continue;
+            }
+            bool matched = rule->anchored ? glob_match(rule->pattern, relative)
+                                          : glob_match(rule->pattern, base_name(relative));
+            if (matched) {
+                return !rule->negated;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,42 @@
+// ignore_rules.h
+#ifndef IGNORE_RULES_H
+#define IGNORE_RULES_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Shell-style wildcard match of a whole path or name: * and ? never match '/', [...] is a byte
+// class ([!...] or [^...] negated) and \ quotes the next character. A ** that is a whole path
+// component matches any number of components, including none.
+bool glob_match(std::string_view pattern, std::string_view text);
+
+// The rules of one .gitignore file, chained to those of the directories above it.
+// Paths are relative to the root of the walk; each file's patterns apply below its own
+// directory, the last matching pattern of a file decides, and a deeper file overrides the ones
+// above it. Supported: comments, ! negation, a trailing / for directories only, patterns
+// anchored by a leading or inner /, and **.
+class IgnoreRules {
+public:
+    // `base` is the directory holding the .gitignore, relative to the walk root and ending in '/'
+    // unless it is the root itself
+    IgnoreRules(std::string_view text, std::string base, std::shared_ptr<const IgnoreRules> parent);
+
+    // True if `path` (relative to the walk root) is ignored by these rules or their parents
+    bool ignored(std::string_view path, bool is_directory) const;
+
+private:
+    struct Rule {
+        std::string pattern;
+        bool negated = false;         // !pattern: re-includes what an earlier rule ignored
+        bool directory_only = false;  // pattern/: matches directories only
+        bool anchored = false;        // Matched against the path below base_, not just the name
+    };
+
+    std::vector<Rule> rules_;
+    std::string base_;
+    std::shared_ptr<const IgnoreRules> parent_;
+};
+
+#endif // IGNORE_RULES_H
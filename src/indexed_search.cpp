@@ -0,0 +1,109 @@
+#include "indexed_search.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include "file_mapping.h"
+#include "search_stats.h"
+
+namespace {
+
+// Searches the runs of candidate blocks that belong to `file`, then whatever follows its
+// indexed lines. The mapping is only touched where it is searched.
+size_t search_indexed_file(const CompiledPattern& pattern, const TrigramIndex& index, const IndexedFile& file,
+                           const std::vector<uint32_t>& candidates, int fd, std::string_view label,
+                           const SearchOptions& options, OutputBuffer& out) {
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        throw std::runtime_error(std::strerror(errno));
+    }
+    if (info.st_size == 0) {
+        return 0;
+    }
+    FileMapping mapping;
+    {
+        StatsTimer timer(&SearchStats::read_ns);
+        if (!mapping.map(fd, static_cast<size_t>(info.st_size))) {
+            throw std::runtime_error(std::strerror(errno));
+        }
+    }
+    std::string_view contents = mapping.contents();
+
+    std::span<const IndexedBlock> blocks = index.blocks(file);
+    auto it = std::lower_bound(candidates.begin(), candidates.end(), file.first_block);
+    auto last = std::lower_bound(candidates.begin(), candidates.end(), file.first_block + file.block_count);
+    size_t matches = 0;
+    while (it != last) {
+        // A file's blocks are consecutive in the file, so a run of ids is one stretch of text
+        auto run_end = it + 1;
+        while (run_end != last && *run_end == *(run_end - 1) + 1) {
+            ++run_end;
+        }
+        const IndexedBlock& first_block = blocks[*it - file.first_block];
+        const IndexedBlock& last_block = blocks[*(run_end - 1) - file.first_block];
+        uint64_t end = last_block.offset + last_block.length;
+        FilePosition position{first_block.offset, first_block.first_line};
+        matches += search_buffer(pattern, contents.substr(first_block.offset, end - first_block.offset), label,
+                                 options, out, position);
+        it = run_end;
+    }
+    if (contents.length() > file.indexed_length) {
+        FilePosition position{file.indexed_length, file.line_count + 1};
+        matches += search_buffer(pattern, contents.substr(file.indexed_length), label, options, out, position);
+    }
+    return matches;
+}
+
+} // namespace
+
+bool indexed_search(const CompiledPattern& pattern, const TrigramIndex& index, const std::vector<std::string>& files,
+                    const SearchOptions& options, OutputBuffer& out) {
+    std::vector<uint32_t> candidates = index.candidate_blocks(pattern.required_literals());
+
+    // Labels are the operands as given, or the absolute paths the index holds
+    std::vector<std::pair<std::string, const IndexedFile*>> targets;
+    if (files.empty()) {
+        for (const IndexedFile& file : index.files()) {
+            targets.emplace_back(std::string(index.path(file)), &file);
+        }
+    }
+    for (const std::string& file : files) {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(file, error);
+        targets.emplace_back(file, error ? nullptr : index.find(absolute.lexically_normal().string()));
+    }
+
+    bool any_match = false;
+    for (const auto& [label, record] : targets) {
+        try {
+            int fd = ::open(label.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error(std::strerror(errno));
+            }
+            FdCloser closer{fd};
+            if (record == nullptr || check_indexed_file(fd, *record) == IndexState::Stale) {
+                any_match |= search_open_file(pattern, fd, label, options, out) > 0;
+                continue;
+            }
+            if (search_stats_enabled()) {
+                thread_stats().files++;
+            }
+            size_t matches = search_indexed_file(pattern, index, *record, candidates, fd, label, options, out);
+            if (options.count_only) {
+                write_count(label, matches, options, out);
+            }
+            any_match |= matches > 0;
+        } catch (const std::runtime_error& e) {
+            out.flush();
+            std::cerr << label << ": " << e.what() << std::endl;
+        }
+    }
+    return any_match;
+}
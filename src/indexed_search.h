@@ -0,0 +1,21 @@
+// indexed_search.h
+#ifndef INDEXED_SEARCH_H
+#define INDEXED_SEARCH_H
+
+#include <string>
+#include <vector>
+#include "grep_funcs.h"
+#include "line_reader.h"
+#include "search.h"
+#include "trigram_index.h"
+
+// --index: searches `files`, or every file the index lists if there are none, reading only
+// the blocks the index cannot rule out for the pattern's required literals. Runs of candidate
+// blocks are searched as one buffer at their own offsets and line numbers, so the output is
+// what a full search prints. Lines appended since the file was indexed are always searched;
+// a file that is not in the index, or has changed in any other way, is searched whole.
+// Errors are reported on stderr and the search goes on. Returns true if any line matched.
+bool indexed_search(const CompiledPattern& pattern, const TrigramIndex& index, const std::vector<std::string>& files,
+                    const SearchOptions& options, OutputBuffer& out);
+
+#endif // INDEXED_SEARCH_H
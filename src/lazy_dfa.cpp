@@ -0,0 +1,522 @@
+#include "lazy_dfa.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// FNV-1a over the instruction set; states at a line start hash apart from the others
+size_t hash_closure(const std::vector<uint32_t>& pcs, bool at_line_start) {
+    size_t hash = 14695981039346656037ull ^ (at_line_start ? 1 : 0);
+    for (uint32_t pc : pcs) {
+        hash = (hash ^ pc) * 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace
+
+void LazyDfa::SparseSet::resize(size_t capacity) {
+    dense.resize(capacity);
+    sparse.resize(capacity);
+    size = 0;
+}
+
+bool LazyDfa::SparseSet::contains(uint32_t value) const {
+    uint32_t slot = sparse[value];
+    return slot < size && dense[slot] == value;
+}
+
+void LazyDfa::SparseSet::insert(uint32_t value) {
+    sparse[value] = static_cast<uint32_t>(size);
+    dense[size++] = value;
+}
+
+LazyDfa::LazyDfa(ProgramView program, size_t memory_limit)
+    : program_(program), memory_limit_(memory_limit) {
+    closure_.resize(program_.insts.size());
+    step_.resize(program_.insts.size());
+    closure_starts_.resize(program_.insts.size());
+    step_starts_.resize(program_.insts.size());
+    stack_.reserve(program_.insts.size());
+    index_slots_.assign(kMinIndexSlots, kUnknown);
+
+    // If nothing can start past position 0, states that die stay dead
+    add_closure(closure_, 0, false, false);
+    floating_ = closure_.size > 0;
+
+    // Bytes that can begin a match; any other byte leaves the floating state where it is
+    ByteSet first_bytes;
+    for (size_t i = 0; i < closure_.size; i++) {
+        const Inst& inst = program_.insts[closure_.dense[i]];
+        switch (inst.op) {
+            case OpCode::Byte: first_bytes.set(inst.byte); break;
+            case OpCode::Class: first_bytes.merge(program_.classes[inst.x]); break;
+            case OpCode::Any:
+            case OpCode::Match: first_bytes.set_range(0, 255); break;
+            default: break;
+        }
+    }
+    first_bytes.set('\n');
+    accelerate_ = floating_ && first_bytes.count() <= kMaxAccelerationBytes;
+    if (accelerate_) {
+        accelerator_ = ClassScanner(first_bytes);
+    }
+
+    reset_cache();
+}
+
+// Adds every instruction reachable from pc through epsilon edges and satisfied assertions
+void LazyDfa::add_closure(SparseSet& set, uint32_t pc, bool at_start, bool at_end) {
+    stack_.push_back(pc);
+    while (!stack_.empty()) {
+        uint32_t current = stack_.back();
+        stack_.pop_back();
+        if (set.contains(current)) {
+            continue;
+        }
+        set.insert(current);
+
+        const Inst& inst = program_.insts[current];
+        switch (inst.op) {
+            case OpCode::Split:
+                stack_.push_back(inst.y);
+                stack_.push_back(inst.x);
+                break;
+            case OpCode::Jmp:
+                stack_.push_back(inst.x);
+                break;
+            case OpCode::LineStart:
+                if (at_start) {
+                    stack_.push_back(current + 1);
+                }
+                break;
+            case OpCode::LineEnd:
+                if (at_end) {
+                    stack_.push_back(current + 1);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Returns the state for the current closure, creating it if it is new.
+// The state at a line start is kept apart because ^ still holds there.
+int32_t LazyDfa::intern_closure(bool at_line_start) {
+    key_.clear();
+    bool is_match = false;
+    for (size_t i = 0; i < closure_.size; i++) {
+        uint32_t pc = closure_.dense[i];
+        switch (program_.insts[pc].op) {
+            case OpCode::Match:
+                is_match = true;
+                key_.push_back(pc);
+                break;
+            case OpCode::Byte:
+            case OpCode::Class:
+            case OpCode::Any:
+            case OpCode::LineEnd:
+                key_.push_back(pc);
+                break;
+            default:
+                break; // Epsilon instructions are fully expanded and never needed again
+        }
+    }
+    std::sort(key_.begin(), key_.end());
+
+    size_t mask = index_slots_.size() - 1;
+    size_t slot = hash_closure(key_, at_line_start) & mask;
+    for (; index_slots_[slot] != kUnknown; slot = (slot + 1) & mask) {
+        const State& candidate = states_[index_slots_[slot]];
+        if (candidate.at_line_start == at_line_start && candidate.pcs_count == key_.size() &&
+            std::equal(key_.begin(), key_.end(), pc_pool_.begin() + candidate.pcs_begin)) {
+            return index_slots_[slot];
+        }
+    }
+
+    State state;
+    state.pcs_begin = static_cast<uint32_t>(pc_pool_.size());
+    state.pcs_count = static_cast<uint32_t>(key_.size());
+    state.is_match = is_match;
+    state.at_line_start = at_line_start;
+    pc_pool_.insert(pc_pool_.end(), key_.begin(), key_.end());
+    states_.push_back(state);
+    transitions_.resize(transitions_.size() + 256, kUnknown);
+    states_built_++;
+
+    int32_t index = static_cast<int32_t>(states_.size() - 1);
+    index_slots_[slot] = index;
+    // Each state also accounts for the two index slots it keeps in use
+    memory_used_ += sizeof(State) + 256 * sizeof(int32_t) + key_.size() * sizeof(uint32_t) + 2 * sizeof(int32_t);
+    if (states_.size() * 2 > index_slots_.size()) {
+        grow_index();
+    }
+    return index;
+}
+
+// Doubles the index and re-inserts every state it holds; only the warm-up pays for this,
+// as flushes keep the index at its size
+void LazyDfa::grow_index() {
+    index_slots_.assign(index_slots_.size() * 2, kUnknown);
+    size_t mask = index_slots_.size() - 1;
+    for (int32_t index = 0; index < static_cast<int32_t>(states_.size()); index++) {
+        if (index == line_match_state_) {
+            continue;  // Never looked up by key
+        }
+        const State& state = states_[index];
+        key_.assign(pc_pool_.begin() + state.pcs_begin, pc_pool_.begin() + state.pcs_begin + state.pcs_count);
+        size_t slot = hash_closure(key_, state.at_line_start) & mask;
+        while (index_slots_[slot] != kUnknown) {
+            slot = (slot + 1) & mask;
+        }
+        index_slots_[slot] = index;
+    }
+}
+
+void LazyDfa::reset_cache() {
+    states_.clear();
+    transitions_.clear();
+    pc_pool_.clear();
+    std::fill(index_slots_.begin(), index_slots_.end(), kUnknown);
+    line_match_state_ = kUnknown;
+    memory_used_ = 0;
+
+    closure_.clear();
+    add_closure(closure_, 0, true, false);
+    start_state_ = intern_closure(true);
+
+    closure_.clear();
+    dead_state_ = intern_closure(false);
+
+    closure_.clear();
+    add_closure(closure_, 0, false, false);
+    float_state_ = intern_closure(false);
+
+    // Target of a '\n' that ends a matching line; never looked up by key
+    State line_match;
+    line_match.is_match = true;
+    states_.push_back(line_match);
+    transitions_.resize(transitions_.size() + 256, kUnknown);
+    line_match_state_ = static_cast<int32_t>(states_.size() - 1);
+}
+
+// Flushes the whole cache and carries only `state` into the fresh one; returns its new index
+int32_t LazyDfa::flush_keeping(int32_t state) {
+    carried_.assign(state_pcs(state), state_pcs(state) + states_[state].pcs_count);
+    bool at_line_start = states_[state].at_line_start;
+    reset_cache();
+    flush_count_++;
+    closure_.clear();
+    for (uint32_t pc : carried_) {
+        closure_.insert(pc);
+    }
+    return intern_closure(at_line_start);
+}
+
+// Advances every instruction in `pcs` that accepts `byte` and adds the resulting closures to `to`
+void LazyDfa::step(const uint32_t* pcs, size_t count, unsigned char byte, SparseSet& to) {
+    for (size_t i = 0; i < count; i++) {
+        const Inst& inst = program_.insts[pcs[i]];
+        bool advances = false;
+        switch (inst.op) {
+            case OpCode::Byte: advances = inst.byte == byte; break;
+            case OpCode::Class: advances = program_.classes[inst.x].test(byte); break;
+            case OpCode::Any: advances = true; break;
+            default: break;
+        }
+        if (advances) {
+            add_closure(to, pcs[i] + 1, false, false);
+        }
+    }
+    if (floating_) {
+        add_closure(to, 0, false, false);
+    }
+}
+
+// A '\n' ends the line: it either completes a $ match or restarts at the next line's start
+int32_t LazyDfa::compute_next(int32_t state, unsigned char byte) {
+    int32_t next;
+    if (byte == '\n') {
+        next = end_accepts(state) ? line_match_state_ : start_state_;
+    } else {
+        closure_.clear();
+        step(state_pcs(state), states_[state].pcs_count, byte, closure_);
+        next = intern_closure(false);
+    }
+    int32_t entry = tag(next);
+    transitions_[(static_cast<size_t>(state) << 8) | byte] = entry;
+    return entry;
+}
+
+// Folds the match/dead flags of a state into its transition-table entry
+int32_t LazyDfa::tag(int32_t state) const {
+    int32_t entry = state;
+    if (states_[state].is_match) {
+        entry |= kTagMatch;
+    }
+    if (state == dead_state_ && !floating_) {
+        entry |= kTagDead;
+    }
+    if (state == float_state_ && accelerate_) {
+        entry |= kTagAccelerate;
+    }
+    return entry;
+}
+
+// Checks whether a pending $ among `pcs` completes a match at the end of the line
+bool LazyDfa::accepts_at_end(const uint32_t* pcs, size_t count, bool at_line_start) {
+    closure_.clear();
+    for (size_t i = 0; i < count; i++) {
+        if (program_.insts[pcs[i]].op == OpCode::LineEnd) {
+            add_closure(closure_, pcs[i] + 1, at_line_start, true);
+        }
+    }
+    return set_has_match(closure_);
+}
+
+bool LazyDfa::end_accepts(int32_t state) {
+    if (states_[state].end_accepts < 0) {
+        bool accepts = accepts_at_end(state_pcs(state), states_[state].pcs_count, states_[state].at_line_start);
+        states_[state].end_accepts = accepts ? 1 : 0;
+    }
+    return states_[state].end_accepts == 1;
+}
+
+bool LazyDfa::set_has_match(const SparseSet& set) const {
+    for (size_t i = 0; i < set.size; i++) {
+        if (program_.insts[set.dense[i]].op == OpCode::Match) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LazyDfa::append_matches(const SparseSet& set, std::vector<uint32_t>& ids) const {
+    for (size_t i = 0; i < set.size; i++) {
+        const Inst& inst = program_.insts[set.dense[i]];
+        if (inst.op == OpCode::Match) {
+            ids.push_back(inst.x);
+        }
+    }
+}
+
+// Plain NFA simulation from `state` at text[from] to the end of that line, used once the cache thrashes.
+// Returns the match offset or npos; `line_end` receives the offset of the line's '\n' (or the text end).
+size_t LazyDfa::simulate_line(int32_t state, std::string_view text, size_t from, size_t& line_end) {
+    SparseSet* current = &closure_;
+    SparseSet* next = &step_;
+    current->clear();
+    for (uint32_t i = 0; i < states_[state].pcs_count; i++) {
+        current->insert(state_pcs(state)[i]);
+    }
+    bool at_line_start = states_[state].at_line_start;
+
+    size_t i = from;
+    for (; i < text.length() && text[i] != '\n'; i++) {
+        next->clear();
+        step(current->dense.data(), current->size, static_cast<unsigned char>(text[i]), *next);
+        if (set_has_match(*next)) {
+            line_end = i;
+            return i;
+        }
+        std::swap(current, next);
+        at_line_start = false;
+    }
+    line_end = i;
+
+    // accepts_at_end reuses closure_, so copy the surviving instructions out first
+    key_.assign(current->dense.begin(), current->dense.begin() + current->size);
+    return accepts_at_end(key_.data(), key_.size(), at_line_start) ? i : std::string_view::npos;
+}
+
+size_t LazyDfa::find(std::string_view text, size_t from) {
+    const char* data = text.data();
+    size_t length = text.length();
+
+    int32_t state = start_state_;
+    if (states_[state].is_match) {
+        return from;
+    }
+    size_t counted = from;  // Bytes before this offset are already in bytes_since_flush_
+    for (size_t i = from; i < length; i++) {
+        unsigned char byte = static_cast<unsigned char>(data[i]);
+        int32_t entry = transitions_[(static_cast<size_t>(state) << 8) | byte];
+        if (entry & kSlowPath) [[unlikely]] {
+            if (entry == kUnknown) {
+                if (memory_used_ > memory_limit_) {
+                    // A cache that fills up faster than it is reused costs more than it saves
+                    bool thrashing = bytes_since_flush_ + (i - counted) < kMinBytesPerState * states_.size();
+                    bytes_since_flush_ = 0;
+                    counted = i;
+                    if (thrashing) {
+                        // Finish this line without the cache, then give the DFA a fresh start
+                        size_t line_end;
+                        size_t found = simulate_line(state, text, i, line_end);
+                        reset_cache();
+                        flush_count_++;
+                        fallback_count_++;
+                        if (found != std::string_view::npos || line_end == length) {
+                            return found;
+                        }
+                        i = line_end;
+                        counted = i + 1;
+                        state = start_state_;
+                        continue;
+                    }
+                    state = flush_keeping(state);
+                }
+                entry = compute_next(state, byte);
+            }
+            if (entry & kTagMatch) {
+                bytes_since_flush_ += i + 1 - counted;
+                return i;
+            }
+            if (entry & kTagDead) {
+                // Nothing more can match on this line; skip straight to the next one
+                const void* newline = std::memchr(data + i, '\n', length - i);
+                if (newline == nullptr) {
+                    bytes_since_flush_ += length - counted;
+                    return std::string_view::npos;
+                }
+                i = static_cast<const char*>(newline) - data;
+                state = start_state_;
+                continue;
+            }
+            if (entry & kTagAccelerate) {
+                // Jump to the next byte that can start a match or end the line
+                state = float_state_;
+                size_t skip_to = accelerator_.find(text, i + 1);
+                i = (skip_to == std::string_view::npos ? length : skip_to) - 1;
+                continue;
+            }
+        }
+        state = entry & kIndexMask;
+    }
+    bytes_since_flush_ += length - counted;
+
+    // The final line has no '\n' to trigger the $ check, unless the text ended exactly at a line end
+    if (length > from && data[length - 1] == '\n') {
+        return std::string_view::npos;
+    }
+    return end_accepts(state) ? length : std::string_view::npos;
+}
+
+bool LazyDfa::search(std::string_view input_line) {
+    return find(input_line, 0) != std::string_view::npos;
+}
+
+void LazyDfa::collect_matches(std::string_view input_line, std::vector<uint32_t>& ids) {
+    size_t first = ids.size();
+    SparseSet* current = &closure_;
+    SparseSet* next = &step_;
+    current->clear();
+    add_closure(*current, 0, true, false);
+    append_matches(*current, ids);
+
+    for (char c : input_line) {
+        next->clear();
+        step(current->dense.data(), current->size, static_cast<unsigned char>(c), *next);
+        append_matches(*next, ids);
+        std::swap(current, next);
+    }
+
+    // Patterns ending in $ match only here; current may alias closure_, so copy it out first
+    key_.assign(current->dense.begin(), current->dense.begin() + current->size);
+    closure_.clear();
+    for (uint32_t pc : key_) {
+        if (program_.insts[pc].op == OpCode::LineEnd) {
+            add_closure(closure_, pc + 1, input_line.empty(), true);
+        }
+    }
+    append_matches(closure_, ids);
+
+    std::sort(ids.begin() + first, ids.end());
+    ids.erase(std::unique(ids.begin() + first, ids.end()), ids.end());
+}
+
+// Adds the closure of pc to the set as a thread that began at `start`. Threads are added in order
+// of their start, so an instruction already in the set belongs to an earlier (better) thread.
+void LazyDfa::add_thread(SparseSet& set, std::vector<size_t>& starts, uint32_t pc, size_t start, bool at_start,
+                         bool at_end) {
+    size_t first = set.size;
+    add_closure(set, pc, at_start, at_end);
+    std::fill(starts.begin() + first, starts.begin() + set.size, start);
+}
+
+bool LazyDfa::find_span(std::string_view input_line, size_t from, size_t& start, size_t& end) {
+    SparseSet* current = &closure_;
+    SparseSet* next = &step_;
+    std::vector<size_t>* current_starts = &closure_starts_;
+    std::vector<size_t>* next_starts = &step_starts_;
+    current->clear();
+    size_t best_start = std::string_view::npos;
+    size_t best_end = 0;
+
+    for (size_t i = from; ; i++) {
+        if (current->size == 0 && best_start == std::string_view::npos && accelerate_ && i > 0 &&
+            i < input_line.length()) {
+            // No thread is alive, so jump to the next byte that can start one
+            size_t skip_to = accelerator_.find(input_line, i);
+            i = skip_to == std::string_view::npos ? input_line.length() : skip_to;
+        }
+        // Once a match is known, threads starting later can no longer be leftmost
+        if (best_start == std::string_view::npos && (floating_ || i == 0)) {
+            add_thread(*current, *current_starts, 0, i, i == 0, false);
+        }
+        if (i == input_line.length()) {
+            // Patterns ending in $ complete only here
+            size_t count = current->size;
+            for (size_t j = 0; j < count; j++) {
+                uint32_t pc = current->dense[j];
+                if (program_.insts[pc].op == OpCode::LineEnd) {
+                    add_thread(*current, *current_starts, pc + 1, (*current_starts)[j], i == 0, true);
+                }
+            }
+        }
+        for (size_t j = 0; j < current->size; j++) {
+            size_t thread_start = (*current_starts)[j];
+            if (program_.insts[current->dense[j]].op == OpCode::Match &&
+                (best_start == std::string_view::npos || thread_start < best_start ||
+                 (thread_start == best_start && i > best_end))) {
+                best_start = thread_start;
+                best_end = i;
+            }
+        }
+        if (i == input_line.length()) {
+            break;
+        }
+
+        unsigned char byte = static_cast<unsigned char>(input_line[i]);
+        next->clear();
+        for (size_t j = 0; j < current->size; j++) {
+            size_t thread_start = (*current_starts)[j];
+            if (best_start != std::string_view::npos && thread_start > best_start) {
+                continue;
+            }
+            const Inst& inst = program_.insts[current->dense[j]];
+            bool advances = false;
+            switch (inst.op) {
+                case OpCode::Byte: advances = inst.byte == byte; break;
+                case OpCode::Class: advances = program_.classes[inst.x].test(byte); break;
+                case OpCode::Any: advances = true; break;
+                default: break;
+            }
+            if (advances) {
+                add_thread(*next, *next_starts, current->dense[j] + 1, thread_start, false, false);
+            }
+        }
+        std::swap(current, next);
+        std::swap(current_starts, next_starts);
+        if (current->size == 0 && (best_start != std::string_view::npos || !floating_)) {
+            break;
+        }
+    }
+
+    if (best_start == std::string_view::npos) {
+        return false;
+    }
+    start = best_start;
+    end = best_end;
+    return true;
+}
@@ -0,0 +1,127 @@
+// lazy_dfa.h
+#ifndef LAZY_DFA_H
+#define LAZY_DFA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "char_class.h"
+#include "regex_program.h"
+
+// Simulates a compiled program as a DFA whose states are built on demand.
+// Each DFA state is the epsilon closure of a set of NFA instructions; transitions are
+// cached in a 256-entry row per state so a warm cache costs one lookup per input byte.
+// When the cache grows past the memory limit it is flushed and rebuilt from the current state;
+// if it keeps filling up without being reused, the rest of the line runs as a plain NFA simulation.
+// While no match is in progress, bytes that cannot start one are skipped with a SIMD class scan.
+// A flush empties the cache's tables without returning their memory, and all other scratch is
+// kept between calls, so a DFA that has warmed up does not allocate.
+class LazyDfa {
+public:
+    static constexpr size_t kDefaultMemoryLimit = 8 * 1024 * 1024;
+
+    explicit LazyDfa(ProgramView program, size_t memory_limit = kDefaultMemoryLimit);
+
+    // Returns true if any substring of input_line matches; runs in O(input_line.length())
+    bool search(std::string_view input_line);
+
+    // Scans text from `from`, which must be a line start, treating '\n' as a line separator.
+    // Returns an offset inside the first matching line (possibly its terminating '\n' or the
+    // end of text), or std::string_view::npos if no later line matches.
+    size_t find(std::string_view text, size_t from);
+
+    // Appends the number of every pattern (Match operand) that matches somewhere in input_line.
+    // Runs a plain NFA simulation over the whole line, so it is meant for lines already known to match.
+    void collect_matches(std::string_view input_line, std::vector<uint32_t>& ids);
+
+    // Finds the leftmost-longest match in input_line that starts at or after `from` and sets
+    // [start, end) to it; ^ and $ still refer to the whole line. Returns false if there is none.
+    // Like collect_matches this is a plain NFA simulation, meant for lines already known to match.
+    bool find_span(std::string_view input_line, size_t from, size_t& start, size_t& end);
+
+    size_t state_count() const { return states_.size(); }
+    size_t flush_count() const { return flush_count_; }
+    size_t states_built() const { return states_built_; }      // Over the DFA's life, flushes included
+    size_t fallback_count() const { return fallback_count_; }  // Lines finished without the cache
+
+private:
+    // Transition entries carry the target's flags so the scan loop needs one load per byte
+    static constexpr int32_t kUnknown = -1;
+    static constexpr int32_t kTagMatch = 1 << 30;
+    static constexpr int32_t kTagDead = 1 << 29;
+    static constexpr int32_t kTagAccelerate = 1 << 28;
+    static constexpr int32_t kIndexMask = kTagAccelerate - 1;
+    static constexpr int32_t kSlowPath = kUnknown & ~kIndexMask;
+    static constexpr size_t kMinBytesPerState = 10;  // Below this reuse rate the cache is thrashing
+    static constexpr int kMaxAccelerationBytes = 64;  // Skipping pays off only for narrow first-byte sets
+    static constexpr size_t kMinIndexSlots = 64;
+
+    struct State {
+        uint32_t pcs_begin = 0;       // Sorted consuming/assertion instructions in the closure,
+        uint32_t pcs_count = 0;       // stored at pc_pool_[pcs_begin, pcs_begin + pcs_count)
+        bool is_match = false;        // Closure reached Match
+        bool at_line_start = false;   // ^ still holds in this state
+        int8_t end_accepts = -1;      // Cached: does the closure match at end of line (-1 unknown)
+    };
+
+    // Sparse set over instruction indices, cleared in O(1)
+    struct SparseSet {
+        std::vector<uint32_t> dense;
+        std::vector<uint32_t> sparse;
+        size_t size = 0;
+
+        void resize(size_t capacity);
+        bool contains(uint32_t value) const;
+        void insert(uint32_t value);
+        void clear() { size = 0; }
+    };
+
+    ProgramView program_;
+    size_t memory_limit_;
+    size_t memory_used_ = 0;
+    size_t flush_count_ = 0;
+    size_t states_built_ = 0;
+    size_t fallback_count_ = 0;
+    size_t bytes_since_flush_ = 0;
+
+    std::vector<State> states_;
+    std::vector<int32_t> transitions_;  // 256 tagged entries per state, kUnknown until computed
+    std::vector<uint32_t> pc_pool_;     // Instruction sets of all states, back to back
+    std::vector<int32_t> index_slots_;  // Open-addressing index from closure to state; kUnknown if empty
+    int32_t start_state_ = kUnknown;
+    int32_t dead_state_ = kUnknown;
+    int32_t line_match_state_ = kUnknown;
+    bool floating_ = true;  // Unanchored search: every step may begin a new match
+    int32_t float_state_ = kUnknown;  // Mid-line state with no match in progress
+    bool accelerate_ = false;         // Skip through float_state_ with accelerator_
+    ClassScanner accelerator_;
+
+    // Scratch reused across transitions
+    SparseSet closure_;
+    SparseSet step_;
+    std::vector<uint32_t> stack_;
+    std::vector<uint32_t> key_;
+    std::vector<uint32_t> carried_;       // flush_keeping: the closure that survives the flush
+    std::vector<size_t> closure_starts_;  // find_span: where the thread at each dense slot began
+    std::vector<size_t> step_starts_;
+
+    void add_closure(SparseSet& set, uint32_t pc, bool at_start, bool at_end);
+    void step(const uint32_t* pcs, size_t count, unsigned char byte, SparseSet& to);
+    bool set_has_match(const SparseSet& set) const;
+    void append_matches(const SparseSet& set, std::vector<uint32_t>& ids) const;
+    void add_thread(SparseSet& set, std::vector<size_t>& starts, uint32_t pc, size_t start, bool at_start,
+                    bool at_end);
+    int32_t intern_closure(bool at_line_start);
+    void grow_index();
+    const uint32_t* state_pcs(int32_t state) const { return pc_pool_.data() + states_[state].pcs_begin; }
+    int32_t compute_next(int32_t state, unsigned char byte);
+    int32_t tag(int32_t state) const;
+    bool accepts_at_end(const uint32_t* pcs, size_t count, bool at_line_start);
+    bool end_accepts(int32_t state);
+    size_t simulate_line(int32_t state, std::string_view text, size_t from, size_t& line_end);
+    int32_t flush_keeping(int32_t state);
+    void reset_cache();
+};
+
+#endif // LAZY_DFA_H
@@ -0,0 +1,126 @@
+#include "line_reader.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include "search_stats.h"
+
+LineReader::LineReader(int fd) : fd_(fd), buffer_(kChunkSize) {}
+
+bool LineReader::next_block(std::string_view& block) {
+    size_t scanned = begin_;  // Bytes before this offset are known to hold no '\n'
+    while (true) {
+        const char* start = buffer_.data() + begin_;
+        const void* newline = ::memrchr(buffer_.data() + scanned, '\n', end_ - scanned);
+        if (newline != nullptr) {
+            const char* stop = static_cast<const char*>(newline) + 1;
+            block = std::string_view(start, stop - start);
+            begin_ += block.length();
+            return true;
+        }
+        if (eof_) {
+            if (begin_ == end_) {
+                return false;
+            }
+            // Last line without a trailing newline
+            block = std::string_view(start, end_ - begin_);
+            begin_ = end_;
+            return true;
+        }
+
+        scanned = end_ - begin_;
+        fill();
+    }
+}
+
+// Moves the partial line to the front of the buffer and reads the next chunk after it
+void LineReader::fill() {
+    if (begin_ > 0) {
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+    if (buffer_.size() - end_ < kChunkSize) {
+        // A line longer than the buffer; grow so one read still fetches a full chunk
+        buffer_.resize(end_ + kChunkSize);
+    }
+
+    while (true) {
+        ssize_t count = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Read error: ") + std::strerror(errno));
+        }
+        if (count == 0) {
+            eof_ = true;
+        }
+        end_ += static_cast<size_t>(count);
+        return;
+    }
+}
+
+OutputBuffer::OutputBuffer() : fd_(-1) {}
+
+OutputBuffer::OutputBuffer(int fd) : fd_(fd), buffer_(kCapacity) {}
+
+OutputBuffer::~OutputBuffer() {
+    try {
+        flush();
+    } catch (const std::runtime_error&) {
+        // Nothing sensible to do with a failed write during destruction
+    }
+}
+
+void OutputBuffer::write(std::string_view data) {
+    if (fd_ < 0) {
+        memory_.append(data);
+        return;
+    }
+    if (data.length() > buffer_.size() - size_) {
+        flush();
+        if (data.length() >= buffer_.size()) {
+            // Too large to batch; send it straight through
+            write_all(data.data(), data.length());
+            return;
+        }
+    }
+    std::memcpy(buffer_.data() + size_, data.data(), data.length());
+    size_ += data.length();
+}
+
+void OutputBuffer::write_line(std::string_view line) {
+    write(line);
+    write("\n");
+}
+
+void OutputBuffer::flush() {
+    if (fd_ < 0) {
+        return;
+    }
+    size_t pending = size_;
+    size_ = 0;
+    write_all(buffer_.data(), pending);
+}
+
+std::string OutputBuffer::take() {
+    return std::exchange(memory_, std::string());
+}
+
+void OutputBuffer::write_all(const char* data, size_t length) {
+    StatsTimer timer(&SearchStats::output_ns);
+    while (length > 0) {
+        ssize_t count = ::write(fd_, data, length);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("Write error: ") + std::strerror(errno));
+        }
+        data += count;
+        length -= static_cast<size_t>(count);
+    }
+}
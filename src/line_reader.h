@@ -0,0 +1,63 @@
+// line_reader.h
+#ifndef LINE_READER_H
+#define LINE_READER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Reads a file descriptor in large chunks and hands out whole lines as views into its buffer.
+// A view stays valid until the next call to next_block().
+class LineReader {
+public:
+    static constexpr size_t kChunkSize = 256 * 1024;
+
+    explicit LineReader(int fd);
+
+    // Stores every complete line currently buffered, '\n' terminators included, in `block`;
+    // the last line of input may lack its '\n'. Returns false at end of input.
+    // Throws std::runtime_error if the read fails.
+    bool next_block(std::string_view& block);
+
+private:
+    int fd_;
+    std::vector<char> buffer_;
+    size_t begin_ = 0;  // Start of unconsumed data
+    size_t end_ = 0;    // End of valid data
+    bool eof_ = false;
+
+    void fill();
+};
+
+// Collects output and writes it to a file descriptor in large batches.
+// Default-constructed buffers keep everything in memory until take() is called, which lets
+// parallel workers produce output that is later written in a deterministic order.
+class OutputBuffer {
+public:
+    static constexpr size_t kCapacity = 64 * 1024;
+
+    OutputBuffer();
+    explicit OutputBuffer(int fd);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void write(std::string_view data);
+    void write_line(std::string_view line);
+    void flush();
+
+    // Returns and clears the collected output of an in-memory buffer
+    std::string take();
+
+private:
+    int fd_;  // -1 for an in-memory buffer
+    std::vector<char> buffer_;
+    size_t size_ = 0;
+    std::string memory_;
+
+    void write_all(const char* data, size_t length);
+};
+
+#endif // LINE_READER_H
@@ -0,0 +1,243 @@
+// literal_analysis.h
+#ifndef LITERAL_ANALYSIS_H
+#define LITERAL_ANALYSIS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "regex_program.h"
+
+// Literals that every match of a pattern must contain: at least one of `alternatives`
+// occurs in any matching line. `exact` means a line matches if and only if it contains
+// one of them, so no further verification is needed.
+struct RequiredLiterals {
+    std::vector<std::string> alternatives;
+    bool exact = false;
+};
+
+// The analysis behind extract_required_literals(), constexpr so that static_regex.h can pick
+// the same prefilter literals at compile time
+class LiteralAnalyzer {
+public:
+    static constexpr RequiredLiterals extract(const RegexAst& ast) {
+        LiteralInfo info = analyze(ast, ast.root);
+        RequiredLiterals result;
+        result.exact = info.exact && !required(info).empty();
+
+        // Containing "ab" implies containing "a", so longer literals with a shorter one inside are redundant
+        for (const std::string& literal : required(info)) {
+            bool redundant = false;
+            for (const std::string& other : required(info)) {
+                if (other != literal && literal.find(other) != std::string::npos) {
+                    redundant = true;
+                    break;
+                }
+            }
+            if (!redundant) {
+                result.alternatives.push_back(literal);
+            }
+        }
+
+        for (const std::string& literal : result.alternatives) {
+            if (literal.find('\n') != std::string::npos) {
+                // Literals spanning a line break cannot be located within single lines
+                return RequiredLiterals{};
+            }
+        }
+        return result;
+    }
+
+    // Length of the shortest string in the set
+    static constexpr size_t shortest(const std::vector<std::string>& strings) {
+        size_t length = SIZE_MAX;
+        for (const std::string& s : strings) {
+            length = std::min(length, s.length());
+        }
+        return length;
+    }
+
+private:
+    static constexpr size_t kMaxExactStrings = 16;
+    static constexpr size_t kMaxClassExpansion = 4;
+
+    // What the extractor knows about one AST node
+    struct LiteralInfo {
+        bool exact = false;             // The node always matches exactly one of `strings`
+        std::vector<std::string> strings;
+        std::vector<std::string> must;  // One of these occurs in every match; empty when unknown
+    };
+
+    static constexpr void dedupe(std::vector<std::string>& strings) {
+        std::sort(strings.begin(), strings.end());
+        strings.erase(std::unique(strings.begin(), strings.end()), strings.end());
+    }
+
+    // Required literals implied by a node, whether it is exact or not
+    static constexpr std::vector<std::string> required(const LiteralInfo& info) {
+        if (!info.exact) {
+            return info.must;
+        }
+        if (info.strings.empty() || shortest(info.strings) == 0) {
+            return {};  // The node can match empty, so it requires nothing
+        }
+        return info.strings;
+    }
+
+    // Longer literals are more selective; among equals, fewer alternatives are cheaper to scan
+    static constexpr bool more_selective(const std::vector<std::string>& a, const std::vector<std::string>& b) {
+        if (a.empty() || b.empty()) {
+            return !a.empty();
+        }
+        size_t a_len = shortest(a);
+        size_t b_len = shortest(b);
+        if (a_len != b_len) {
+            return a_len > b_len;
+        }
+        return a.size() < b.size();
+    }
+
+    static constexpr LiteralInfo unknown() {
+        return LiteralInfo{};
+    }
+
+    static constexpr LiteralInfo exact_of(std::vector<std::string> strings) {
+        LiteralInfo info;
+        info.exact = true;
+        info.strings = std::move(strings);
+        return info;
+    }
+
+
+    static constexpr LiteralInfo analyze_concat(const RegexAst& ast, const RegexNode& node) {
+        std::vector<std::string> best;
+        std::vector<std::string> run{""};  // Exact strings of the current run of exact children
+        bool all_exact = true;
+
+        auto close_run = [&]() {
+            std::vector<std::string> candidate = required(exact_of(run));
+            if (more_selective(candidate, best)) {
+                best = std::move(candidate);
+            }
+            run = {""};
+        };
+
+        for (int child : node.children) {
+            LiteralInfo info = analyze(ast, child);
+            if (info.exact && run.size() * info.strings.size() <= kMaxExactStrings) {
+                std::vector<std::string> joined;
+                for (const std::string& prefix : run) {
+                    for (const std::string& suffix : info.strings) {
+                        joined.push_back(prefix + suffix);
+                    }
+                }
+                dedupe(joined);
+                run = std::move(joined);
+                continue;
+            }
+
+            all_exact = false;
+            close_run();
+            if (info.exact) {
+                // Too many combinations to keep exact; restart the run from this child
+                run = info.strings;
+            } else if (more_selective(info.must, best)) {
+                best = info.must;
+            }
+        }
+
+        if (all_exact) {
+            return exact_of(std::move(run));
+        }
+        close_run();
+        LiteralInfo info;
+        info.must = std::move(best);
+        return info;
+    }
+
+    static constexpr LiteralInfo analyze_alternation(const RegexAst& ast, const RegexNode& node) {
+        std::vector<LiteralInfo> options;
+        bool all_exact = true;
+        size_t exact_total = 0;
+        for (int child : node.children) {
+            options.push_back(analyze(ast, child));
+            all_exact = all_exact && options.back().exact;
+            exact_total += options.back().strings.size();
+        }
+
+        if (all_exact && exact_total <= kMaxExactStrings) {
+            std::vector<std::string> strings;
+            for (const LiteralInfo& option : options) {
+                strings.insert(strings.end(), option.strings.begin(), option.strings.end());
+            }
+            dedupe(strings);
+            return exact_of(std::move(strings));
+        }
+
+        // A match goes through one option, so it contains one of the union of their requirements
+        LiteralInfo info;
+        for (const LiteralInfo& option : options) {
+            std::vector<std::string> option_must = required(option);
+            if (option_must.empty()) {
+                return unknown();
+            }
+            info.must.insert(info.must.end(), option_must.begin(), option_must.end());
+        }
+        dedupe(info.must);
+        return info;
+    }
+
+    static constexpr LiteralInfo analyze(const RegexAst& ast, int index) {
+        const RegexNode& node = ast.nodes[index];
+        switch (node.type) {
+            case RegexNodeType::Empty:
+                return exact_of({""});
+            case RegexNodeType::Byte:
+                return exact_of({std::string(1, static_cast<char>(node.byte))});
+            case RegexNodeType::Class: {
+                const ByteSet& set = ast.classes[node.class_index];
+                if (set.count() == 0 || set.count() > static_cast<int>(kMaxClassExpansion)) {
+                    return unknown();
+                }
+                std::vector<std::string> strings;
+                for (int c = 0; c < 256; c++) {
+                    if (set.test(static_cast<unsigned char>(c))) {
+                        strings.push_back(std::string(1, static_cast<char>(c)));
+                    }
+                }
+                return exact_of(std::move(strings));
+            }
+            case RegexNodeType::Any:
+            case RegexNodeType::LineStart:
+            case RegexNodeType::LineEnd:
+            case RegexNodeType::Star:
+            case RegexNodeType::Backref:
+                return unknown();
+            case RegexNodeType::Concat:
+                return analyze_concat(ast, node);
+            case RegexNodeType::Alternation:
+                return analyze_alternation(ast, node);
+            case RegexNodeType::Group:
+                return analyze(ast, node.children[0]);
+            case RegexNodeType::Question: {
+                LiteralInfo child = analyze(ast, node.children[0]);
+                if (!child.exact || child.strings.size() + 1 > kMaxExactStrings) {
+                    return unknown();
+                }
+                child.strings.push_back("");
+                dedupe(child.strings);
+                return child;
+            }
+            case RegexNodeType::Plus: {
+                // At least one repetition, so the body's requirements carry over
+                LiteralInfo info;
+                info.must = required(analyze(ast, node.children[0]));
+                return info;
+            }
+        }
+        return unknown();
+    }
+};
+
+#endif // LITERAL_ANALYSIS_H
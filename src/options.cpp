@@ -0,0 +1,168 @@
+#include "options.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include "trigram_index.h"
+
+namespace {
+
+size_t parse_count(std::string_view flag, const std::string& value) {
+    size_t parsed = 0;
+    try {
+        size_t used = 0;
+        unsigned long number = std::stoul(value, &used);
+        if (used != value.length() || number == 0) {
+            throw std::invalid_argument(value);
+        }
+        parsed = static_cast<size_t>(number);
+    } catch (const std::logic_error&) {
+        throw std::runtime_error("Invalid value for " + std::string(flag) + ": " + value);
+    }
+    return parsed;
+}
+
+// Value of a short option given either attached ("-j4") or as the next argument ("-j 4")
+std::string option_value(const std::string& arg, int argc, char* argv[], int& i) {
+    if (arg.length() > 2) {
+        return arg.substr(2);
+    }
+    if (i + 1 >= argc) {
+        throw std::runtime_error("Expected a value after " + arg);
+    }
+    return argv[++i];
+}
+
+// One pattern per line, as with grep -f
+void read_pattern_file(const std::string& path, std::vector<std::string>& patterns) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error(path + ": " + std::strerror(errno));
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        patterns.push_back(line);
+    }
+    if (file.bad()) {
+        throw std::runtime_error(path + ": " + std::strerror(errno));
+    }
+}
+
+bool is_option(const std::string& arg, std::string_view name) {
+    return arg.compare(0, name.length(), name) == 0;
+}
+
+// Flags without values, which may be grouped behind one dash as in -En
+constexpr std::string_view kSwitches = "Eobnczr";
+
+bool is_switch_group(const std::string& arg) {
+    return arg.length() >= 2 && arg[0] == '-' &&
+           arg.find_first_not_of(kSwitches, 1) == std::string::npos;
+}
+
+} // namespace
+
+GrepOptions parse_options(int argc, char* argv[]) {
+    GrepOptions options;
+    bool extended = false;
+    bool patterns_given = false;  // -e or -f was used, so every operand is a file
+
+    int i = 1;
+    for (; i < argc; i++) {
+        std::string arg = argv[i];
+        if (is_switch_group(arg)) {
+            for (char flag : std::string_view(arg).substr(1)) {
+                switch (flag) {
+                    case 'E': extended = true; break;
+                    case 'o': options.only_matching = true; break;
+                    case 'b': options.byte_offset = true; break;
+                    case 'n': options.line_number = true; break;
+                    case 'c': options.count_only = true; break;
+                    case 'z': options.decompress = true; break;
+                    case 'r': options.recursive = true; break;
+                    default: break;
+                }
+            }
+        } else if (arg == "--pattern-ids") {
+            options.pattern_ids = true;
+        } else if (is_option(arg, "--include=")) {
+            options.include.push_back(arg.substr(std::string_view("--include=").length()));
+        } else if (is_option(arg, "--exclude=")) {
+            options.exclude.push_back(arg.substr(std::string_view("--exclude=").length()));
+        } else if (is_option(arg, "--exclude-dir=")) {
+            options.exclude_dir.push_back(arg.substr(std::string_view("--exclude-dir=").length()));
+        } else if (arg == "--no-ignore") {
+            options.use_ignore_files = false;
+        } else if (arg == "--utf8") {
+            options.utf8 = true;
+        } else if (arg == "--no-cache") {
+            options.use_cache = false;
+        } else if (arg == "--cache-stats") {
+            options.cache_stats = true;
+        } else if (arg == "--index") {
+            options.index_path = TrigramIndex::kDefaultPath;
+        } else if (is_option(arg, "--index=")) {
+            options.index_path = arg.substr(std::string_view("--index=").length());
+        } else if (arg == "--stats" || arg == "--stats=json") {
+            options.stats = true;
+            options.stats_json = arg == "--stats=json";
+        } else if (is_option(arg, "-j")) {
+            options.jobs = parse_count("-j", option_value(arg, argc, argv, i));
+        } else if (is_option(arg, "-e")) {
+            options.patterns.push_back(option_value(arg, argc, argv, i));
+            patterns_given = true;
+        } else if (is_option(arg, "-f")) {
+            read_pattern_file(option_value(arg, argc, argv, i), options.patterns);
+            patterns_given = true;
+        } else if (arg == "--") {
+            i++;
+            break;
+        } else {
+            break;
+        }
+    }
+
+    if (!extended) {
+        throw std::runtime_error("Expected first argument to be '-E'");
+    }
+    if (!patterns_given) {
+        if (i >= argc) {
+            throw std::runtime_error("Expected a pattern");
+        }
+        options.patterns.push_back(argv[i++]);
+    }
+    for (; i < argc; i++) {
+        options.files.push_back(argv[i]);
+    }
+    if (options.recursive && !options.index_path.empty()) {
+        throw std::runtime_error("Cannot combine -r with --index");
+    }
+    return options;
+}
+
+IndexOptions parse_index_options(int argc, char* argv[]) {
+    IndexOptions options;
+    options.index_path = TrigramIndex::kDefaultPath;
+    int i = 2;
+    for (; i < argc; i++) {
+        std::string arg = argv[i];
+        if (is_option(arg, "--index=")) {
+            options.index_path = arg.substr(std::string_view("--index=").length());
+        } else if (arg == "--") {
+            i++;
+            break;
+        } else if (arg.length() > 1 && arg[0] == '-') {
+            throw std::runtime_error("Unknown option for index: " + arg);
+        } else {
+            break;
+        }
+    }
+    for (; i < argc; i++) {
+        options.paths.push_back(argv[i]);
+    }
+    if (options.index_path.empty()) {
+        throw std::runtime_error("Expected a file name after --index=");
+    }
+    return options;
+}
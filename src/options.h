@@ -0,0 +1,50 @@
+// options.h
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Command line of the grep executable
+struct GrepOptions {
+    std::vector<std::string> patterns;  // From -e, -f, or the first operand
+    std::vector<std::string> files;     // Empty means standard input
+    size_t jobs = 1;                    // -j N: worker threads for file searches
+    bool pattern_ids = false;           // --pattern-ids: prefix lines with the matching pattern numbers
+    bool only_matching = false;         // -o: print only the matched parts of lines
+    bool byte_offset = false;           // -b: prefix output with its byte offset in the input
+    bool line_number = false;           // -n: prefix output with its line number
+    bool count_only = false;            // -c: print only the number of matching lines
+    bool decompress = false;            // -z: decompress gzip and zstd inputs, detected by their magic bytes
+    bool utf8 = false;                  // --utf8: '.', classes and groups match whole UTF-8 characters
+    bool recursive = false;             // -r: search the files below directory operands
+    std::vector<std::string> include;      // --include=GLOB: with -r, only search files whose name matches
+    std::vector<std::string> exclude;      // --exclude=GLOB: with -r, skip files whose name matches
+    std::vector<std::string> exclude_dir;  // --exclude-dir=GLOB: with -r, skip directories whose name matches
+    bool use_ignore_files = true;       // Cleared by --no-ignore: with -r, disregard .gitignore files
+    bool use_cache = true;              // Cleared by --no-cache: always compile the patterns afresh
+    bool cache_stats = false;           // --cache-stats: report pattern cache hits, misses and evictions on stderr
+    bool stats = false;                 // --stats: report counters and timings of the search on stderr
+    bool stats_json = false;            // --stats=json: as one JSON object instead of labelled lines
+    std::string index_path;             // --index[=FILE]: search through a trigram index; empty for none
+};
+
+// Command line of the index subcommand, which builds or refreshes a trigram index
+struct IndexOptions {
+    std::string index_path;          // --index=FILE, else TrigramIndex::kDefaultPath
+    std::vector<std::string> paths;  // Files and directories to add; indexed files are always refreshed
+};
+
+// Parses `-E [-o] [-b] [-n] [-c] [-z] [-r] [-j N] [-e pattern]... [-f file]... [--include=GLOB]...
+// [--exclude=GLOB]... [--exclude-dir=GLOB]... [--no-ignore] [--utf8] [--pattern-ids] [--no-cache]
+// [--cache-stats] [--stats[=json]] [--index[=FILE]] [pattern] [file...]`. Single-letter flags may
+// be combined, as in -rn. Options must precede the operands. Throws std::runtime_error on
+// invalid usage.
+GrepOptions parse_options(int argc, char* argv[]);
+
+// Parses `index [--index=FILE] [path...]`, argv[1] being "index". Throws std::runtime_error
+// on invalid usage.
+IndexOptions parse_index_options(int argc, char* argv[]);
+
+#endif // OPTIONS_H
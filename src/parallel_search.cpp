@@ -0,0 +1,178 @@
+#include "parallel_search.h"
+#include <condition_variable>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <sys/stat.h>
+#include "decompress.h"
+#include "file_mapping.h"
+#include "search_stats.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Output of one task, handed from the worker to the writing thread
+struct Slot {
+    std::string output;
+    std::string error;
+    size_t matches = 0;
+    bool done = false;
+};
+
+class SlotBoard {
+public:
+    explicit SlotBoard(size_t count) : slots_(count) {}
+
+    void finish(size_t index, Slot&& result) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            slots_[index] = std::move(result);
+            slots_[index].done = true;
+        }
+        ready_.notify_all();
+    }
+
+    Slot wait(size_t index) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&]() { return slots_[index].done; });
+        return std::move(slots_[index]);
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::vector<Slot> slots_;
+};
+
+// Maps a regular file big enough to split; returns nullptr if it should be searched whole,
+// as must a compressed file that is to be decompressed. The mapping is shared by the chunk
+// tasks that search it.
+std::shared_ptr<const FileMapping> map_large_file(const std::string& path, bool decompress) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;  // The whole-file task reports the error
+    }
+    FdCloser closer{fd};
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+        static_cast<size_t>(info.st_size) <= 2 * kParallelChunkSize) {
+        return nullptr;
+    }
+    auto mapping = std::make_shared<FileMapping>();
+    if (!mapping->map(fd, static_cast<size_t>(info.st_size)) ||
+        (decompress && detect_compression(mapping->contents()) != Compression::None)) {
+        return nullptr;
+    }
+    mapping->advise_sequential();
+    return mapping;
+}
+
+// Chunk boundaries placed just after the first '\n' at or beyond each multiple of the chunk size
+std::vector<size_t> chunk_bounds(std::string_view contents) {
+    std::vector<size_t> bounds{0};
+    size_t next = kParallelChunkSize;
+    while (next < contents.length()) {
+        size_t newline = contents.find('\n', next);
+        if (newline == std::string_view::npos || newline + 1 >= contents.length()) {
+            break;
+        }
+        bounds.push_back(newline + 1);
+        next = newline + 1 + kParallelChunkSize;
+    }
+    bounds.push_back(contents.length());
+    return bounds;
+}
+
+} // namespace
+
+bool parallel_search(const CompiledPattern& pattern, const std::vector<std::string>& files,
+                     const SearchOptions& options, size_t jobs, OutputBuffer& out) {
+    // Plan every task up front so slot order is file order, then chunk order within a file
+    std::vector<std::function<Slot()>> tasks;
+    std::vector<const std::string*> chunk_of;  // File of each chunk task, nullptr for whole files
+    for (const std::string& file : files) {
+        std::shared_ptr<const FileMapping> mapping = map_large_file(file, options.decompress);
+        if (mapping == nullptr) {
+            tasks.push_back([&pattern, &options, &file]() {
+                Slot slot;
+                OutputBuffer buffer;
+                try {
+                    slot.matches = search_file(pattern, file, options, buffer);
+                } catch (const std::runtime_error& e) {
+                    slot.error = file + ": " + e.what();
+                }
+                slot.output = buffer.take();
+                return slot;
+            });
+            chunk_of.push_back(nullptr);
+            continue;
+        }
+
+        if (search_stats_enabled()) {
+            thread_stats().files++;  // Its chunks go through search_buffer, which counts no files
+        }
+
+        // A chunk's first line number depends on every chunk before it, so with -n the
+        // newlines are counted here, at memory speed, before the searches start
+        std::vector<size_t> bounds = chunk_bounds(mapping->contents());
+        FilePosition position;
+        for (size_t i = 0; i + 1 < bounds.size(); i++) {
+            std::string_view chunk = mapping->contents().substr(bounds[i], bounds[i + 1] - bounds[i]);
+            tasks.push_back([&pattern, &options, &file, mapping, chunk, position]() mutable {
+                Slot slot;
+                OutputBuffer buffer;
+                try {
+                    slot.matches = search_buffer(pattern, chunk, file, options, buffer, position);
+                } catch (const std::runtime_error& e) {
+                    slot.error = file + ": " + e.what();
+                }
+                slot.output = buffer.take();
+                return slot;
+            });
+            chunk_of.push_back(&file);
+            position.offset += chunk.length();
+            if (options.line_number) {
+                position.line += count_byte(chunk, '\n');
+            }
+        }
+    }
+
+    SlotBoard board(tasks.size());
+    bool any_match = false;
+    size_t file_matches = 0;  // Matching lines so far in the current chunked file
+    bool file_failed = false;  // A chunk of the current file failed: like a sequential search, stop there
+    {
+        ThreadPool pool(jobs);
+        for (size_t i = 0; i < tasks.size(); i++) {
+            pool.submit([&board, &tasks, i]() { board.finish(i, tasks[i]()); });
+        }
+
+        // Write results in order as they complete while later tasks keep running
+        for (size_t i = 0; i < tasks.size(); i++) {
+            Slot slot = board.wait(i);
+            bool last_chunk = chunk_of[i] != nullptr && (i + 1 == tasks.size() || chunk_of[i + 1] != chunk_of[i]);
+            if (!file_failed) {
+                out.write(slot.output);
+                if (!slot.error.empty()) {
+                    out.flush();
+                    std::cerr << slot.error << std::endl;
+                }
+                any_match |= slot.matches > 0;
+                // Whole-file tasks print their own count; chunked files are counted after their last chunk
+                file_matches += slot.matches;
+                file_failed = chunk_of[i] != nullptr && !slot.error.empty();
+                if (last_chunk && !file_failed && options.count_only) {
+                    write_count(*chunk_of[i], file_matches, options, out);
+                }
+            }
+            if (chunk_of[i] == nullptr || last_chunk) {
+                file_matches = 0;
+                file_failed = false;
+            }
+        }
+    }
+    return any_match;
+}
@@ -0,0 +1,23 @@
+// parallel_search.h
+#ifndef PARALLEL_SEARCH_H
+#define PARALLEL_SEARCH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "grep_funcs.h"
+#include "line_reader.h"
+#include "search.h"
+
+// Regular files larger than two chunks are split at line boundaries into chunks of about this size
+constexpr size_t kParallelChunkSize = 4 * 1024 * 1024;
+
+// Searches `files` on `jobs` threads sharing one compiled pattern. Each file is a task and
+// large files are split into line-aligned chunks; every task fills its own in-memory buffer,
+// and the buffers are written to `out` in file and chunk order, so output is identical to a
+// sequential run. Errors are reported on stderr in the same order; a chunked file that fails
+// is reported once and, as in a sequential run, nothing after the failing chunk is printed.
+bool parallel_search(const CompiledPattern& pattern, const std::vector<std::string>& files,
+                     const SearchOptions& options, size_t jobs, OutputBuffer& out);
+
+#endif // PARALLEL_SEARCH_H
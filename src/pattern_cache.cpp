@@ -0,0 +1,269 @@
+#include "pattern_cache.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include "file_mapping.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'G', 'R', 'E', 'P', 'C', 'A', 'C', 'H'};
+
+// Fixed-size prefix of every entry, checked before the payload is touched
+struct EntryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t key;
+    uint64_t payload_size;
+    uint64_t payload_hash;
+};
+
+// Lengths go into the hash too, so ["ab", "c"] and ["a", "bc"] get different keys
+uint64_t pattern_key(const std::vector<std::string>& patterns, uint32_t flags) {
+    BinaryWriter key;
+    key.put(PatternCache::kFormatVersion);
+    key.put(flags);
+    key.put<uint64_t>(patterns.size());
+    for (const std::string& pattern : patterns) {
+        key.put_string(pattern);
+    }
+    return hash_bytes(key.data());
+}
+
+// Creates `path` and any missing parents; returns false if it still does not exist
+bool make_directories(const std::string& path) {
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string prefix = path.substr(0, slash);
+        if (::mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (slash == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+// A temporary file this old belongs to a run that died before renaming it
+constexpr time_t kStaleTemporarySeconds = 3600;
+
+// One cache entry as found on disk
+struct EntryFile {
+    std::string path;
+    int64_t mtime_ns;
+    uint64_t size;
+};
+
+// What a directory entry is to the cache. The directory may be shared, as /tmp is, so only
+// names the cache writes itself are ever touched: "<16 hex digits>.gpc", and while one is
+// being written, "<16 hex digits>.gpc.<pid>.tmp".
+enum class CacheFile { Foreign, Entry, Temporary };
+
+CacheFile classify(std::string_view name) {
+    constexpr size_t kKeyDigits = 16;
+    constexpr std::string_view kEntrySuffix = ".gpc";
+    if (name.length() < kKeyDigits + kEntrySuffix.length() ||
+        !std::all_of(name.begin(), name.begin() + kKeyDigits,
+                     [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); }) ||
+        name.substr(kKeyDigits, kEntrySuffix.length()) != kEntrySuffix) {
+        return CacheFile::Foreign;
+    }
+    std::string_view rest = name.substr(kKeyDigits + kEntrySuffix.length());
+    if (rest.empty()) {
+        return CacheFile::Entry;
+    }
+    // ".<pid>.tmp"
+    if (!rest.starts_with('.') || !rest.ends_with(".tmp") || rest.length() <= 5 ||
+        !std::all_of(rest.begin() + 1, rest.end() - 4, [](char c) { return c >= '0' && c <= '9'; })) {
+        return CacheFile::Foreign;
+    }
+    return CacheFile::Temporary;
+}
+
+int64_t mtime_ns(const struct stat& info) {
+    return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+PatternCache::PatternCache(std::string directory, size_t max_entries, uint64_t max_bytes)
+    : directory_(std::move(directory)), max_entries_(max_entries), max_bytes_(max_bytes) {}
+
+std::string PatternCache::default_directory() {
+    if (const char* dir = std::getenv("GREP_CACHE_DIR"); dir != nullptr && *dir != '\0') {
+        return dir;
+    }
+    if (const char* dir = std::getenv("XDG_CACHE_HOME"); dir != nullptr && *dir != '\0') {
+        return std::string(dir) + "/grep-patterns";
+    }
+    if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+        return std::string(home) + "/.cache/grep-patterns";
+    }
+    return std::string();
+}
+
+std::unique_ptr<CompiledPattern> PatternCache::load(const std::vector<std::string>& patterns, uint32_t flags) {
+    if (directory_.empty()) {
+        misses_++;
+        return std::make_unique<CompiledPattern>(patterns, flags);
+    }
+
+    uint64_t key = pattern_key(patterns, flags);
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.gpc", static_cast<unsigned long long>(key));
+    std::string path = directory_ + name;
+
+    std::unique_ptr<CompiledPattern> compiled = read_entry(path, patterns, flags, key);
+    if (compiled != nullptr) {
+        hits_++;
+        return compiled;
+    }
+    misses_++;
+    compiled = std::make_unique<CompiledPattern>(patterns, flags);
+    if (write_entry(path, *compiled, flags, key)) {
+        prune();
+    }
+    return compiled;
+}
+
+// Returns nullptr on any mismatch, so the caller falls back to compiling
+std::unique_ptr<CompiledPattern> PatternCache::read_entry(const std::string& path,
+                                                          const std::vector<std::string>& patterns,
+                                                          uint32_t flags, uint64_t key) const {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    FdCloser closer{fd};
+    struct stat info;
+    if (fd < 0 || ::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(EntryHeader)) {
+        return nullptr;
+    }
+    FileMapping entry;
+    if (!entry.map(fd, static_cast<size_t>(info.st_size))) {
+        return nullptr;
+    }
+
+    std::string_view file = entry.contents();
+    EntryHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    std::string_view payload = file.substr(sizeof(header));
+    bool valid = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kFormatVersion &&
+                 header.flags == flags && header.key == key && header.payload_size == payload.length() &&
+                 header.payload_hash == hash_bytes(payload);
+    if (!valid) {
+        return nullptr;
+    }
+
+    try {
+        BinaryReader in(payload);
+        auto compiled = std::make_unique<CompiledPattern>(in);
+        // A different pattern list with the same hash is a miss, not a wrong answer
+        if (!in.at_end() || compiled->patterns() != patterns) {
+            return nullptr;
+        }
+        ::futimens(fd, nullptr);  // Now the most recently used entry
+        return compiled;
+    } catch (const std::runtime_error&) {
+        return nullptr;
+    }
+}
+
+// Writes to a private temporary file first, so concurrent runs only ever see complete entries.
+// Returns true if the entry was stored.
+bool PatternCache::write_entry(const std::string& path, const CompiledPattern& compiled, uint32_t flags,
+                               uint64_t key) const {
+    BinaryWriter payload;
+    compiled.save(payload);
+
+    EntryHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kFormatVersion;
+    header.flags = flags;
+    header.key = key;
+    header.payload_size = payload.data().length();
+    header.payload_hash = hash_bytes(payload.data());
+
+    if (!make_directories(directory_)) {
+        return false;
+    }
+    std::string temporary = path + "." + std::to_string(::getpid()) + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool written = true;
+    for (std::string_view data : {std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)),
+                                  std::string_view(payload.data())}) {
+        while (written && !data.empty()) {
+            ssize_t count = ::write(fd, data.data(), data.length());
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            written = count > 0;
+            data.remove_prefix(written ? static_cast<size_t>(count) : 0);
+        }
+    }
+    written = ::close(fd) == 0 && written;
+    if (!written || ::rename(temporary.c_str(), path.c_str()) != 0) {
+        ::unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Removes least recently used entries until the cache is within both limits, and stale
+// temporary files. Files the cache did not write are left alone. Another run may be pruning
+// at the same time, so files that are already gone are simply skipped.
+void PatternCache::prune() {
+    DIR* dir = ::opendir(directory_.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+    std::vector<EntryFile> entries;
+    uint64_t total = 0;
+    time_t now = std::time(nullptr);
+    while (const dirent* item = ::readdir(dir)) {
+        CacheFile kind = classify(item->d_name);
+        if (kind == CacheFile::Foreign) {
+            continue;
+        }
+        std::string path = directory_ + "/" + item->d_name;
+        struct stat info;
+        if (::lstat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        if (kind == CacheFile::Temporary) {
+            if (now - info.st_mtim.tv_sec > kStaleTemporarySeconds) {
+                ::unlink(path.c_str());
+            }
+            continue;
+        }
+        entries.push_back({std::move(path), mtime_ns(info), static_cast<uint64_t>(info.st_size)});
+        total += static_cast<uint64_t>(info.st_size);
+    }
+    ::closedir(dir);
+
+    if (entries.size() <= max_entries_ && total <= max_bytes_) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const EntryFile& a, const EntryFile& b) { return a.mtime_ns < b.mtime_ns; });
+    size_t count = entries.size();
+    for (const EntryFile& entry : entries) {
+        if (count <= max_entries_ && total <= max_bytes_) {
+            break;
+        }
+        if (::unlink(entry.path.c_str()) == 0) {
+            evictions_++;
+        }
+        count--;
+        total -= entry.size;
+    }
+}
@@ -0,0 +1,60 @@
+// pattern_cache.h
+#ifndef PATTERN_CACHE_H
+#define PATTERN_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "grep_funcs.h"
+
+// Keeps compiled patterns on disk between runs, so a process started over and over with the
+// same patterns maps a file instead of parsing and compiling them again. Each entry is one
+// file named after a hash of the patterns and the compile flags; it holds a versioned header
+// and the tables written by CompiledPattern::save(). Entries that are missing, stale or
+// damaged count as misses: the patterns are compiled and the entry rewritten. The cache is
+// an optimization only, so failing to read or write it is never an error.
+//
+// The directory is bounded: a hit marks its entry as recently used by touching its
+// modification time, and each write that takes the cache past its entry count or byte size
+// removes the least recently used entries, along with temporary files left by crashed runs.
+// Only files named the way the cache names its own are ever removed, so the directory may be
+// shared with other programs.
+class PatternCache {
+public:
+    static constexpr uint32_t kFormatVersion = 4;  // Bump whenever any saved table changes layout
+    static constexpr size_t kMaxEntries = 256;
+    static constexpr uint64_t kMaxBytes = 64 * 1024 * 1024;
+
+    // An empty directory disables the cache: every lookup compiles and nothing is stored
+    explicit PatternCache(std::string directory, size_t max_entries = kMaxEntries, uint64_t max_bytes = kMaxBytes);
+
+    // $GREP_CACHE_DIR, else $XDG_CACHE_HOME/grep-patterns, else ~/.cache/grep-patterns;
+    // empty when none of them is set
+    static std::string default_directory();
+
+    // Returns the patterns compiled with `flags` (kUtf8Mode or 0), from the cache when possible.
+    // Throws std::runtime_error for malformed patterns.
+    std::unique_ptr<CompiledPattern> load(const std::vector<std::string>& patterns, uint32_t flags = 0);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t evictions() const { return evictions_; }
+    const std::string& directory() const { return directory_; }
+
+private:
+    std::string directory_;
+    size_t max_entries_;
+    uint64_t max_bytes_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+
+    std::unique_ptr<CompiledPattern> read_entry(const std::string& path, const std::vector<std::string>& patterns,
+                                                uint32_t flags, uint64_t key) const;
+    bool write_entry(const std::string& path, const CompiledPattern& compiled, uint32_t flags, uint64_t key) const;
+    void prune();
+};
+
+#endif // PATTERN_CACHE_H
@@ -0,0 +1,185 @@
+#include "prefilter.h"
+#include <algorithm>
+#include <cstring>
+#ifdef GREP_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+// Rough frequency rank of a byte in log and text data; lower means rarer
+int byte_rank(unsigned char c) {
+    static constexpr std::string_view kCommonLetters = "etaoinsrhldcumfpgwybvkxjqz";
+    if (c == ' ') {
+        return 255;
+    }
+    if (c >= 'a' && c <= 'z') {
+        return 250 - static_cast<int>(kCommonLetters.find(static_cast<char>(c))) * 4;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return 140 - static_cast<int>(kCommonLetters.find(static_cast<char>(c - 'A' + 'a'))) * 2;
+    }
+    if (c >= '0' && c <= '9') {
+        return 160;
+    }
+    if (c == '\t' || c == ':' || c == '/' || c == '.' || c == '-' || c == '_' || c == ',') {
+        return 120;
+    }
+    if (c >= 0x80) {
+        return 40;
+    }
+    return c < 0x20 ? 10 : 60;
+}
+
+} // namespace
+
+RequiredLiterals extract_required_literals(const RegexAst& ast) {
+    return LiteralAnalyzer::extract(ast);
+}
+
+LiteralPrefilter::LiteralPrefilter(const RequiredLiterals& literals) {
+    if (literals.alternatives.empty() || literals.alternatives.size() > kMaxLiterals) {
+        return;
+    }
+    literals_ = literals.alternatives;
+    exact_ = literals.exact;
+
+    if (literals_.size() == 1) {
+        const std::string& literal = literals_[0];
+        for (size_t i = 0; i < literal.length(); i++) {
+            unsigned char c = static_cast<unsigned char>(literal[i]);
+            if (i == 0 || byte_rank(c) < byte_rank(rare_byte_)) {
+                rare_byte_ = c;
+                rare_offset_ = i;
+            }
+        }
+        return;
+    }
+
+    fingerprint_ = std::min(kMaxFingerprint, LiteralAnalyzer::shortest(literals_));
+    for (size_t i = 0; i < literals_.size(); i++) {
+        size_t bucket = i % kBuckets;
+        buckets_[bucket].push_back(static_cast<uint32_t>(i));
+        for (size_t j = 0; j < fingerprint_; j++) {
+            unsigned char c = static_cast<unsigned char>(literals_[i][j]);
+            uint8_t bit = static_cast<uint8_t>(1u << bucket);
+            byte_masks_[j][c] |= bit;
+            low_nibbles_[j][c & 0x0F] |= bit;
+            high_nibbles_[j][c >> 4] |= bit;
+        }
+    }
+#ifdef GREP_HAVE_X86_SIMD
+    use_ssse3_ = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+size_t LiteralPrefilter::find(std::string_view text, size_t from) const {
+    if (literals_.size() == 1) {
+        return find_single(text, from);
+    }
+#ifdef GREP_HAVE_X86_SIMD
+    if (use_ssse3_) {
+        return find_multi_ssse3(text, from);
+    }
+#endif
+    return find_multi_scalar(text, from);
+}
+
+size_t LiteralPrefilter::find_single(std::string_view text, size_t from) const {
+    const std::string& literal = literals_[0];
+    const char* data = text.data();
+    size_t length = text.length();
+    if (length < literal.length() || from > length - literal.length()) {
+        return std::string_view::npos;
+    }
+    size_t last_start = length - literal.length();
+
+    size_t start = from;
+    while (start <= last_start) {
+        const void* found = std::memchr(data + start + rare_offset_, rare_byte_, last_start - start + 1);
+        if (found == nullptr) {
+            break;
+        }
+        size_t candidate = static_cast<const char*>(found) - data - rare_offset_;
+        if (std::memcmp(data + candidate, literal.data(), literal.length()) == 0) {
+            return candidate;
+        }
+        start = candidate + 1;
+    }
+    return std::string_view::npos;
+}
+
+bool LiteralPrefilter::verify_buckets(std::string_view text, size_t pos, uint8_t mask) const {
+    while (mask != 0) {
+        size_t bucket = static_cast<size_t>(__builtin_ctz(mask));
+        mask &= static_cast<uint8_t>(mask - 1);
+        for (uint32_t index : buckets_[bucket]) {
+            const std::string& literal = literals_[index];
+            if (pos + literal.length() <= text.length() &&
+                std::memcmp(text.data() + pos, literal.data(), literal.length()) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+size_t LiteralPrefilter::find_multi_scalar(std::string_view text, size_t from) const {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+    size_t length = text.length();
+    for (size_t pos = from; pos + fingerprint_ <= length; pos++) {
+        uint8_t mask = byte_masks_[0][data[pos]];
+        for (size_t j = 1; j < fingerprint_ && mask != 0; j++) {
+            mask &= byte_masks_[j][data[pos + j]];
+        }
+        if (mask != 0 && verify_buckets(text, pos, mask)) {
+            return pos;
+        }
+    }
+    return std::string_view::npos;
+}
+
+#ifdef GREP_HAVE_X86_SIMD
+// Teddy: classify 16 positions at once by looking up each byte's low and high nibble in
+// per-bucket tables; a position survives only if all fingerprint bytes agree on a bucket
+__attribute__((target("ssse3")))
+size_t LiteralPrefilter::find_multi_ssse3(std::string_view text, size_t from) const {
+    const char* data = text.data();
+    size_t length = text.length();
+    const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+
+    __m128i low_tables[kMaxFingerprint];
+    __m128i high_tables[kMaxFingerprint];
+    for (size_t j = 0; j < fingerprint_; j++) {
+        low_tables[j] = _mm_load_si128(reinterpret_cast<const __m128i*>(low_nibbles_[j].data()));
+        high_tables[j] = _mm_load_si128(reinterpret_cast<const __m128i*>(high_nibbles_[j].data()));
+    }
+
+    size_t pos = from;
+    for (; pos + fingerprint_ - 1 + 16 <= length; pos += 16) {
+        __m128i candidates = _mm_set1_epi8(static_cast<char>(0xFF));
+        for (size_t j = 0; j < fingerprint_; j++) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + j));
+            __m128i low = _mm_and_si128(chunk, nibble_mask);
+            __m128i high = _mm_and_si128(_mm_srli_epi16(chunk, 4), nibble_mask);
+            __m128i buckets = _mm_and_si128(_mm_shuffle_epi8(low_tables[j], low),
+                                            _mm_shuffle_epi8(high_tables[j], high));
+            candidates = _mm_and_si128(candidates, buckets);
+        }
+
+        unsigned bits = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(candidates, _mm_setzero_si128()))) & 0xFFFF;
+        if (bits == 0) {
+            continue;
+        }
+        alignas(16) uint8_t masks[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(masks), candidates);
+        while (bits != 0) {
+            unsigned offset = static_cast<unsigned>(__builtin_ctz(bits));
+            bits &= bits - 1;
+            if (verify_buckets(text, pos + offset, masks[offset])) {
+                return pos + offset;
+            }
+        }
+    }
+    return find_multi_scalar(text, pos);
+}
+#endif
@@ -0,0 +1,62 @@
+// prefilter.h
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "char_class.h"
+#include "literal_analysis.h"
+#include "regex_program.h"
+
+// Walks the AST and picks the most selective set of required literals; empty if none exist
+RequiredLiterals extract_required_literals(const RegexAst& ast);
+
+// Finds occurrences of a small set of literals far faster than running the automaton:
+// a single literal is located with memchr on its rarest byte, several literals with a
+// Teddy-style SIMD fingerprint scan.
+class LiteralPrefilter {
+public:
+    static constexpr size_t kMaxLiterals = 32;
+
+    LiteralPrefilter() = default;
+    explicit LiteralPrefilter(const RequiredLiterals& literals);
+
+    bool active() const { return !literals_.empty(); }
+    bool exact() const { return exact_; }
+    const std::vector<std::string>& literals() const { return literals_; }
+
+    // Returns the start offset of the first literal occurrence at or after `from`, or npos
+    size_t find(std::string_view text, size_t from) const;
+
+private:
+    static constexpr size_t kBuckets = 8;
+    static constexpr size_t kMaxFingerprint = 3;
+
+    std::vector<std::string> literals_;
+    bool exact_ = false;
+
+    // Single literal: rarest byte and its offset within the literal
+    unsigned char rare_byte_ = 0;
+    size_t rare_offset_ = 0;
+
+    // Multiple literals: per fingerprint position, bucket masks by byte and by nibble
+    size_t fingerprint_ = 0;
+    std::array<std::vector<uint32_t>, kBuckets> buckets_;
+    std::array<std::array<uint8_t, 256>, kMaxFingerprint> byte_masks_{};
+    alignas(16) std::array<std::array<uint8_t, 16>, kMaxFingerprint> low_nibbles_{};
+    alignas(16) std::array<std::array<uint8_t, 16>, kMaxFingerprint> high_nibbles_{};
+    bool use_ssse3_ = false;  // Always false off x86
+
+    size_t find_single(std::string_view text, size_t from) const;
+    size_t find_multi_scalar(std::string_view text, size_t from) const;
+#ifdef GREP_HAVE_X86_SIMD
+    size_t find_multi_ssse3(std::string_view text, size_t from) const;
+#endif
+    bool verify_buckets(std::string_view text, size_t pos, uint8_t mask) const;
+};
+
+#endif // PREFILTER_H
@@ -0,0 +1,438 @@
+#include "recursive_search.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "decompress.h"
+#include "file_mapping.h"
+#include "ignore_rules.h"
+#include "search_stats.h"
+#include "thread_pool.h"
+
+namespace {
+
+constexpr size_t kDirentBufferSize = 32 * 1024;
+
+// An open directory, kept open by the tasks that still open entries relative to it
+struct Directory {
+    int fd = -1;
+    std::string label;     // Output label prefix: the root as given, then the path below it; ends in '/' unless empty
+    std::string relative;  // Path below the root, which ignore rules match; ends in '/' unless empty
+    std::shared_ptr<const IgnoreRules> ignore;  // Rules for this directory's entries
+
+    ~Directory() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+struct Entry {
+    std::string name;
+    unsigned char type;  // DT_* from getdents64, resolved with fstatat where the filesystem leaves it unknown
+};
+
+// With jobs > 1, what one root, directory or file of the walk printed, held until everything
+// before it in walk order has been written. A directory's children are its entries in the
+// order a single-threaded walk visits them.
+struct OutputNode {
+    bool done = false;  // Output, error and children are final
+    std::string output;
+    std::string error;  // Written to stderr after the output
+    std::vector<std::shared_ptr<OutputNode>> children;
+};
+
+// Position of the writer in the tree of OutputNodes
+struct OutputCursor {
+    OutputNode* node;
+    size_t next = 0;      // Child to write next
+    bool written = false; // The node's own output has been written
+};
+
+unsigned char type_of(mode_t mode) {
+    if (S_ISDIR(mode)) {
+        return DT_DIR;
+    }
+    if (S_ISREG(mode)) {
+        return DT_REG;
+    }
+    return S_ISLNK(mode) ? DT_LNK : DT_UNKNOWN;
+}
+
+bool matches_any(const std::vector<std::string>& globs, std::string_view name) {
+    return std::any_of(globs.begin(), globs.end(), [&](const std::string& glob) { return glob_match(glob, name); });
+}
+
+// Lists a directory with getdents64, skipping "." and ".."; throws std::runtime_error on failure
+std::vector<Entry> list_directory(int fd) {
+    thread_local std::vector<char> buffer(kDirentBufferSize);
+    std::vector<Entry> entries;
+    while (true) {
+        ssize_t count = ::getdents64(fd, buffer.data(), buffer.size());
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::strerror(errno));
+        }
+        if (count == 0) {
+            return entries;
+        }
+        for (ssize_t offset = 0; offset < count;) {
+            const auto* record = reinterpret_cast<const struct dirent64*>(buffer.data() + offset);
+            offset += record->d_reclen;
+            std::string_view name(record->d_name);
+            if (name == "." || name == "..") {
+                continue;
+            }
+            entries.push_back(Entry{std::string(name), record->d_type});
+        }
+    }
+}
+
+// The contents of a small file below `dir_fd`, or nothing if it cannot be read
+std::string read_small_file(int dir_fd, const char* name) {
+    int fd = ::openat(dir_fd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        return std::string();
+    }
+    FdCloser closer{fd};
+    std::string text;
+    char chunk[4096];
+    while (true) {
+        ssize_t count = ::read(fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return text;
+        }
+        text.append(chunk, static_cast<size_t>(count));
+    }
+}
+
+// Every open directory holds a descriptor until the last of its entries has been opened,
+// which a wide tree searched on many threads can run into; go as high as allowed
+void raise_open_file_limit() {
+    struct rlimit limit;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+class TreeSearch {
+public:
+    TreeSearch(const CompiledPattern& pattern, const SearchOptions& options, const WalkOptions& walk,
+               size_t jobs, OutputBuffer& out)
+        : pattern_(pattern), options_(options), walk_(walk), out_(out) {
+        if (jobs > 1) {
+            pool_ = std::make_unique<ThreadPool>(jobs);
+        }
+    }
+
+    bool run(const std::vector<std::string>& roots) {
+        if (pool_ != nullptr) {
+            tree_ = std::make_shared<OutputNode>();
+            cursor_.push_back(OutputCursor{tree_.get()});
+        }
+        if (roots.empty()) {
+            start_directory(".", std::string(), add_child(tree_));
+        }
+        for (const std::string& root : roots) {
+            struct stat info;
+            if (::stat(root.c_str(), &info) != 0) {
+                fail(add_child(tree_), root + ": " + std::strerror(errno));
+            } else if (S_ISDIR(info.st_mode)) {
+                start_directory(root, root.back() == '/' ? root : root + "/", add_child(tree_));
+            } else if (wanted_file(base_name(root))) {
+                dispatch([this, root, node = add_child(tree_)]() { search_entry(AT_FDCWD, root, root, node); });
+            }
+        }
+        complete(tree_);
+
+        // Tasks spawn tasks, so the pool may only stop once none are left anywhere
+        std::unique_lock<std::mutex> lock(pending_mutex_);
+        idle_.wait(lock, [this]() { return pending_ == 0; });
+        lock.unlock();
+        pool_.reset();
+        return any_match_;
+    }
+
+private:
+    const CompiledPattern& pattern_;
+    const SearchOptions& options_;
+    const WalkOptions& walk_;
+    OutputBuffer& out_;
+    std::unique_ptr<ThreadPool> pool_;  // nullptr with one job: every task runs inline
+
+    std::mutex output_mutex_;
+    bool any_match_ = false;  // Guarded by output_mutex_
+    std::shared_ptr<OutputNode> tree_;   // jobs > 1: the roots, in the order given
+    std::vector<OutputCursor> cursor_;   // Path from tree_ to the next node to write; guarded by output_mutex_
+
+    std::mutex pending_mutex_;
+    std::condition_variable idle_;
+    size_t pending_ = 0;  // Dispatched tasks not yet finished; guarded by pending_mutex_
+
+    static std::string_view base_name(std::string_view path) {
+        while (path.length() > 1 && path.back() == '/') {
+            path.remove_suffix(1);
+        }
+        size_t slash = path.rfind('/');
+        return slash == std::string_view::npos ? path : path.substr(slash + 1);
+    }
+
+    bool wanted_file(std::string_view name) const {
+        return (walk_.include.empty() || matches_any(walk_.include, name)) && !matches_any(walk_.exclude, name);
+    }
+
+    void dispatch(std::function<void()> task) {
+        if (pool_ == nullptr) {
+            task();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            pending_++;
+        }
+        pool_->submit([this, task = std::move(task)]() {
+            task();
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            if (--pending_ == 0) {
+                idle_.notify_all();
+            }
+        });
+    }
+
+    // A new last child of `parent`, or nullptr when there is no tree because output is written directly
+    static std::shared_ptr<OutputNode> add_child(const std::shared_ptr<OutputNode>& parent) {
+        if (parent == nullptr) {
+            return nullptr;
+        }
+        parent->children.push_back(std::make_shared<OutputNode>());
+        return parent->children.back();
+    }
+
+    // Writes every finished node that is next in walk order. Call with output_mutex_ held.
+    void drain() {
+        while (!cursor_.empty()) {
+            OutputCursor& top = cursor_.back();
+            if (!top.node->done) {
+                return;
+            }
+            if (!top.written) {
+                out_.write(top.node->output);
+                if (!top.node->error.empty()) {
+                    out_.flush();
+                    std::cerr << top.node->error << std::endl;
+                }
+                top.written = true;
+            }
+            if (top.next < top.node->children.size()) {
+                OutputNode* child = top.node->children[top.next++].get();
+                cursor_.push_back(OutputCursor{child});
+                continue;
+            }
+            cursor_.pop_back();
+            if (!cursor_.empty()) {
+                cursor_.back().node->children[cursor_.back().next - 1].reset();  // Written: free it
+            }
+        }
+    }
+
+    // Marks `node` finished, with nothing more to print of its own
+    void complete(const std::shared_ptr<OutputNode>& node) {
+        if (node != nullptr) {
+            std::lock_guard<std::mutex> lock(output_mutex_);
+            node->done = true;
+            drain();
+        }
+    }
+
+    // Reports an error in walk order; directly when there is no tree
+    void fail(const std::shared_ptr<OutputNode>& node, const std::string& message) {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (node == nullptr) {
+            out_.flush();
+            std::cerr << message << std::endl;
+            return;
+        }
+        node->error = message;
+        node->done = true;
+        drain();
+    }
+
+    void start_directory(const std::string& path, std::string label, std::shared_ptr<OutputNode> node) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            fail(node, path + ": " + std::strerror(errno));
+            return;
+        }
+        auto root = std::make_shared<Directory>();
+        root->fd = fd;
+        root->label = std::move(label);
+        dispatch([this, root, node = std::move(node)]() { walk_directory(root, node); });
+    }
+
+    // Opens the subdirectory `name` of `parent` and walks it
+    void enter_directory(const std::shared_ptr<Directory>& parent, const std::string& name,
+                         const std::shared_ptr<OutputNode>& node) {
+        int fd = ::openat(parent->fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+            fail(node, parent->label + name + ": " + std::strerror(errno));
+            return;
+        }
+        auto dir = std::make_shared<Directory>();
+        dir->fd = fd;
+        dir->label = parent->label + name + "/";
+        dir->relative = parent->relative + name + "/";
+        dir->ignore = parent->ignore;
+        walk_directory(dir, node);
+    }
+
+    // Lists `dir` and hands out its entries. Their output nodes are all in place before any
+    // of them is dispatched, so the writer knows the directory's whole share of the walk order.
+    void walk_directory(const std::shared_ptr<Directory>& dir, const std::shared_ptr<OutputNode>& node) {
+        std::vector<Entry> entries;
+        try {
+            entries = list_directory(dir->fd);
+        } catch (const std::runtime_error& e) {
+            fail(node, dir->label + ": " + e.what());
+            return;
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+
+        // The directory's own .gitignore applies to everything below it, so read it first
+        if (walk_.use_ignore_files) {
+            auto gitignore = std::find_if(entries.begin(), entries.end(), [](const Entry& e) { return e.name == ".gitignore"; });
+            if (gitignore != entries.end()) {
+                dir->ignore = std::make_shared<IgnoreRules>(read_small_file(dir->fd, ".gitignore"), dir->relative, dir->ignore);
+            }
+        }
+
+        std::vector<std::function<void()>> tasks;
+        for (Entry& entry : entries) {
+            if (entry.type == DT_UNKNOWN) {
+                struct stat info;
+                if (::fstatat(dir->fd, entry.name.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0) {
+                    std::string message = dir->label + entry.name + ": " + std::strerror(errno);
+                    tasks.push_back([this, message, child = add_child(node)]() { fail(child, message); });
+                    continue;
+                }
+                entry.type = type_of(info.st_mode);
+            }
+
+            bool is_directory = entry.type == DT_DIR;
+            if (!is_directory && entry.type != DT_REG) {
+                continue;  // Symbolic links, devices, pipes and sockets
+            }
+            if (is_directory ? matches_any(walk_.exclude_dir, entry.name) : !wanted_file(entry.name)) {
+                continue;
+            }
+            if (walk_.use_ignore_files) {
+                if (is_directory && entry.name == ".git") {
+                    continue;
+                }
+                if (dir->ignore != nullptr && dir->ignore->ignored(dir->relative + entry.name, is_directory)) {
+                    continue;
+                }
+            }
+
+            if (is_directory) {
+                tasks.push_back([this, dir, name = std::move(entry.name), child = add_child(node)]() {
+                    enter_directory(dir, name, child);
+                });
+            } else {
+                tasks.push_back([this, dir, name = std::move(entry.name), child = add_child(node)]() {
+                    search_entry(dir->fd, name, dir->label + name, child);
+                });
+            }
+        }
+        complete(node);
+        for (std::function<void()>& task : tasks) {
+            dispatch(std::move(task));
+        }
+    }
+
+    // Searches the file `name` below `dir_fd`. Alone, it writes straight to the output; on the
+    // pool, into its node's buffer, which is written once its turn in walk order comes.
+    void search_entry(int dir_fd, const std::string& name, const std::string& label,
+                      const std::shared_ptr<OutputNode>& node) {
+        int fd = ::openat(dir_fd, name.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+        if (fd < 0) {
+            fail(node, label + ": " + std::strerror(errno));
+            return;
+        }
+        FdCloser closer{fd};
+        if (looks_binary(fd, options_.decompress)) {
+            if (search_stats_enabled()) {
+                thread_stats().binary_files++;
+            }
+            complete(node);
+            return;
+        }
+
+        OutputBuffer buffer;
+        OutputBuffer& target = node != nullptr ? buffer : out_;
+        size_t matches = 0;
+        std::string error;
+        try {
+            matches = search_open_file(pattern_, fd, label, options_, target);
+        } catch (const std::runtime_error& e) {
+            error = label + ": " + e.what();
+        }
+
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        any_match_ |= matches > 0;
+        if (node != nullptr) {
+            node->output = buffer.take();
+            node->error = std::move(error);
+            node->done = true;
+            drain();
+        } else if (!error.empty()) {
+            out_.flush();
+            std::cerr << error << std::endl;
+        }
+    }
+};
+
+} // namespace
+
+// With decompress, a compressed file is always searched, since its raw bytes say nothing
+// about what it holds
+bool looks_binary(int fd, bool decompress) {
+    thread_local std::vector<char> head(kBinaryCheckBytes);
+    ssize_t count;
+    do {
+        count = ::pread(fd, head.data(), head.size(), 0);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) {
+        return false;  // Unreadable files are left to the search to report
+    }
+    std::string_view block(head.data(), static_cast<size_t>(count));
+    if (decompress && detect_compression(block) != Compression::None) {
+        return false;
+    }
+    return block.find('\0') != std::string_view::npos;
+}
+
+bool recursive_search(const CompiledPattern& pattern, const std::vector<std::string>& roots,
+                      const SearchOptions& options, const WalkOptions& walk, size_t jobs, OutputBuffer& out) {
+    if (jobs > 1) {
+        raise_open_file_limit();
+    }
+    TreeSearch search(pattern, options, walk, jobs, out);
+    return search.run(roots);
+}
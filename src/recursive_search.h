@@ -0,0 +1,40 @@
+// recursive_search.h
+#ifndef RECURSIVE_SEARCH_H
+#define RECURSIVE_SEARCH_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "grep_funcs.h"
+#include "line_reader.h"
+#include "search.h"
+
+// A file with a NUL byte in this many leading bytes is taken to be binary and skipped
+constexpr size_t kBinaryCheckBytes = 32 * 1024;
+
+// True if `fd` has a NUL byte within its first kBinaryCheckBytes; with decompress, compressed
+// files never count as binary. Reads with pread, so the file offset is left alone.
+bool looks_binary(int fd, bool decompress);
+
+// Which entries of the tree -r searches. Globs are matched against the entry's own name
+// with glob_match.
+struct WalkOptions {
+    std::vector<std::string> include;      // --include: if any are given, only files matching one
+    std::vector<std::string> exclude;      // --exclude: skip files matching any
+    std::vector<std::string> exclude_dir;  // --exclude-dir: do not descend into directories matching any
+    bool use_ignore_files = true;          // Cleared by --no-ignore: honour .gitignore files and skip .git
+};
+
+// -r: searches every regular file below the directories in `roots`, and the other roots as
+// files; no roots means the current directory, with labels relative to it. Directories are
+// opened relative to their parent with openat and listed with getdents64; symbolic links and
+// special files inside the tree are skipped, as are files that look binary. With jobs > 1,
+// listing a directory and searching a file are both tasks on one work-stealing pool, so files
+// are searched as soon as they are found while the rest of the tree is still being walked.
+// Output always comes in walk order, depth first and by name, as with one job: each file's
+// results are held until every file before it has been written. Errors are reported on
+// stderr in the same order and the walk goes on. Returns true if any line matched.
+bool recursive_search(const CompiledPattern& pattern, const std::vector<std::string>& roots,
+                      const SearchOptions& options, const WalkOptions& walk, size_t jobs, OutputBuffer& out);
+
+#endif // RECURSIVE_SEARCH_H
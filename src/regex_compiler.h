@@ -0,0 +1,570 @@
+// regex_compiler.h
+#ifndef REGEX_COMPILER_H
+#define REGEX_COMPILER_H
+
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "char_class.h"
+#include "regex_program.h"
+#include "unicode_tables.h"
+#include "utf8.h"
+
+// The parser and compiler behind parse_regex() and compile_regex(). They are constexpr so that
+// static_regex.h can run the very same code at compile time; a malformed pattern there fails
+// to compile instead of throwing.
+
+// Recursive descent parser for the supported ERE subset:
+//   alternation := concat ('|' concat)*
+//   concat      := repeat*
+//   repeat      := atom ('*' | '+' | '?')*
+//   atom        := literal | '.' | '^' | '$' | '\' escape | '[' group ']' | '(' alternation ')'
+// Groups capture and are numbered by their '('; \1 to \9 refer back to a group closed earlier.
+// In UTF-8 mode a multi-byte character is a single atom, and '.', the class escapes and [...]
+// groups match whole code points: their code point sets are expanded into alternations of
+// byte-range sequences, so the automata still step one byte at a time and never decode.
+class RegexParser {
+public:
+    constexpr explicit RegexParser(std::string_view pattern, bool utf8 = false) : pattern_(pattern), utf8_(utf8) {}
+
+    constexpr RegexAst parse() {
+        ast_.root = parse_alternation();
+        if (pos_ < pattern_.length()) {
+            // Only an unbalanced ')' can stop the top-level alternation early
+            throw std::runtime_error("Unmatched ) in pattern");
+        }
+        return std::move(ast_);
+    }
+
+private:
+    std::string_view pattern_;
+    bool utf8_;
+    size_t pos_ = 0;
+    RegexAst ast_;
+    std::vector<bool> closed_;  // closed_[g]: group g's ')' has been seen
+
+    constexpr int add_node(RegexNodeType type) {
+        RegexNode node;
+        node.type = type;
+        ast_.nodes.push_back(std::move(node));
+        return static_cast<int>(ast_.nodes.size() - 1);
+    }
+
+    constexpr int add_byte(unsigned char c) {
+        int node = add_node(RegexNodeType::Byte);
+        ast_.nodes[node].byte = c;
+        return node;
+    }
+
+    constexpr int add_class(const ByteSet& set) {
+        int node = add_node(RegexNodeType::Class);
+        ast_.classes.push_back(set);
+        ast_.nodes[node].class_index = static_cast<int>(ast_.classes.size() - 1);
+        return node;
+    }
+
+    // A Byte node for a single byte, else a Class node
+    constexpr int add_byte_set(const ByteSet& set) {
+        if (set.count() == 1) {
+            for (unsigned c = 0; c < 256; c++) {
+                if (set.test(static_cast<unsigned char>(c))) {
+                    return add_byte(static_cast<unsigned char>(c));
+                }
+            }
+        }
+        return add_class(set);
+    }
+
+    // UTF-8 mode: a node matching the encoding of any code point in `ranges`
+    constexpr int add_codepoints(std::vector<CodepointRange> ranges) {
+        normalize_ranges(ranges);
+        std::vector<Utf8Sequence> sequences = utf8_sequences(ranges);
+        if (sequences.empty()) {
+            return add_class(ByteSet());  // Matches nothing
+        }
+        return add_sequence_trie(sequences, 0, sequences.size(), 0);
+    }
+
+    // Alternation over the rest of sequences[begin, end) from byte `depth` on, which all share
+    // their earlier byte ranges. Consecutive sequences with the same range at `depth` share one
+    // branch, and the sequences that end at `depth` merge into one class.
+    constexpr int add_sequence_trie(const std::vector<Utf8Sequence>& sequences, size_t begin, size_t end, size_t depth) {
+        std::vector<int> options;
+        ByteSet last_bytes;
+        for (size_t i = begin; i < end;) {
+            unsigned char lo = sequences[i].lo[depth];
+            unsigned char hi = sequences[i].hi[depth];
+            size_t next = i + 1;
+            while (next < end && sequences[next].lo[depth] == lo && sequences[next].hi[depth] == hi) {
+                next++;
+            }
+            // No sequence is longer than kMaxUtf8Length; saying so keeps the recursion visibly bounded
+            if (sequences[i].length == depth + 1 || depth + 1 == kMaxUtf8Length) {
+                last_bytes.set_range(lo, hi);
+            } else {
+                ByteSet range;
+                range.set_range(lo, hi);
+                int first = add_byte_set(range);
+                int rest = add_sequence_trie(sequences, i, next, depth + 1);
+                int node = add_node(RegexNodeType::Concat);
+                ast_.nodes[node].children = {first, rest};
+                options.push_back(node);
+            }
+            i = next;
+        }
+        if (last_bytes.count() > 0) {
+            options.insert(options.begin(), add_byte_set(last_bytes));
+        }
+        if (options.size() == 1) {
+            return options[0];
+        }
+        int node = add_node(RegexNodeType::Alternation);
+        ast_.nodes[node].children = std::move(options);
+        return node;
+    }
+
+    // UTF-8 mode: the character starting at `start` as one atom, so that a following * repeats
+    // all of its bytes. A byte that does not start a valid encoding stands for itself.
+    constexpr int parse_multibyte(size_t start) {
+        size_t end = start;
+        uint32_t codepoint = 0;
+        if (!decode_utf8(pattern_, end, codepoint)) {
+            pos_ = start + 1;
+            return add_byte(static_cast<unsigned char>(pattern_[start]));
+        }
+        pos_ = end;
+        std::vector<int> bytes;
+        for (size_t i = start; i < end; i++) {
+            bytes.push_back(add_byte(static_cast<unsigned char>(pattern_[i])));
+        }
+        int node = add_node(RegexNodeType::Concat);
+        ast_.nodes[node].children = std::move(bytes);
+        return node;
+    }
+
+    constexpr bool at_end() const { return pos_ >= pattern_.length(); }
+
+    constexpr int parse_alternation() {
+        std::vector<int> options;
+        options.push_back(parse_concat());
+        while (!at_end() && pattern_[pos_] == '|') {
+            pos_++;
+            options.push_back(parse_concat());
+        }
+        if (options.size() == 1) {
+            return options[0];
+        }
+        int node = add_node(RegexNodeType::Alternation);
+        ast_.nodes[node].children = std::move(options);
+        return node;
+    }
+
+    constexpr int parse_concat() {
+        std::vector<int> items;
+        while (!at_end() && pattern_[pos_] != '|' && pattern_[pos_] != ')') {
+            items.push_back(parse_repeat(items.empty()));
+        }
+        if (items.empty()) {
+            return add_node(RegexNodeType::Empty);
+        }
+        if (items.size() == 1) {
+            return items[0];
+        }
+        int node = add_node(RegexNodeType::Concat);
+        ast_.nodes[node].children = std::move(items);
+        return node;
+    }
+
+    constexpr int parse_repeat(bool first_in_concat) {
+        int atom;
+        char c = pattern_[pos_];
+        if (first_in_concat && (c == '*' || c == '+' || c == '?')) {
+            // Nothing to repeat; treat the operator as a literal like grep -E does
+            pos_++;
+            atom = add_byte(static_cast<unsigned char>(c));
+        } else {
+            atom = parse_atom();
+        }
+
+        while (!at_end()) {
+            RegexNodeType type;
+            switch (pattern_[pos_]) {
+                case '*': type = RegexNodeType::Star; break;
+                case '+': type = RegexNodeType::Plus; break;
+                case '?': type = RegexNodeType::Question; break;
+                default: return atom;
+            }
+            pos_++;
+            int node = add_node(type);
+            ast_.nodes[node].children.push_back(atom);
+            atom = node;
+        }
+        return atom;
+    }
+
+    constexpr int parse_atom() {
+        char c = pattern_[pos_++];
+        switch (c) {
+            case '.': return utf8_ ? add_codepoints({CodepointRange{0, kMaxCodepoint}}) : add_node(RegexNodeType::Any);
+            case '^': return add_node(RegexNodeType::LineStart);
+            case '$': return add_node(RegexNodeType::LineEnd);
+            case '[': return parse_char_group();
+            case '\\': return parse_escape();
+            case '(': {
+                int group = ++ast_.group_count;
+                closed_.resize(group + 1, false);
+                int inner = parse_alternation();
+                if (at_end() || pattern_[pos_] != ')') {
+                    throw std::runtime_error("Unmatched ( in pattern");
+                }
+                pos_++;
+                closed_[group] = true;
+                int node = add_node(RegexNodeType::Group);
+                ast_.nodes[node].children.push_back(inner);
+                ast_.nodes[node].group = group;
+                return node;
+            }
+            default:
+                if (utf8_ && static_cast<unsigned char>(c) >= 0x80) {
+                    return parse_multibyte(pos_ - 1);
+                }
+                return add_byte(static_cast<unsigned char>(c));
+        }
+    }
+
+    // Handles the character after a backslash outside of a group
+    constexpr int parse_escape() {
+        if (at_end()) {
+            throw std::runtime_error("Incomplete escape sequence");
+        }
+        char esc_char = pattern_[pos_++];
+        if (utf8_) {
+            std::vector<CodepointRange> ranges;
+            if (escape_codepoints(esc_char, ranges)) {
+                return add_codepoints(std::move(ranges));
+            }
+            if (static_cast<unsigned char>(esc_char) >= 0x80) {
+                return parse_multibyte(pos_ - 1);
+            }
+        }
+        ByteSet set;
+        if (escape_class(esc_char, set)) {
+            return add_class(set);
+        }
+        if (esc_char >= '1' && esc_char <= '9') {
+            // A group still open (or never opened) has nothing to repeat yet
+            int group = esc_char - '0';
+            if (group >= static_cast<int>(closed_.size()) || !closed_[group]) {
+                throw std::runtime_error("Invalid back reference");
+            }
+            int node = add_node(RegexNodeType::Backref);
+            ast_.nodes[node].group = group;
+            ast_.has_backrefs = true;
+            return node;
+        }
+        if (alnum_set().test(static_cast<unsigned char>(esc_char))) {
+            throw std::runtime_error("Unhandled escape sequence: \\" + std::string(1, esc_char));
+        }
+        return add_byte(static_cast<unsigned char>(esc_char));
+    }
+
+    // Fills `set` for class escapes such as \d; returns false for any other character
+    static constexpr bool escape_class(char esc_char, ByteSet& set) {
+        switch (esc_char) {
+            case 'd': set = digit_set(); return true;
+            case 'D': set = digit_set(); set.invert(); return true;
+            case 'w': set = word_set(); return true;
+            case 'W': set = word_set(); set.invert(); return true;
+            case 's': set = space_set(); return true;
+            case 'S': set = space_set(); set.invert(); return true;
+            default: return false;
+        }
+    }
+
+    // UTF-8 mode counterpart of escape_class: appends the code points of \d, \w or \s, or of
+    // their negations, to `ranges`
+    static constexpr bool escape_codepoints(char esc_char, std::vector<CodepointRange>& ranges) {
+        std::span<const CodepointRange> table;
+        switch (esc_char) {
+            case 'd': case 'D': table = kUnicodeDigit; break;
+            case 'w': case 'W': table = kUnicodeWord; break;
+            case 's': case 'S': table = kUnicodeSpace; break;
+            default: return false;
+        }
+        std::vector<CodepointRange> set(table.begin(), table.end());
+        if (esc_char >= 'A' && esc_char <= 'Z') {
+            set = complement_ranges(set);
+        }
+        ranges.insert(ranges.end(), set.begin(), set.end());
+        return true;
+    }
+
+    // One code point of a UTF-8 mode group
+    constexpr uint32_t next_codepoint() {
+        uint32_t codepoint = 0;
+        if (!decode_utf8(pattern_, pos_, codepoint)) {
+            throw std::runtime_error("Invalid UTF-8 in character group");
+        }
+        return codepoint;
+    }
+
+    // parse_char_group for UTF-8 mode, where members and range ends are code points
+    constexpr int parse_codepoint_group() {
+        std::vector<CodepointRange> ranges;
+        bool negated = false;
+        if (!at_end() && pattern_[pos_] == '^') {
+            negated = true;
+            pos_++;
+        }
+
+        bool first = true;
+        while (true) {
+            if (at_end()) {
+                throw std::runtime_error("Unmatched [ in pattern");
+            }
+            if (pattern_[pos_] == ']' && !first) {
+                pos_++;
+                break;
+            }
+            first = false;
+
+            if (pattern_[pos_] == '\\' && pos_ + 1 < pattern_.length()) {
+                if (escape_codepoints(pattern_[pos_ + 1], ranges)) {
+                    pos_ += 2;
+                    continue;
+                }
+                pos_++;
+            }
+            uint32_t lo = next_codepoint();
+
+            // Range such as a-z; a trailing '-' is a literal
+            if (pos_ + 1 < pattern_.length() && pattern_[pos_] == '-' && pattern_[pos_ + 1] != ']') {
+                pos_++;
+                uint32_t hi = next_codepoint();
+                if (hi < lo) {
+                    throw std::runtime_error("Invalid range end in character group");
+                }
+                ranges.push_back(CodepointRange{lo, hi});
+            } else {
+                ranges.push_back(CodepointRange{lo, lo});
+            }
+        }
+
+        normalize_ranges(ranges);
+        if (negated) {
+            ranges = complement_ranges(ranges);
+        }
+        return add_codepoints(std::move(ranges));
+    }
+
+    // Parses a positive or negative character group; pos_ is just past the '['
+    constexpr int parse_char_group() {
+        if (utf8_) {
+            return parse_codepoint_group();
+        }
+        ByteSet set;
+        bool negated = false;
+        if (!at_end() && pattern_[pos_] == '^') {
+            negated = true;
+            pos_++;
+        }
+
+        bool first = true;
+        while (true) {
+            if (at_end()) {
+                throw std::runtime_error("Unmatched [ in pattern");
+            }
+            unsigned char c = static_cast<unsigned char>(pattern_[pos_]);
+            if (c == ']' && !first) {
+                pos_++;
+                break;
+            }
+            first = false;
+            pos_++;
+
+            if (c == '\\' && !at_end()) {
+                ByteSet escaped;
+                if (escape_class(pattern_[pos_], escaped)) {
+                    set.merge(escaped);
+                    pos_++;
+                    continue;
+                }
+                c = static_cast<unsigned char>(pattern_[pos_++]);
+            }
+
+            // Range such as a-z; a trailing '-' is a literal
+            if (pos_ + 1 < pattern_.length() && pattern_[pos_] == '-' && pattern_[pos_ + 1] != ']') {
+                unsigned char hi = static_cast<unsigned char>(pattern_[pos_ + 1]);
+                if (hi < c) {
+                    throw std::runtime_error("Invalid range end in character group");
+                }
+                set.set_range(c, hi);
+                pos_ += 2;
+            } else {
+                set.set(c);
+            }
+        }
+
+        if (negated) {
+            set.invert();
+        }
+        return add_class(set);
+    }
+};
+
+// Emits program instructions for AST nodes. Without captures a back-reference is emitted as
+// another copy of its group; with them, groups are bracketed by Save and back-references
+// become Backref.
+class RegexCompiler {
+public:
+    constexpr explicit RegexCompiler(const RegexAst& ast, bool captures = false) : ast_(ast), captures_(captures) {
+        group_nodes_.resize(ast_.group_count + 1, -1);
+        for (size_t i = 0; i < ast_.nodes.size(); i++) {
+            if (ast_.nodes[i].type == RegexNodeType::Group) {
+                group_nodes_[ast_.nodes[i].group] = static_cast<int>(i);
+            }
+        }
+    }
+
+    constexpr Program compile() {
+        program_.classes = ast_.classes;
+        emit_node(ast_.root);
+        emit(OpCode::Match);
+        return std::move(program_);
+    }
+
+    // Alternates between the roots like emit_alternation, but every option gets its own Match
+    constexpr Program compile_set(const std::vector<int>& roots, const std::vector<uint32_t>& ids) {
+        program_.classes = ast_.classes;
+        for (size_t i = 0; i < roots.size(); i++) {
+            bool last = i + 1 == roots.size();
+            uint32_t split = 0;
+            if (!last) {
+                split = emit(OpCode::Split);
+                program_.insts[split].x = next_pc();
+            }
+            emit_node(roots[i]);
+            emit(OpCode::Match, ids[i]);
+            if (!last) {
+                program_.insts[split].y = next_pc();
+            }
+        }
+        return std::move(program_);
+    }
+
+private:
+    const RegexAst& ast_;
+    bool captures_;
+    std::vector<int> group_nodes_;  // Group node of each capture number
+    Program program_;
+
+    constexpr uint32_t next_pc() const { return static_cast<uint32_t>(program_.insts.size()); }
+
+    constexpr uint32_t emit(OpCode op, uint32_t x = 0, uint32_t y = 0) {
+        Inst inst;
+        inst.op = op;
+        inst.x = x;
+        inst.y = y;
+        program_.insts.push_back(inst);
+        return next_pc() - 1;
+    }
+
+    constexpr void emit_node(int index) {
+        const RegexNode& node = ast_.nodes[index];
+        switch (node.type) {
+            case RegexNodeType::Empty:
+                break;
+            case RegexNodeType::Byte:
+                program_.insts[emit(OpCode::Byte)].byte = node.byte;
+                break;
+            case RegexNodeType::Class:
+                emit(OpCode::Class, static_cast<uint32_t>(node.class_index));
+                break;
+            case RegexNodeType::Any:
+                emit(OpCode::Any);
+                break;
+            case RegexNodeType::LineStart:
+                emit(OpCode::LineStart);
+                break;
+            case RegexNodeType::LineEnd:
+                emit(OpCode::LineEnd);
+                break;
+            case RegexNodeType::Concat:
+                for (int child : node.children) {
+                    emit_node(child);
+                }
+                break;
+            case RegexNodeType::Group:
+                if (captures_) {
+                    emit(OpCode::Save, static_cast<uint32_t>(node.group) * 2);
+                }
+                emit_node(node.children[0]);
+                if (captures_) {
+                    emit(OpCode::Save, static_cast<uint32_t>(node.group) * 2 + 1);
+                }
+                break;
+            case RegexNodeType::Backref:
+                if (captures_) {
+                    emit(OpCode::Backref, static_cast<uint32_t>(node.group));
+                } else {
+                    // Anything the group could have matched; refers only to groups closed earlier, so this ends
+                    emit_node(ast_.nodes[group_nodes_[node.group]].children[0]);
+                }
+                break;
+            case RegexNodeType::Alternation:
+                emit_alternation(node);
+                break;
+            case RegexNodeType::Question: {
+                uint32_t split = emit(OpCode::Split);
+                program_.insts[split].x = next_pc();
+                emit_node(node.children[0]);
+                program_.insts[split].y = next_pc();
+                break;
+            }
+            case RegexNodeType::Star:
+                emit_star(node.children[0]);
+                break;
+            case RegexNodeType::Plus: {
+                uint32_t loop = next_pc();
+                emit_node(node.children[0]);
+                emit(OpCode::Split, loop, next_pc() + 1);
+                break;
+            }
+        }
+    }
+
+    // Each option but the last is guarded by a Split that falls through to the next option
+    constexpr void emit_alternation(const RegexNode& node) {
+        std::vector<uint32_t> exits;
+        for (size_t i = 0; i < node.children.size(); i++) {
+            bool last = i + 1 == node.children.size();
+            uint32_t split = 0;
+            if (!last) {
+                split = emit(OpCode::Split);
+                program_.insts[split].x = next_pc();
+            }
+            emit_node(node.children[i]);
+            if (!last) {
+                exits.push_back(emit(OpCode::Jmp));
+                program_.insts[split].y = next_pc();
+            }
+        }
+        for (uint32_t exit : exits) {
+            program_.insts[exit].x = next_pc();
+        }
+    }
+
+    // Empty-able loop bodies need no special casing: NFA simulation never revisits a state within one step
+    constexpr void emit_star(int body) {
+        uint32_t split = emit(OpCode::Split);
+        program_.insts[split].x = next_pc();
+        emit_node(body);
+        emit(OpCode::Jmp, split);
+        program_.insts[split].y = next_pc();
+    }
+};
+
+#endif // REGEX_COMPILER_H
@@ -0,0 +1,139 @@
+#include "regex_program.h"
+#include <stdexcept>
+#include "regex_compiler.h"
+
+RegexAst parse_regex(std::string_view pattern, bool utf8) {
+    return RegexParser(pattern, utf8).parse();
+}
+
+bool node_is_nullable(const RegexAst& ast, int node) {
+    const RegexNode& n = ast.nodes[node];
+    switch (n.type) {
+        case RegexNodeType::Empty:
+        case RegexNodeType::LineStart:
+        case RegexNodeType::LineEnd:
+        case RegexNodeType::Star:
+        case RegexNodeType::Question:
+            return true;
+        case RegexNodeType::Byte:
+        case RegexNodeType::Class:
+        case RegexNodeType::Any:
+            return false;
+        case RegexNodeType::Backref:
+            return true;  // The group may have captured nothing
+        case RegexNodeType::Concat:
+            for (int child : n.children) {
+                if (!node_is_nullable(ast, child)) {
+                    return false;
+                }
+            }
+            return true;
+        case RegexNodeType::Alternation:
+            for (int child : n.children) {
+                if (node_is_nullable(ast, child)) {
+                    return true;
+                }
+            }
+            return false;
+        case RegexNodeType::Group:
+        case RegexNodeType::Plus:
+            return node_is_nullable(ast, n.children[0]);
+    }
+    return false;
+}
+
+Program compile_regex(const RegexAst& ast) {
+    return RegexCompiler(ast).compile();
+}
+
+RegexSet merge_regex_asts(const std::vector<RegexAst>& asts, const std::vector<uint32_t>& ids) {
+    RegexSet set;
+    set.ids = ids;
+    for (const RegexAst& ast : asts) {
+        int node_offset = static_cast<int>(set.ast.nodes.size());
+        int class_offset = static_cast<int>(set.ast.classes.size());
+        int group_offset = set.ast.group_count;
+        for (RegexNode node : ast.nodes) {
+            for (int& child : node.children) {
+                child += node_offset;
+            }
+            if (node.class_index >= 0) {
+                node.class_index += class_offset;
+            }
+            if (node.group > 0) {
+                node.group += group_offset;  // Each pattern's \1 still means its own first group
+            }
+            set.ast.nodes.push_back(std::move(node));
+        }
+        set.ast.classes.insert(set.ast.classes.end(), ast.classes.begin(), ast.classes.end());
+        set.ast.group_count += ast.group_count;
+        set.ast.has_backrefs |= ast.has_backrefs;
+        set.roots.push_back(ast.root + node_offset);
+    }
+
+    if (set.roots.size() == 1) {
+        set.ast.root = set.roots[0];
+    } else {
+        RegexNode alternation;
+        alternation.type = RegexNodeType::Alternation;
+        alternation.children = set.roots;
+        set.ast.nodes.push_back(std::move(alternation));
+        set.ast.root = static_cast<int>(set.ast.nodes.size() - 1);
+    }
+    return set;
+}
+
+Program compile_regex_set(const RegexSet& set, bool captures) {
+    return RegexCompiler(set.ast, captures).compile_set(set.roots, set.ids);
+}
+
+ProgramView copy_program(const Program& program, Arena& arena) {
+    return ProgramView(arena.copy(program.insts), arena.copy(program.classes));
+}
+
+void write_program(BinaryWriter& out, ProgramView program) {
+    out.put<uint64_t>(program.insts.size());
+    for (const Inst& inst : program.insts) {
+        out.put(static_cast<uint8_t>(inst.op));
+        out.put(inst.byte);
+        out.put(inst.x);
+        out.put(inst.y);
+    }
+    out.put_span(program.classes);
+}
+
+ProgramView read_program(BinaryReader& in, Arena& arena) {
+    constexpr size_t kInstBytes = sizeof(uint8_t) + sizeof(unsigned char) + 2 * sizeof(uint32_t);
+    uint64_t count = in.get<uint64_t>();
+    if (count > in.remaining() / kInstBytes) {
+        throw std::runtime_error("Truncated binary data");
+    }
+    std::span<Inst> insts = arena.allocate_array<Inst>(count);
+    for (Inst& inst : insts) {
+        uint8_t op = in.get<uint8_t>();
+        if (op > static_cast<uint8_t>(OpCode::Backref)) {
+            throw std::runtime_error("Invalid instruction in compiled program");
+        }
+        inst.op = static_cast<OpCode>(op);
+        inst.byte = in.get<unsigned char>();
+        inst.x = in.get<uint32_t>();
+        inst.y = in.get<uint32_t>();
+    }
+    ProgramView program(insts, in.get_span<ByteSet>(arena));
+
+    // The engines follow these indices without checking them
+    for (const Inst& inst : program.insts) {
+        bool bad_target = (inst.op == OpCode::Split && (inst.x >= count || inst.y >= count)) ||
+                          (inst.op == OpCode::Jmp && inst.x >= count) ||
+                          (inst.op == OpCode::Class && inst.x >= program.classes.size());
+        if (bad_target) {
+            throw std::runtime_error("Invalid instruction in compiled program");
+        }
+    }
+    // Consuming and assertion instructions fall through to the next one
+    if (program.insts.empty() || (program.insts.back().op != OpCode::Match &&
+                                  program.insts.back().op != OpCode::Jmp && program.insts.back().op != OpCode::Split)) {
+        throw std::runtime_error("Invalid instruction in compiled program");
+    }
+    return program;
+}
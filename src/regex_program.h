@@ -0,0 +1,124 @@
+// regex_program.h
+#ifndef REGEX_PROGRAM_H
+#define REGEX_PROGRAM_H
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "arena.h"
+#include "binary_io.h"
+#include "char_class.h"
+
+// Node kinds produced by the parser
+enum class RegexNodeType {
+    Empty,        // Matches the empty string
+    Byte,         // Literal byte
+    Class,        // \d, \w or a [...] group
+    Any,          // .
+    LineStart,    // ^
+    LineEnd,      // $
+    Concat,
+    Alternation,
+    Group,        // ( ... )
+    Star,         // *
+    Plus,         // +
+    Question,     // ?
+    Backref       // \1 to \9: the text the group captured, again
+};
+
+struct RegexNode {
+    RegexNodeType type = RegexNodeType::Empty;
+    unsigned char byte = 0;     // Byte value for RegexNodeType::Byte
+    int class_index = -1;       // Index into RegexAst::classes for RegexNodeType::Class
+    int group = 0;              // Capture number (from 1) of a Group, or the one a Backref repeats
+    std::vector<int> children;  // Indices into RegexAst::nodes
+};
+
+// Parsed pattern: a flat node table rooted at `root`
+struct RegexAst {
+    std::vector<RegexNode> nodes;
+    std::vector<ByteSet> classes;
+    int root = -1;
+    int group_count = 0;        // Groups are numbered by their '(' from 1 to group_count
+    bool has_backrefs = false;
+};
+
+// Instructions of the compiled program
+enum class OpCode : uint8_t {
+    Byte,       // Consume one byte equal to `byte`
+    Class,      // Consume one byte contained in classes[x]
+    Any,        // Consume any byte
+    LineStart,  // Assert position is 0
+    LineEnd,    // Assert position is the end of the line
+    Split,      // Fork to x (preferred) and y
+    Jmp,        // Continue at x
+    Match,      // Pattern number x of the program matched
+    Save,       // Record the position in capture slot x (2 * group, +1 for the end)
+    Backref     // Consume a copy of the text group x captured; fails if the group is unset
+};
+
+struct Inst {
+    OpCode op;
+    unsigned char byte = 0;
+    uint32_t x = 0;
+    uint32_t y = 0;
+};
+
+// Compiled pattern program, built once and executed for every line.
+// Split and Jmp are the epsilon edges of a Thompson NFA. Save and Backref only appear in
+// programs compiled with captures, which only the Backtracker runs.
+struct Program {
+    std::vector<Inst> insts;
+    std::vector<ByteSet> classes;
+};
+
+// A finished program whose tables are owned elsewhere: by a Program, or by the arena of a
+// CompiledPattern. The engines run views, so they work the same on either.
+struct ProgramView {
+    std::span<const Inst> insts;
+    std::span<const ByteSet> classes;
+
+    ProgramView() = default;
+    ProgramView(const Program& program) : insts(program.insts), classes(program.classes) {}
+    ProgramView(std::span<const Inst> program_insts, std::span<const ByteSet> program_classes)
+        : insts(program_insts), classes(program_classes) {}
+};
+
+// Parses an extended regular expression, throwing std::runtime_error on malformed input.
+// With `utf8`, '.', classes and groups match whole UTF-8 encoded code points.
+RegexAst parse_regex(std::string_view pattern, bool utf8 = false);
+
+// Returns true if the node can match the empty string
+bool node_is_nullable(const RegexAst& ast, int node);
+
+// Compiles a parsed pattern into a program. A back-reference becomes a second copy of its
+// group, so for patterns with back-references the program accepts a superset of the lines
+// that really match; automata run it to rule lines out before the Backtracker decides.
+Program compile_regex(const RegexAst& ast);
+
+// Several patterns merged into one AST so they run as a single automaton
+struct RegexSet {
+    RegexAst ast;               // ast.root alternates between all the patterns
+    std::vector<int> roots;     // Root node of each pattern
+    std::vector<uint32_t> ids;  // Number reported by each pattern's Match instruction
+};
+
+// Copies the node tables of `asts` into one AST; asts[i] is reported as ids[i]. `asts` must not be empty.
+RegexSet merge_regex_asts(const std::vector<RegexAst>& asts, const std::vector<uint32_t>& ids);
+
+// Compiles a merged set; each pattern ends in its own Match so a simulation can tell them apart.
+// With `captures`, groups record their bounds with Save and back-references compile to Backref.
+Program compile_regex_set(const RegexSet& set, bool captures = false);
+
+// Copies the tables of a program into `arena`
+ProgramView copy_program(const Program& program, Arena& arena);
+
+// Serializes a program for the pattern cache
+void write_program(BinaryWriter& out, ProgramView program);
+
+// Reads a program written by write_program into `arena`, throwing std::runtime_error if the
+// data is truncated or refers outside the program
+ProgramView read_program(BinaryReader& in, Arena& arena);
+
+#endif // REGEX_PROGRAM_H
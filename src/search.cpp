@@ -0,0 +1,260 @@
+#include "search.h"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "decompress.h"
+#include "file_mapping.h"
+#include "search_stats.h"
+
+namespace {
+
+// Regular files up to this size are read into memory rather than mapped
+constexpr size_t kSmallFileSize = 128 * 1024;
+
+void write_number(uint64_t number, OutputBuffer& out) {
+    char digits[24];
+    char* end = std::to_chars(digits, digits + sizeof(digits), number).ptr;
+    out.write(std::string_view(digits, end - digits));
+}
+
+// Everything before the text of an output line: "<label>:<line>:<offset>:<ids>:"
+void write_prefix(const CompiledPattern& pattern, std::string_view line, std::string_view label,
+                  uint64_t line_number, uint64_t offset, const SearchOptions& options, OutputBuffer& out) {
+    if (options.with_filename) {
+        out.write(label);
+        out.write(":");
+    }
+    if (options.line_number) {
+        write_number(line_number, out);
+        out.write(":");
+    }
+    if (options.byte_offset) {
+        write_number(offset, out);
+        out.write(":");
+    }
+    if (options.pattern_ids) {
+        thread_local std::vector<uint32_t> ids;
+        ids.clear();
+        pattern.matching_patterns(line, ids);
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (i > 0) {
+                out.write(",");
+            }
+            write_number(ids[i] + 1, out);
+        }
+        out.write(":");
+    }
+}
+
+// `line_offset` is the offset of the line within its input
+void write_match(const CompiledPattern& pattern, std::string_view line, std::string_view label,
+                 uint64_t line_number, uint64_t line_offset, const SearchOptions& options, OutputBuffer& out) {
+    if (!options.only_matching) {
+        write_prefix(pattern, line, label, line_number, line_offset, options, out);
+        out.write_line(line);
+        return;
+    }
+
+    // Successive leftmost-longest matches; empty ones are skipped, as they print nothing
+    MatchSpan span;
+    size_t from = 0;
+    while (from <= line.length() && pattern.find_span(line, from, span)) {
+        if (span.end == span.start) {
+            from = span.start + 1;
+            continue;
+        }
+        write_prefix(pattern, line, label, line_number, line_offset + span.start, options, out);
+        out.write_line(line.substr(span.start, span.end - span.start));
+        from = span.end;
+    }
+}
+
+// reader.next_block(), with the wait counted as reading for --stats
+template <typename Reader>
+bool read_block(Reader& reader, std::string_view& block) {
+    StatsTimer timer(&SearchStats::read_ns);
+    return reader.next_block(block);
+}
+
+// Searches every block `reader` hands out; offsets and line numbers run across blocks
+template <typename Reader>
+size_t scan_blocks(const CompiledPattern& pattern, Reader& reader, std::string_view label,
+                   const SearchOptions& options, OutputBuffer& out) {
+    std::string_view block;
+    FilePosition position;
+    size_t matches = 0;
+    while (read_block(reader, block)) {
+        matches += search_buffer(pattern, block, label, options, out, position);
+    }
+    return matches;
+}
+
+size_t scan_fd(const CompiledPattern& pattern, int fd, std::string_view label,
+               const SearchOptions& options, OutputBuffer& out) {
+    if (options.decompress) {
+        DecompressingReader reader(fd);
+        return scan_blocks(pattern, reader, label, options, out);
+    }
+    LineReader reader(fd);
+    return scan_blocks(pattern, reader, label, options, out);
+}
+
+// Peeks at the magic bytes without moving the file offset; false for pipes and short files
+bool is_compressed_file(int fd) {
+    char head[4];
+    ssize_t count = ::pread(fd, head, sizeof(head), 0);
+    return count > 0 && detect_compression(std::string_view(head, static_cast<size_t>(count))) != Compression::None;
+}
+
+size_t scan_open_file(const CompiledPattern& pattern, int fd, std::string_view label,
+                      const SearchOptions& options, OutputBuffer& out) {
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (options.decompress && is_compressed_file(fd))) {
+        return scan_fd(pattern, fd, label, options, out);
+    }
+    if (info.st_size == 0) {
+        return 0;
+    }
+
+    size_t length = static_cast<size_t>(info.st_size);
+    if (length <= kSmallFileSize) {
+        // Setting up and tearing down a mapping costs more than copying a small file
+        thread_local std::vector<char> contents;
+        contents.resize(length);
+        size_t filled = 0;
+        StatsTimer timer(&SearchStats::read_ns);
+        while (filled < length) {
+            ssize_t count = ::pread(fd, contents.data() + filled, length - filled, static_cast<off_t>(filled));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                throw std::runtime_error(std::strerror(errno));
+            }
+            if (count == 0) {
+                break;  // Truncated since the fstat
+            }
+            filled += static_cast<size_t>(count);
+        }
+        timer.stop();
+        return search_buffer(pattern, std::string_view(contents.data(), filled), label, options, out);
+    }
+
+    // Only setting up the mapping counts as reading; its page faults land in the search
+    StatsTimer timer(&SearchStats::read_ns);
+    FileMapping mapping;
+    if (!mapping.map(fd, length)) {
+        timer.stop();
+        return scan_fd(pattern, fd, label, options, out);
+    }
+    mapping.advise_sequential();
+    timer.stop();
+    return search_buffer(pattern, mapping.contents(), label, options, out);
+}
+
+} // namespace
+
+size_t search_fd(const CompiledPattern& pattern, int fd, std::string_view label,
+                 const SearchOptions& options, OutputBuffer& out) {
+    if (search_stats_enabled()) {
+        thread_stats().files++;
+    }
+    size_t matches = scan_fd(pattern, fd, label, options, out);
+    if (options.count_only) {
+        write_count(label, matches, options, out);
+    }
+    return matches;
+}
+
+size_t search_buffer(const CompiledPattern& pattern, std::string_view buffer, std::string_view label,
+                     const SearchOptions& options, OutputBuffer& out) {
+    FilePosition position;
+    return search_buffer(pattern, buffer, label, options, out, position);
+}
+
+size_t search_buffer(const CompiledPattern& pattern, std::string_view buffer, std::string_view label,
+                     const SearchOptions& options, OutputBuffer& out, FilePosition& position) {
+    const char* data = buffer.data();
+    size_t matches = 0;
+    size_t from = 0;
+    size_t numbered = 0;  // position.line is the number of the line holding this offset
+    LineCursor cursor;
+    while (from < buffer.length()) {
+        StatsTimer match_timer(&SearchStats::match_ns);
+        size_t hit = pattern.find_line(buffer, from, cursor);
+        match_timer.stop();
+        if (hit == std::string_view::npos) {
+            break;
+        }
+        matches++;
+
+        // Walk back and forward from the hit to the enclosing line boundaries
+        const void* before = hit > from ? ::memrchr(data + from, '\n', hit - from) : nullptr;
+        size_t line_start = before ? static_cast<const char*>(before) - data + 1 : from;
+        const void* after = std::memchr(data + hit, '\n', buffer.length() - hit);
+        size_t line_end = after ? static_cast<const char*>(after) - data : buffer.length();
+        from = line_end + 1;
+        if (options.count_only) {
+            continue;
+        }
+
+        if (options.line_number) {
+            position.line += count_byte(buffer.substr(numbered, line_start - numbered), '\n');
+            numbered = line_start;
+        }
+        StatsTimer output_timer(&SearchStats::output_ns);
+        write_match(pattern, buffer.substr(line_start, line_end - line_start), label, position.line,
+                    position.offset + line_start, options, out);
+    }
+
+    if (search_stats_enabled()) {
+        // A last line without its '\n' is still a line
+        SearchStats& stats = thread_stats();
+        stats.bytes += buffer.length();
+        stats.lines += count_byte(buffer, '\n') + (!buffer.empty() && buffer.back() != '\n');
+        stats.matching_lines += matches;
+    }
+
+    if (options.line_number) {
+        position.line += count_byte(buffer.substr(numbered), '\n');
+    }
+    position.offset += buffer.length();
+    return matches;
+}
+
+size_t search_file(const CompiledPattern& pattern, const std::string& path,
+                   const SearchOptions& options, OutputBuffer& out) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(std::strerror(errno));
+    }
+    FdCloser closer{fd};
+    return search_open_file(pattern, fd, path, options, out);
+}
+
+size_t search_open_file(const CompiledPattern& pattern, int fd, std::string_view label,
+                        const SearchOptions& options, OutputBuffer& out) {
+    if (search_stats_enabled()) {
+        thread_stats().files++;
+    }
+    size_t matches = scan_open_file(pattern, fd, label, options, out);
+    if (options.count_only) {
+        write_count(label, matches, options, out);
+    }
+    return matches;
+}
+
+void write_count(std::string_view label, size_t count, const SearchOptions& options, OutputBuffer& out) {
+    if (options.with_filename) {
+        out.write(label);
+        out.write(":");
+    }
+    write_number(count, out);
+    out.write("\n");
+}
@@ -0,0 +1,55 @@
+// search.h
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "grep_funcs.h"
+#include "line_reader.h"
+
+struct SearchOptions {
+    bool with_filename = false;  // Prefix each output line with "<label>:"
+    bool line_number = false;    // -n: then with the line number, from 1
+    bool byte_offset = false;    // -b: then with the byte offset of the line (or match, with -o)
+    bool pattern_ids = false;    // Then with the matching pattern numbers, from 1, as "2,5:"
+    bool only_matching = false;  // -o: print each non-empty match on its own line, not the line
+    bool count_only = false;     // -c: print only the number of matching lines per input
+    bool decompress = false;     // -z: inputs may be gzip or zstd compressed; search their contents
+};
+
+// Where a buffer starts within its input. Line numbers are only maintained when
+// SearchOptions::line_number is set, by counting newlines over the regions between matches.
+struct FilePosition {
+    uint64_t offset = 0;
+    uint64_t line = 1;
+};
+
+// Streams `fd` through the pattern a block of whole lines at a time and writes matching
+// lines (or, with count_only, their number) to `out`. Returns the number of matching lines.
+// With decompress, the input is decoded on a second thread while the blocks are searched.
+size_t search_fd(const CompiledPattern& pattern, int fd, std::string_view label,
+                 const SearchOptions& options, OutputBuffer& out);
+
+// Searches a whole buffer of lines at once; only lines containing a match are ever delimited.
+// Returns the number of matching lines; the count itself is left to the caller.
+// The second form starts numbering at `position` and advances it past the buffer.
+size_t search_buffer(const CompiledPattern& pattern, std::string_view buffer, std::string_view label,
+                     const SearchOptions& options, OutputBuffer& out);
+size_t search_buffer(const CompiledPattern& pattern, std::string_view buffer, std::string_view label,
+                     const SearchOptions& options, OutputBuffer& out, FilePosition& position);
+
+// Memory-maps regular files and searches them with search_buffer; pipes, devices, files that
+// cannot be mapped and, with decompress, compressed files go through search_fd instead.
+// Throws std::runtime_error on open failure.
+size_t search_file(const CompiledPattern& pattern, const std::string& path,
+                   const SearchOptions& options, OutputBuffer& out);
+
+// Like search_file, for a file the caller has already opened; `fd` is left open
+size_t search_open_file(const CompiledPattern& pattern, int fd, std::string_view label,
+                        const SearchOptions& options, OutputBuffer& out);
+
+// Writes the -c line for one input: "<label>:<count>", or just the count without with_filename
+void write_count(std::string_view label, size_t count, const SearchOptions& options, OutputBuffer& out);
+
+#endif // SEARCH_H
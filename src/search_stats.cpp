@@ -0,0 +1,127 @@
+#include "search_stats.h"
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Every thread's counters, owned here so they survive the thread
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<SearchStats>> threads;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+double seconds(uint64_t ns) {
+    return static_cast<double>(ns) / 1e9;
+}
+
+// Candidate lines as a fraction of all lines, 0 for empty input
+double candidate_rate(const SearchStats& stats) {
+    return stats.lines == 0 ? 0.0 : static_cast<double>(stats.candidate_lines) / static_cast<double>(stats.lines);
+}
+
+// Engine descriptions are plain ASCII, but keep the output valid JSON whatever they hold
+void write_json_string(const std::string& text, std::ostream& out) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+void SearchStats::merge(const SearchStats& other) {
+    files += other.files;
+    binary_files += other.binary_files;
+    bytes += other.bytes;
+    lines += other.lines;
+    matching_lines += other.matching_lines;
+    candidate_lines += other.candidate_lines;
+    confirmed_lines += other.confirmed_lines;
+    backtracked_lines += other.backtracked_lines;
+    ascii_windows += other.ascii_windows;
+    utf8_windows += other.utf8_windows;
+    dfa_states += other.dfa_states;
+    dfa_flushes += other.dfa_flushes;
+    nfa_fallbacks += other.nfa_fallbacks;
+    read_ns += other.read_ns;
+    match_ns += other.match_ns;
+    output_ns += other.output_ns;
+}
+
+void enable_search_stats() {
+    search_stats_detail::enabled = true;
+}
+
+SearchStats& thread_stats() {
+    thread_local SearchStats* stats = nullptr;
+    if (stats == nullptr) {
+        Registry& all = registry();
+        std::lock_guard<std::mutex> lock(all.mutex);
+        all.threads.push_back(std::make_unique<SearchStats>());
+        stats = all.threads.back().get();
+    }
+    return *stats;
+}
+
+SearchStats merged_search_stats() {
+    Registry& all = registry();
+    std::lock_guard<std::mutex> lock(all.mutex);
+    SearchStats total;
+    for (const std::unique_ptr<SearchStats>& stats : all.threads) {
+        total.merge(*stats);
+    }
+    return total;
+}
+
+void write_search_stats(const SearchStats& stats, const std::string& engine, uint64_t wall_ns, bool json,
+                        std::ostream& out) {
+    if (json) {
+        out << "{\"engine\":";
+        write_json_string(engine, out);
+        out << ",\"files\":" << stats.files << ",\"binary_files\":" << stats.binary_files
+            << ",\"bytes\":" << stats.bytes << ",\"lines\":" << stats.lines
+            << ",\"matching_lines\":" << stats.matching_lines << ",\"candidate_lines\":" << stats.candidate_lines
+            << ",\"confirmed_lines\":" << stats.confirmed_lines << ",\"candidate_rate\":" << candidate_rate(stats)
+            << ",\"backtracked_lines\":" << stats.backtracked_lines << ",\"ascii_windows\":" << stats.ascii_windows
+            << ",\"utf8_windows\":" << stats.utf8_windows << ",\"dfa_states\":" << stats.dfa_states
+            << ",\"dfa_flushes\":" << stats.dfa_flushes << ",\"nfa_fallbacks\":" << stats.nfa_fallbacks
+            << ",\"read_ns\":" << stats.read_ns << ",\"match_ns\":" << stats.match_ns
+            << ",\"output_ns\":" << stats.output_ns << ",\"wall_ns\":" << wall_ns << "}" << std::endl;
+        return;
+    }
+
+    std::ios_base::fmtflags saved = out.flags();
+    std::streamsize precision = out.precision(3);
+    out << std::fixed;
+    out << "engine: " << engine << '\n';
+    out << "files: " << stats.files << " searched, " << stats.binary_files << " binary skipped\n";
+    out << "bytes: " << stats.bytes << '\n';
+    out << "lines: " << stats.lines << " scanned, " << stats.matching_lines << " matching\n";
+    out << "prefilter: " << stats.candidate_lines << " candidate lines ("
+        << 100.0 * candidate_rate(stats) << "% of lines), " << stats.confirmed_lines << " confirmed\n";
+    out << "backtracked lines: " << stats.backtracked_lines << '\n';
+    if (stats.ascii_windows + stats.utf8_windows > 0) {
+        out << "utf8 windows: " << stats.ascii_windows << " ascii, " << stats.utf8_windows << " utf8\n";
+    }
+    out << "dfa: " << stats.dfa_states << " states built, " << stats.dfa_flushes << " flushes, "
+        << stats.nfa_fallbacks << " nfa fallbacks\n";
+    out.precision(6);
+    out << "time: read " << seconds(stats.read_ns) << " s, match " << seconds(stats.match_ns) << " s, output "
+        << seconds(stats.output_ns) << " s, wall " << seconds(wall_ns) << " s" << std::endl;
+    out.flags(saved);
+    out.precision(precision);
+}
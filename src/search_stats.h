@@ -0,0 +1,91 @@
+// search_stats.h
+#ifndef SEARCH_STATS_H
+#define SEARCH_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// What --stats reports about a run. Each thread counts into its own instance, so the hot path
+// never shares a cache line or takes a lock; the instances are summed once the searches end.
+// Every counter stays zero unless enable_search_stats() was called: the only cost left in the
+// search loops is one well-predicted branch on a flag that never changes.
+struct SearchStats {
+    uint64_t files = 0;               // Inputs searched
+    uint64_t binary_files = 0;        // -r: files skipped as binary
+    uint64_t bytes = 0;               // Bytes searched, after any decompression
+    uint64_t lines = 0;               // Lines in those bytes
+    uint64_t matching_lines = 0;
+    uint64_t candidate_lines = 0;     // Lines a required-literal hit sent on to the automaton
+    uint64_t confirmed_lines = 0;     // Candidates the automaton accepted
+    uint64_t backtracked_lines = 0;   // Lines decided by the Backtracker
+    uint64_t ascii_windows = 0;       // UTF-8 mode: windows searched by the bytewise twin
+    uint64_t utf8_windows = 0;        // UTF-8 mode: windows searched by the UTF-8 automaton
+    uint64_t dfa_states = 0;          // DFA states built, including those built again after a flush
+    uint64_t dfa_flushes = 0;         // DFA cache flushes
+    uint64_t nfa_fallbacks = 0;       // Lines finished as an NFA simulation because the cache thrashed
+    uint64_t read_ns = 0;             // Reading, mapping and decompressing input (per thread, summed)
+    uint64_t match_ns = 0;            // Finding matching lines
+    uint64_t output_ns = 0;           // Formatting output and writing it
+
+    void merge(const SearchStats& other);
+};
+
+namespace search_stats_detail {
+inline bool enabled = false;
+inline thread_local bool timing = false;  // A StatsTimer is running on this thread
+}
+
+// Turns counting on; call before any search starts
+void enable_search_stats();
+
+inline bool search_stats_enabled() {
+    return search_stats_detail::enabled;
+}
+
+// The calling thread's counters; they outlive the thread, so pool workers may exit first
+SearchStats& thread_stats();
+
+// The sum over every thread that has counted anything; call once the searches have finished
+SearchStats merged_search_stats();
+
+// Adds the time until it goes out of scope to one SearchStats field of the calling thread;
+// does nothing, not even read the clock, while stats are off. A timer started while another
+// is running adds nothing either, so a write flushed while formatting output is counted once.
+class StatsTimer {
+public:
+    explicit StatsTimer(uint64_t SearchStats::*field)
+        : field_(search_stats_enabled() && !search_stats_detail::timing ? field : nullptr) {
+        if (field_ != nullptr) {
+            search_stats_detail::timing = true;
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~StatsTimer() { stop(); }
+
+    StatsTimer(const StatsTimer&) = delete;
+    StatsTimer& operator=(const StatsTimer&) = delete;
+
+    // Ends the timing before the scope does; the destructor then adds nothing
+    void stop() {
+        if (field_ != nullptr) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            thread_stats().*field_ += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            search_stats_detail::timing = false;
+            field_ = nullptr;
+        }
+    }
+
+private:
+    uint64_t SearchStats::*field_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Writes the --stats report: labelled lines, or with `json` a single JSON object on one line.
+// `engine` names the matching strategy and `wall_ns` is the run's elapsed time.
+void write_search_stats(const SearchStats& stats, const std::string& engine, uint64_t wall_ns, bool json,
+                        std::ostream& out);
+
+#endif // SEARCH_STATS_H
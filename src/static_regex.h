@@ -0,0 +1,452 @@
+// static_regex.h
+#ifndef STATIC_REGEX_H
+#define STATIC_REGEX_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "char_class.h"
+#include "literal_analysis.h"
+#include "prefilter.h"
+#include "regex_compiler.h"
+#include "regex_program.h"
+
+// Header-only matchers for patterns fixed at compile time:
+//
+//     using error_line = grep::static_regex<"^error_\\d+$">;
+//     if (error_line::match(line)) { ... }
+//
+// The pattern goes through the same parser and compiler as CompiledPattern, at compile time,
+// and the resulting program is expanded into a complete DFA stored in constexpr tables.
+// Matching is then a single loop of table lookups with no parse step, no engine dispatch
+// and no allocation. A malformed pattern, or one with back-references (which no DFA can
+// match), is a compile error. Required literals are extracted at compile time too; at run
+// time they feed a LiteralPrefilter and the SIMD skip loop uses ClassScanner, so programs
+// link the library as CompiledPattern users do.
+namespace grep {
+
+// A string literal usable as a template argument
+template <size_t N>
+struct fixed_string {
+    char data[N]{};
+
+    constexpr fixed_string(const char (&text)[N]) { std::copy_n(text, N, data); }
+    constexpr std::string_view view() const { return std::string_view(data, N - 1); }
+};
+
+namespace detail {
+
+// Table sizes for one pattern, computed in a first compile-time pass
+struct StaticDfaShape {
+    size_t states = 0;
+    size_t classes = 0;
+    size_t accelerated = 0;  // States left by only a few bytes, skipped through with a class scan
+    size_t literals = 0;     // Required literals worth prefiltering on; 0 when there are none
+    size_t literal_bytes = 0;
+};
+
+// Transitions hold the target's row offset (state * classes), so a step is one add and one load.
+// States are ordered so that a comparison or two classify a row: accelerated states come first
+// (rows below first_plain), then the other running states, then the dead state and the
+// matching states, which end the search (rows from first_stop and first_match).
+template <StaticDfaShape Shape>
+struct StaticDfa {
+    using Entry = std::conditional_t<(Shape.states * Shape.classes <= UINT16_MAX), uint16_t, uint32_t>;
+
+    std::array<uint8_t, 256> byte_class{};
+    std::array<Entry, Shape.states * Shape.classes> next{};
+    std::array<bool, Shape.states> accepts_at_end{};  // A pending $ completes at the end of the line
+    std::array<ByteSet, Shape.accelerated> exits{};   // Bytes that leave each accelerated state
+    Entry start = 0;
+    Entry first_plain = 0;
+    Entry first_stop = 0;
+    Entry first_match = 0;
+
+    // Required literals, concatenated; literal_begin[i] is the offset of the i-th
+    std::array<char, Shape.literal_bytes> literal_text{};
+    std::array<size_t, Shape.literals + 1> literal_begin{};
+    bool literals_exact = false;  // Containing a literal is the same as matching
+};
+
+// Runs the subset construction over a compiled program at compile time. The closure rules are
+// those of LazyDfa restricted to a single line: ^ holds only before the first byte, $ only after
+// the last, and every step may begin a new match.
+class StaticDfaBuilder {
+public:
+    static constexpr size_t kMaxStates = 4096;
+    static constexpr int kMaxAccelerationBytes = 64;  // Skipping pays off only for narrow exit sets
+
+    constexpr explicit StaticDfaBuilder(std::string_view pattern) {
+        RegexAst ast = RegexParser(pattern).parse();
+        if (ast.has_backrefs) {
+            throw std::invalid_argument("static_regex cannot match back-references");
+        }
+        program_ = RegexCompiler(ast).compile();
+        compute_byte_classes();
+        build();
+        if (!anchored()) {
+            literals_ = LiteralAnalyzer::extract(ast);
+        }
+        if (literals_.alternatives.size() > 1) {
+            // The DFA's own class scan already beats a multi-literal scan over a single line
+            literals_ = RequiredLiterals{};
+        }
+    }
+
+    constexpr StaticDfaShape shape() const {
+        size_t accelerated = 0;
+        for (size_t i = 0; i < states_.size(); i++) {
+            accelerated += kind_of(i) == kAccelerated ? 1 : 0;
+        }
+        size_t literal_bytes = 0;
+        for (const std::string& literal : literals_.alternatives) {
+            literal_bytes += literal.length();
+        }
+        return {states_.size(), class_count_, accelerated, literals_.alternatives.size(), literal_bytes};
+    }
+
+    template <StaticDfaShape Shape>
+    constexpr StaticDfa<Shape> tables() const {
+        using Entry = typename StaticDfa<Shape>::Entry;
+        StaticDfa<Shape> dfa;
+        dfa.byte_class = byte_class_;
+
+        // Final position of every state, grouped by kind
+        std::vector<size_t> order(states_.size());
+        size_t position = 0;
+        for (int kind = kAccelerated; kind <= kMatched; kind++) {
+            for (size_t i = 0; i < states_.size(); i++) {
+                if (kind_of(i) == kind) {
+                    if (kind == kAccelerated) {
+                        dfa.exits[position] = exits(i);
+                    }
+                    order[i] = position++;
+                }
+            }
+            Entry end = static_cast<Entry>(position * class_count_);
+            switch (kind) {
+                case kAccelerated: dfa.first_plain = end; break;
+                case kRunning: dfa.first_stop = end; break;
+                case kDead: dfa.first_match = end; break;
+                default: break;
+            }
+        }
+
+        for (size_t i = 0; i < states_.size(); i++) {
+            size_t row = order[i] * class_count_;
+            for (size_t c = 0; c < class_count_; c++) {
+                dfa.next[row + c] = static_cast<Entry>(order[next_[i * class_count_ + c]] * class_count_);
+            }
+            dfa.accepts_at_end[order[i]] = states_[i].accepts_at_end;
+        }
+        dfa.start = static_cast<Entry>(order[0] * class_count_);
+
+        size_t offset = 0;
+        for (size_t i = 0; i < literals_.alternatives.size(); i++) {
+            dfa.literal_begin[i] = offset;
+            for (char c : literals_.alternatives[i]) {
+                dfa.literal_text[offset++] = c;
+            }
+        }
+        dfa.literal_begin[literals_.alternatives.size()] = offset;
+        dfa.literals_exact = literals_.exact;
+        return dfa;
+    }
+
+private:
+    struct State {
+        std::vector<uint32_t> pcs;  // Sorted consuming, $ and Match instructions of the closure
+        bool at_line_start = false;
+        bool is_match = false;
+        bool accepts_at_end = false;
+
+        constexpr bool same_key(const State& other) const {
+            return at_line_start == other.at_line_start && pcs == other.pcs;
+        }
+    };
+
+    Program program_;
+    std::array<uint8_t, 256> byte_class_{};
+    std::array<uint8_t, 256> class_byte_{};  // One representative byte per class
+    size_t class_count_ = 0;
+    std::vector<State> states_;
+    std::vector<size_t> next_;  // class_count_ entries per state
+    RequiredLiterals literals_;
+
+    enum Kind { kAccelerated, kRunning, kDead, kMatched };
+
+    constexpr Kind kind_of(size_t state) const {
+        if (states_[state].is_match) {
+            return kMatched;
+        }
+        if (states_[state].pcs.empty() && !states_[state].at_line_start) {
+            return kDead;
+        }
+        return exits(state).count() <= kMaxAccelerationBytes ? kAccelerated : kRunning;
+    }
+
+    // Bytes whose transition leaves `state`
+    constexpr ByteSet exits(size_t state) const {
+        ByteSet set;
+        for (int c = 0; c < 256; c++) {
+            if (next_[state * class_count_ + byte_class_[c]] != state) {
+                set.set(static_cast<unsigned char>(c));
+            }
+        }
+        return set;
+    }
+
+    // Bytes no instruction can tell apart share a class; split the classes by every set in use
+    constexpr void compute_byte_classes() {
+        auto split = [this](const ByteSet& set) {
+            std::array<int, 512> renumber{};
+            renumber.fill(-1);
+            int count = 0;
+            for (int c = 0; c < 256; c++) {
+                int key = byte_class_[c] * 2 + (set.test(static_cast<unsigned char>(c)) ? 1 : 0);
+                if (renumber[key] < 0) {
+                    renumber[key] = count++;
+                }
+                byte_class_[c] = static_cast<uint8_t>(renumber[key]);
+            }
+            class_count_ = static_cast<size_t>(count);
+        };
+
+        class_count_ = 1;
+        for (const Inst& inst : program_.insts) {
+            if (inst.op == OpCode::Byte) {
+                ByteSet set;
+                set.set(inst.byte);
+                split(set);
+            } else if (inst.op == OpCode::Class) {
+                split(program_.classes[inst.x]);
+            }
+        }
+        for (int c = 255; c >= 0; c--) {
+            class_byte_[byte_class_[c]] = static_cast<uint8_t>(c);
+        }
+    }
+
+    constexpr void add_closure(std::vector<uint8_t>& in_set, uint32_t pc, bool at_start, bool at_end) const {
+        std::vector<uint32_t> stack{pc};
+        while (!stack.empty()) {
+            uint32_t current = stack.back();
+            stack.pop_back();
+            if (in_set[current]) {
+                continue;
+            }
+            in_set[current] = 1;
+
+            const Inst& inst = program_.insts[current];
+            switch (inst.op) {
+                case OpCode::Split:
+                    stack.push_back(inst.y);
+                    stack.push_back(inst.x);
+                    break;
+                case OpCode::Jmp:
+                    stack.push_back(inst.x);
+                    break;
+                case OpCode::LineStart:
+                    if (at_start) {
+                        stack.push_back(current + 1);
+                    }
+                    break;
+                case OpCode::LineEnd:
+                    if (at_end) {
+                        stack.push_back(current + 1);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // True when every match starts at the beginning of the line. Such a DFA usually dies within
+    // a byte or two, sooner than any literal scan could reject the line.
+    constexpr bool anchored() const {
+        std::vector<uint8_t> in_set(program_.insts.size(), 0);
+        add_closure(in_set, 0, false, false);
+        for (size_t pc = 0; pc < in_set.size(); pc++) {
+            OpCode op = program_.insts[pc].op;
+            if (in_set[pc] && (op == OpCode::Byte || op == OpCode::Class || op == OpCode::Any || op == OpCode::Match)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr bool has_match(const std::vector<uint8_t>& in_set) const {
+        for (size_t pc = 0; pc < in_set.size(); pc++) {
+            if (in_set[pc] && program_.insts[pc].op == OpCode::Match) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Returns the index of the state for a closure, adding it if it is new
+    constexpr size_t intern(const std::vector<uint8_t>& in_set, bool at_line_start) {
+        State state;
+        state.at_line_start = at_line_start;
+        for (uint32_t pc = 0; pc < in_set.size(); pc++) {
+            if (!in_set[pc]) {
+                continue;
+            }
+            switch (program_.insts[pc].op) {
+                case OpCode::Match:
+                    state.is_match = true;
+                    state.pcs.push_back(pc);
+                    break;
+                case OpCode::Byte:
+                case OpCode::Class:
+                case OpCode::Any:
+                case OpCode::LineEnd:
+                    state.pcs.push_back(pc);
+                    break;
+                default:
+                    break;
+            }
+        }
+        for (size_t i = 0; i < states_.size(); i++) {
+            if (states_[i].same_key(state)) {
+                return i;
+            }
+        }
+        if (states_.size() == kMaxStates) {
+            throw std::length_error("Pattern needs too many states for static_regex");
+        }
+
+        std::vector<uint8_t> at_end(program_.insts.size(), 0);
+        for (uint32_t pc : state.pcs) {
+            if (program_.insts[pc].op == OpCode::LineEnd) {
+                add_closure(at_end, pc + 1, at_line_start, true);
+            }
+        }
+        state.accepts_at_end = state.is_match || has_match(at_end);
+        states_.push_back(std::move(state));
+        return states_.size() - 1;
+    }
+
+    constexpr void build() {
+        std::vector<uint8_t> in_set(program_.insts.size(), 0);
+        add_closure(in_set, 0, true, false);
+        intern(in_set, true);
+
+        // states_ grows while it is walked; each new state gets its row of transitions
+        for (size_t i = 0; i < states_.size(); i++) {
+            next_.resize(states_.size() * class_count_);
+            if (states_[i].is_match || (states_[i].pcs.empty() && !states_[i].at_line_start)) {
+                for (size_t c = 0; c < class_count_; c++) {
+                    next_[i * class_count_ + c] = i;  // The search has already ended
+                }
+                continue;
+            }
+            for (size_t c = 0; c < class_count_; c++) {
+                unsigned char byte = class_byte_[c];
+                std::fill(in_set.begin(), in_set.end(), 0);
+                for (uint32_t pc : states_[i].pcs) {
+                    const Inst& inst = program_.insts[pc];
+                    bool advances = inst.op == OpCode::Any || (inst.op == OpCode::Byte && inst.byte == byte) ||
+                                    (inst.op == OpCode::Class && program_.classes[inst.x].test(byte));
+                    if (advances) {
+                        add_closure(in_set, pc + 1, false, false);
+                    }
+                }
+                add_closure(in_set, 0, false, false);
+                size_t target = intern(in_set, false);
+                next_.resize(states_.size() * class_count_);
+                next_[i * class_count_ + c] = target;
+            }
+        }
+    }
+};
+
+} // namespace detail
+
+// A pattern compiled into a DFA at compile time. match() agrees with
+// CompiledPattern(pattern).match() on every line.
+template <fixed_string Pattern>
+class static_regex {
+public:
+    static constexpr std::string_view pattern() noexcept { return Pattern.view(); }
+    static constexpr size_t state_count() noexcept { return kShape.states; }
+
+    // Returns true if any substring of input_line matches; one table lookup per byte, and
+    // the scan stops as soon as the outcome is known. At run time, lines without a required
+    // literal are rejected up front, and states that only a few bytes can leave are skipped
+    // through with a SIMD class scan.
+    static constexpr bool match(std::string_view input_line) noexcept {
+        if constexpr (kShape.literals > 0) {
+            if !consteval {
+                bool has_literal = prefilter().find(input_line, 0) != std::string_view::npos;
+                if (!has_literal || kDfa.literals_exact) {
+                    return has_literal;
+                }
+            }
+        }
+        auto row = kDfa.start;
+        if (row >= kDfa.first_stop) {
+            return row >= kDfa.first_match;
+        }
+        const size_t length = input_line.length();
+        for (size_t i = 0; i < length; i++) {
+            if constexpr (kShape.accelerated > 0) {
+                if !consteval {
+                    if (row < kDfa.first_plain) {
+                        i = scanners()[row / kShape.classes].find(input_line, i);
+                        if (i == std::string_view::npos) {
+                            break;
+                        }
+                    }
+                }
+            }
+            row = kDfa.next[row + kDfa.byte_class[static_cast<unsigned char>(input_line[i])]];
+            if (row >= kDfa.first_stop) {
+                return row >= kDfa.first_match;
+            }
+        }
+        return kDfa.accepts_at_end[row / kShape.classes];
+    }
+
+    constexpr bool operator()(std::string_view input_line) const noexcept { return match(input_line); }
+
+private:
+    static constexpr detail::StaticDfaShape kShape = detail::StaticDfaBuilder(Pattern.view()).shape();
+    static constexpr detail::StaticDfa<kShape> kDfa =
+        detail::StaticDfaBuilder(Pattern.view()).template tables<kShape>();
+
+    static const std::array<ClassScanner, kShape.accelerated>& scanners() {
+        static const std::array<ClassScanner, kShape.accelerated> built = [] {
+            std::array<ClassScanner, kShape.accelerated> result;
+            for (size_t i = 0; i < kShape.accelerated; i++) {
+                result[i] = ClassScanner(kDfa.exits[i]);
+            }
+            return result;
+        }();
+        return built;
+    }
+
+    static const LiteralPrefilter& prefilter() {
+        static const LiteralPrefilter built = [] {
+            RequiredLiterals literals;
+            for (size_t i = 0; i < kShape.literals; i++) {
+                literals.alternatives.emplace_back(kDfa.literal_text.data() + kDfa.literal_begin[i],
+                                                   kDfa.literal_begin[i + 1] - kDfa.literal_begin[i]);
+            }
+            literals.exact = kDfa.literals_exact;
+            return LiteralPrefilter(literals);
+        }();
+        return built;
+    }
+};
+
+} // namespace grep
+
+#endif // STATIC_REGEX_H
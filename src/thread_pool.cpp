@@ -0,0 +1,97 @@
+#include "thread_pool.h"
+
+namespace {
+
+// Index of the pool worker running on this thread, or SIZE_MAX outside any pool
+thread_local size_t worker_index = SIZE_MAX;
+thread_local const void* worker_pool = nullptr;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; i++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        workers_.emplace_back([this, i]() { run(i); });
+    }
+}
+
+// Finishes every queued task before joining
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    size_t target;
+    if (worker_pool == this) {
+        target = worker_index;
+    } else {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        target = next_queue_++ % queues_.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+        queues_[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        queued_++;
+    }
+    wake_.notify_one();
+}
+
+bool ThreadPool::try_pop(size_t self, std::function<void()>& task) {
+    {
+        Queue& own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t offset = 1; offset < queues_.size(); offset++) {
+        Queue& victim = *queues_[(self + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t self) {
+    worker_index = self;
+    worker_pool = this;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_.wait(lock, [this]() { return queued_ > 0 || stopping_; });
+            if (queued_ == 0) {
+                return;  // Stopping and nothing left to do
+            }
+            queued_--;
+        }
+
+        // The count reserved one task, so some deque holds it; a scan can still miss it while
+        // other workers pop concurrently, so retry until it turns up
+        std::function<void()> task;
+        while (!try_pop(self, task)) {
+            std::this_thread::yield();
+        }
+        task();
+    }
+}
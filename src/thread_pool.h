@@ -0,0 +1,49 @@
+// thread_pool.h
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker pops its newest task
+// first and, when it runs dry, steals the oldest task from another worker, so tasks spawned
+// by a task stay on the same core while idle workers still pick up slack.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queues a task; from a worker thread it goes onto that worker's own deque
+    void submit(std::function<void()> task);
+
+    size_t size() const { return workers_.size(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    size_t queued_ = 0;       // Tasks sitting in any deque; guarded by wake_mutex_
+    bool stopping_ = false;   // Guarded by wake_mutex_
+    size_t next_queue_ = 0;   // Round-robin target for submissions from outside the pool
+
+    bool try_pop(size_t self, std::function<void()>& task);
+    void run(size_t self);
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,645 @@
+#include "trigram_index.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include "binary_io.h"
+#include "char_class.h"
+#include "file_mapping.h"
+#include "recursive_search.h"
+
+namespace {
+
+constexpr char kMagic[8] = {'G', 'R', 'E', 'P', 'T', 'R', 'I', 'X'};
+constexpr uint32_t kTrigramCount = 1u << 24;
+constexpr uint32_t kDropped = UINT32_MAX;
+
+// Fixed-size start of an index file. The tables follow it back to back; every entry size is a
+// multiple of 8, so each table is aligned for reading in place.
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t file_count;
+    uint64_t block_count;
+    uint64_t trigram_count;
+    uint64_t files_offset;
+    uint64_t blocks_offset;
+    uint64_t trigrams_offset;
+    uint64_t postings_offset;
+    uint64_t postings_length;
+    uint64_t strings_offset;
+    uint64_t strings_length;
+};
+
+int64_t modification_ns(const struct stat& info) {
+    return static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+uint32_t trigram_at(std::string_view text, size_t pos) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(text[pos])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 1])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 2]));
+}
+
+// LEB128: seven bits per byte, low bits first, high bit set on all but the last byte
+void put_varint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+uint32_t get_varint(std::string_view data, size_t& pos) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= data.length()) {
+            break;
+        }
+        unsigned char byte = static_cast<unsigned char>(data[pos++]);
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupt posting list in index");
+}
+
+// Reads exactly `length` bytes at `offset`; false on error or end of file
+bool read_at(int fd, char* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t count = ::pread(fd, data, length, static_cast<off_t>(offset));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        length -= static_cast<size_t>(count);
+        offset += static_cast<uint64_t>(count);
+    }
+    return true;
+}
+
+// hash_bytes() of the bytes before `end`, as kept in IndexedFile::tail_hash
+uint64_t tail_hash(std::string_view contents, uint64_t end) {
+    size_t length = static_cast<size_t>(std::min<uint64_t>(end, TrigramIndex::kTailHashBytes));
+    return hash_bytes(contents.substr(static_cast<size_t>(end) - length, length));
+}
+
+// The distinct trigrams of a block, leaving out those that span a '\n' since no line holds
+// them. The seen-set is a bitmap over all 2^24 trigrams, cleared through the list of what was
+// set, so each block costs only its own bytes.
+class TrigramCollector {
+public:
+    TrigramCollector() : seen_(kTrigramCount / 64) {}
+
+    const std::vector<uint32_t>& collect(std::string_view block) {
+        for (uint32_t trigram : found_) {
+            seen_[trigram >> 6] = 0;
+        }
+        found_.clear();
+
+        uint32_t window = 0;
+        size_t run = 0;  // Bytes since the last '\n'
+        for (char c : block) {
+            unsigned char byte = static_cast<unsigned char>(c);
+            if (byte == '\n') {
+                run = 0;
+                continue;
+            }
+            window = ((window << 8) | byte) & (kTrigramCount - 1);
+            if (++run < 3) {
+                continue;
+            }
+            uint64_t& word = seen_[window >> 6];
+            uint64_t bit = uint64_t{1} << (window & 63);
+            if ((word & bit) == 0) {
+                word |= bit;
+                found_.push_back(window);
+            }
+        }
+        return found_;
+    }
+
+private:
+    std::vector<uint64_t> seen_;
+    std::vector<uint32_t> found_;
+};
+
+// A file's record with its path and blocks held by value until the index is written
+struct FileBuild {
+    std::string path;
+    IndexedFile record{};
+    std::vector<IndexedBlock> blocks;
+};
+
+// The new index while it is put together. Block ids are handed out in file order, so each
+// file's blocks stay consecutive.
+class IndexBuilder {
+public:
+    // Keeps `file`'s indexed blocks from the old index under new ids, recorded in `remap`
+    void keep_blocks(FileBuild& build, const TrigramIndex& old, const IndexedFile& file,
+                     std::vector<uint32_t>& remap) {
+        uint32_t old_id = file.first_block;
+        for (const IndexedBlock& block : old.blocks(file)) {
+            remap[old_id++] = next_id_++;
+            build.blocks.push_back(block);
+        }
+        build.record.indexed_length = file.indexed_length;
+        build.record.line_count = file.line_count;
+        build.record.tail_hash = file.tail_hash;
+    }
+
+    // Indexes the complete lines of `contents` from `from`, which ends the lines already indexed,
+    // continuing the file's blocks and line numbers. Returns the bytes read.
+    uint64_t add_lines(FileBuild& build, std::string_view contents, uint64_t from) {
+        const char* data = contents.data();
+        const void* last_newline = from < contents.length()
+                                       ? ::memrchr(data + from, '\n', contents.length() - from)
+                                       : nullptr;
+        if (last_newline == nullptr) {
+            return 0;  // No complete line yet
+        }
+        size_t end = static_cast<const char*>(last_newline) - data + 1;
+
+        uint64_t line = build.record.line_count + 1;
+        for (size_t pos = static_cast<size_t>(from); pos < end;) {
+            size_t block_end = end;
+            if (end - pos > TrigramIndex::kBlockSize) {
+                // There is a '\n' at end - 1, so one is always found
+                const void* newline = std::memchr(data + pos + TrigramIndex::kBlockSize, '\n',
+                                                  end - pos - TrigramIndex::kBlockSize);
+                block_end = static_cast<const char*>(newline) - data + 1;
+            }
+            std::string_view block = contents.substr(pos, block_end - pos);
+            build.blocks.push_back({pos, block.length(), line});
+            line += count_byte(block, '\n');
+            for (uint32_t trigram : collector_.collect(block)) {
+                postings_[trigram].push_back(next_id_);
+            }
+            next_id_++;
+            pos = block_end;
+        }
+        build.record.indexed_length = end;
+        build.record.line_count = line - 1;
+        build.record.tail_hash = tail_hash(contents, end);
+        return end - from;
+    }
+
+    // Carries the old posting lists over to the kept blocks' new ids
+    void keep_postings(const TrigramIndex& old, const std::vector<uint32_t>& remap) {
+        std::vector<uint32_t> ids;
+        for (uint32_t trigram : old.trigrams()) {
+            old.postings(trigram, ids);
+            for (uint32_t id : ids) {
+                if (remap[id] != kDropped) {
+                    postings_[trigram].push_back(remap[id]);
+                }
+            }
+        }
+    }
+
+    void write(const std::string& path, std::vector<FileBuild>& files);
+
+private:
+    TrigramCollector collector_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings_;
+    uint32_t next_id_ = 0;
+};
+
+void write_all(int fd, std::string_view data, const std::string& path) {
+    while (!data.empty()) {
+        ssize_t count = ::write(fd, data.data(), data.length());
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            throw std::runtime_error(path + ": " + std::strerror(errno));
+        }
+        data.remove_prefix(static_cast<size_t>(count));
+    }
+}
+
+// Writes to a private temporary file first, so a search never maps a half-written index
+void IndexBuilder::write(const std::string& path, std::vector<FileBuild>& files) {
+    std::string strings;
+    std::vector<IndexedBlock> blocks;
+    for (FileBuild& build : files) {
+        build.record.path_offset = strings.length();
+        build.record.path_length = build.path.length();
+        strings += build.path;
+        build.record.first_block = static_cast<uint32_t>(blocks.size());
+        build.record.block_count = static_cast<uint32_t>(build.blocks.size());
+        blocks.insert(blocks.end(), build.blocks.begin(), build.blocks.end());
+    }
+
+    // Posting lists hold gaps between increasing ids; the first gap is from -1
+    std::vector<uint32_t> keys;
+    keys.reserve(postings_.size());
+    for (const auto& [trigram, ids] : postings_) {
+        keys.push_back(trigram);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<IndexedTrigram> trigrams;
+    std::string postings;
+    for (uint32_t trigram : keys) {
+        std::vector<uint32_t>& ids = postings_[trigram];
+        if (!std::is_sorted(ids.begin(), ids.end())) {
+            std::sort(ids.begin(), ids.end());
+        }
+        trigrams.push_back({trigram, static_cast<uint32_t>(ids.size()), postings.length()});
+        uint32_t previous = UINT32_MAX;
+        for (uint32_t id : ids) {
+            put_varint(postings, id - previous - 1);
+            previous = id;
+        }
+    }
+
+    IndexHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = TrigramIndex::kFormatVersion;
+    header.block_size = TrigramIndex::kBlockSize;
+    header.file_count = files.size();
+    header.block_count = blocks.size();
+    header.trigram_count = trigrams.size();
+    header.files_offset = sizeof(IndexHeader);
+    header.blocks_offset = header.files_offset + files.size() * sizeof(IndexedFile);
+    header.trigrams_offset = header.blocks_offset + blocks.size() * sizeof(IndexedBlock);
+    header.postings_offset = header.trigrams_offset + trigrams.size() * sizeof(IndexedTrigram);
+    header.postings_length = postings.length();
+    header.strings_offset = header.postings_offset + postings.length();
+    header.strings_length = strings.length();
+
+    BinaryWriter tables;
+    tables.put(header);
+    for (const FileBuild& build : files) {
+        tables.put(build.record);
+    }
+    for (const IndexedBlock& block : blocks) {
+        tables.put(block);
+    }
+    for (const IndexedTrigram& trigram : trigrams) {
+        tables.put(trigram);
+    }
+
+    std::string temporary = path + "." + std::to_string(::getpid()) + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error(temporary + ": " + std::strerror(errno));
+    }
+    try {
+        FdCloser closer{fd};
+        write_all(fd, tables.data(), temporary);
+        write_all(fd, postings, temporary);
+        write_all(fd, strings, temporary);
+    } catch (const std::runtime_error&) {
+        ::unlink(temporary.c_str());
+        throw;
+    }
+    if (::rename(temporary.c_str(), path.c_str()) != 0) {
+        int error = errno;
+        ::unlink(temporary.c_str());
+        throw std::runtime_error(path + ": " + std::strerror(error));
+    }
+}
+
+// Adds `path`, or every regular file below it if it is a directory, by absolute path
+void collect_paths(const std::string& path, std::map<std::string, const IndexedFile*>& paths) {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    if (!fs::is_directory(path, error)) {
+        paths.emplace(fs::absolute(path).lexically_normal().string(), nullptr);
+        return;
+    }
+    fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied, error);
+    for (; !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+        const fs::directory_entry& entry = *it;
+        if (entry.is_symlink(error)) {
+            continue;
+        }
+        if (entry.is_directory(error)) {
+            if (entry.path().filename() == ".git") {
+                it.disable_recursion_pending();
+            }
+        } else if (entry.is_regular_file(error)) {
+            paths.emplace(fs::absolute(entry.path()).lexically_normal().string(), nullptr);
+        }
+    }
+    if (error) {
+        std::cerr << path << ": " << error.message() << std::endl;
+    }
+}
+
+} // namespace
+
+TrigramIndex::TrigramIndex(const std::string& path) {
+    map_and_check(path);
+}
+
+void TrigramIndex::map_and_check(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    FdCloser closer{fd};
+    struct stat info;
+    if (fd < 0 || ::fstat(fd, &info) != 0) {
+        throw std::runtime_error(path + ": " + std::strerror(errno));
+    }
+    size_t length = static_cast<size_t>(info.st_size);
+    if (length < sizeof(IndexHeader)) {
+        throw std::runtime_error(path + ": Not a grep index");
+    }
+    if (!mapping_.map(fd, length)) {
+        throw std::runtime_error(path + ": " + std::strerror(errno));
+    }
+
+    const char* base = mapping_.data();
+    IndexHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error(path + ": Not a grep index");
+    }
+    if (header.version != kFormatVersion) {
+        throw std::runtime_error(path + ": Index format " + std::to_string(header.version) + " is not supported");
+    }
+
+    // Each table must lie within the file, in order, so the counts cannot overflow the offsets
+    auto fits = [length](uint64_t offset, uint64_t count, size_t entry_size) {
+        return offset <= length && count <= (length - offset) / entry_size;
+    };
+    bool valid = header.files_offset == sizeof(IndexHeader) &&
+                 fits(header.files_offset, header.file_count, sizeof(IndexedFile)) &&
+                 header.blocks_offset == header.files_offset + header.file_count * sizeof(IndexedFile) &&
+                 fits(header.blocks_offset, header.block_count, sizeof(IndexedBlock)) &&
+                 header.trigrams_offset == header.blocks_offset + header.block_count * sizeof(IndexedBlock) &&
+                 fits(header.trigrams_offset, header.trigram_count, sizeof(IndexedTrigram)) &&
+                 header.postings_offset == header.trigrams_offset + header.trigram_count * sizeof(IndexedTrigram) &&
+                 fits(header.postings_offset, header.postings_length, 1) &&
+                 header.strings_offset == header.postings_offset + header.postings_length &&
+                 fits(header.strings_offset, header.strings_length, 1);
+    if (!valid) {
+        throw std::runtime_error(path + ": Corrupt index");
+    }
+    files_ = {reinterpret_cast<const IndexedFile*>(base + header.files_offset), header.file_count};
+    blocks_ = {reinterpret_cast<const IndexedBlock*>(base + header.blocks_offset), header.block_count};
+    trigrams_ = {reinterpret_cast<const IndexedTrigram*>(base + header.trigrams_offset), header.trigram_count};
+    postings_ = std::string_view(base + header.postings_offset, header.postings_length);
+    strings_ = std::string_view(base + header.strings_offset, header.strings_length);
+
+    for (const IndexedFile& file : files_) {
+        if (file.path_offset > strings_.length() || file.path_length > strings_.length() - file.path_offset ||
+            file.first_block > blocks_.size() || file.block_count > blocks_.size() - file.first_block) {
+            throw std::runtime_error(path + ": Corrupt index");
+        }
+    }
+}
+
+std::string_view TrigramIndex::path(const IndexedFile& file) const {
+    return strings_.substr(file.path_offset, file.path_length);
+}
+
+std::span<const IndexedBlock> TrigramIndex::blocks(const IndexedFile& file) const {
+    return blocks_.subspan(file.first_block, file.block_count);
+}
+
+const IndexedFile* TrigramIndex::find(std::string_view absolute_path) const {
+    auto it = std::lower_bound(files_.begin(), files_.end(), absolute_path,
+                               [this](const IndexedFile& file, std::string_view key) { return path(file) < key; });
+    return it != files_.end() && path(*it) == absolute_path ? &*it : nullptr;
+}
+
+const IndexedTrigram* TrigramIndex::lookup(uint32_t trigram) const {
+    auto it = std::lower_bound(trigrams_.begin(), trigrams_.end(), trigram,
+                               [](const IndexedTrigram& entry, uint32_t key) { return entry.trigram < key; });
+    return it != trigrams_.end() && it->trigram == trigram ? &*it : nullptr;
+}
+
+void TrigramIndex::decode(const IndexedTrigram& entry, std::vector<uint32_t>& ids) const {
+    size_t index = &entry - trigrams_.data();
+    uint64_t end = index + 1 < trigrams_.size() ? trigrams_[index + 1].offset : postings_.length();
+    if (entry.offset > end || end > postings_.length()) {
+        throw std::runtime_error("Corrupt posting list in index");
+    }
+    std::string_view list = postings_.substr(entry.offset, end - entry.offset);
+    ids.clear();
+    ids.reserve(entry.count);
+    size_t pos = 0;
+    uint32_t previous = UINT32_MAX;
+    for (uint32_t i = 0; i < entry.count; i++) {
+        previous += get_varint(list, pos) + 1;
+        if (previous >= blocks_.size()) {
+            throw std::runtime_error("Corrupt posting list in index");
+        }
+        ids.push_back(previous);
+    }
+}
+
+void TrigramIndex::postings(uint32_t trigram, std::vector<uint32_t>& ids) const {
+    ids.clear();
+    if (const IndexedTrigram* entry = lookup(trigram)) {
+        decode(*entry, ids);
+    }
+}
+
+std::vector<uint32_t> TrigramIndex::trigrams() const {
+    std::vector<uint32_t> result;
+    result.reserve(trigrams_.size());
+    for (const IndexedTrigram& entry : trigrams_) {
+        result.push_back(entry.trigram);
+    }
+    return result;
+}
+
+// A literal's blocks are the intersection of its trigrams' lists, taken shortest first so
+// the running set shrinks as fast as possible; the candidates are the union over literals
+std::vector<uint32_t> TrigramIndex::candidate_blocks(const RequiredLiterals& literals) const {
+    std::vector<uint32_t> all(blocks_.size());
+    for (uint32_t id = 0; id < all.size(); id++) {
+        all[id] = id;
+    }
+    if (literals.alternatives.empty()) {
+        return all;
+    }
+
+    std::vector<uint32_t> result;
+    std::vector<uint32_t> blocks;
+    std::vector<uint32_t> list;
+    std::vector<uint32_t> both;
+    std::vector<const IndexedTrigram*> entries;
+    for (const std::string& literal : literals.alternatives) {
+        if (literal.length() < 3) {
+            return all;
+        }
+        entries.clear();
+        bool absent = false;
+        for (size_t pos = 0; pos + 3 <= literal.length() && !absent; pos++) {
+            const IndexedTrigram* entry = lookup(trigram_at(literal, pos));
+            absent = entry == nullptr;
+            entries.push_back(entry);
+        }
+        if (absent) {
+            continue;  // Some trigram occurs nowhere, so neither does the literal
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const IndexedTrigram* a, const IndexedTrigram* b) {
+                      return a->count != b->count ? a->count < b->count : a < b;
+                  });
+        entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+        decode(*entries[0], blocks);
+        for (size_t i = 1; i < entries.size() && !blocks.empty(); i++) {
+            decode(*entries[i], list);
+            both.clear();
+            std::set_intersection(blocks.begin(), blocks.end(), list.begin(), list.end(), std::back_inserter(both));
+            blocks.swap(both);
+        }
+        result.insert(result.end(), blocks.begin(), blocks.end());
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+IndexState check_indexed_file(int fd, const IndexedFile& file) {
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<uint64_t>(info.st_dev) != file.device ||
+        static_cast<uint64_t>(info.st_ino) != file.inode) {
+        return IndexState::Stale;
+    }
+    uint64_t size = static_cast<uint64_t>(info.st_size);
+    if (size == file.size && modification_ns(info) == file.mtime_ns) {
+        return IndexState::Unchanged;
+    }
+    if (size <= file.size) {
+        return IndexState::Stale;  // Rewritten in place or truncated, as by copytruncate
+    }
+
+    // Grown: appended to, unless the file was emptied and refilled past its old size
+    size_t length = static_cast<size_t>(std::min<uint64_t>(file.indexed_length, TrigramIndex::kTailHashBytes));
+    char tail[TrigramIndex::kTailHashBytes];
+    if (!read_at(fd, tail, length, file.indexed_length - length)) {
+        return IndexState::Stale;
+    }
+    return hash_bytes(std::string_view(tail, length)) == file.tail_hash ? IndexState::Appended : IndexState::Stale;
+}
+
+IndexUpdate update_index(const std::string& index_path, const std::vector<std::string>& paths) {
+    std::unique_ptr<TrigramIndex> old;
+    if (::access(index_path.c_str(), F_OK) == 0) {
+        try {
+            old = std::make_unique<TrigramIndex>(index_path);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << "; building a new index" << std::endl;
+        }
+    }
+
+    // Every file to look at, in path order, with its old record if it has one
+    std::map<std::string, const IndexedFile*> files;
+    if (old != nullptr) {
+        for (const IndexedFile& file : old->files()) {
+            files.emplace(std::string(old->path(file)), &file);
+        }
+    }
+    for (const std::string& path : paths) {
+        collect_paths(path, files);
+    }
+
+    // Rotation renames a file, so an old record may turn up under a new path
+    std::map<std::pair<uint64_t, uint64_t>, const IndexedFile*> by_inode;
+    if (old != nullptr) {
+        for (const IndexedFile& file : old->files()) {
+            by_inode.emplace(std::make_pair(file.device, file.inode), &file);
+        }
+    }
+    std::vector<bool> claimed(old != nullptr ? old->files().size() : 0);
+
+    IndexUpdate update;
+    IndexBuilder builder;
+    std::vector<uint32_t> remap(old != nullptr ? old->block_count() : 0, kDropped);
+    std::vector<FileBuild> builds;
+    for (const auto& [path, record] : files) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+        struct stat info;
+        if (fd < 0 || ::fstat(fd, &info) != 0) {
+            if (record == nullptr || errno != ENOENT) {
+                std::cerr << path << ": " << std::strerror(errno) << std::endl;
+            }
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            update.removed += record != nullptr;
+            continue;
+        }
+        FdCloser closer{fd};
+        if (!S_ISREG(info.st_mode) || looks_binary(fd, false)) {
+            update.removed += record != nullptr;
+            continue;
+        }
+
+        FileBuild build;
+        build.path = path;
+        build.record.device = static_cast<uint64_t>(info.st_dev);
+        build.record.inode = static_cast<uint64_t>(info.st_ino);
+        build.record.mtime_ns = modification_ns(info);
+        build.record.size = static_cast<uint64_t>(info.st_size);
+
+        // An old record's blocks go to one file at most: its own, else the one it was renamed to
+        auto unclaimed = [&](const IndexedFile* file) {
+            return file != nullptr && !claimed[file - old->files().data()];
+        };
+        const IndexedFile* previous = nullptr;
+        IndexState state = IndexState::Stale;
+        if (unclaimed(record)) {
+            previous = record;
+            state = check_indexed_file(fd, *previous);
+        }
+        auto renamed = by_inode.find(std::make_pair(build.record.device, build.record.inode));
+        if (state == IndexState::Stale && renamed != by_inode.end() && unclaimed(renamed->second)) {
+            previous = renamed->second;
+            state = check_indexed_file(fd, *previous);
+        }
+        if (state != IndexState::Stale) {
+            claimed[previous - old->files().data()] = true;
+        }
+        uint64_t from = state == IndexState::Stale ? 0 : previous->indexed_length;
+        FileMapping contents;
+        if (state != IndexState::Unchanged && build.record.size > from) {
+            if (!contents.map(fd, static_cast<size_t>(build.record.size))) {
+                std::cerr << path << ": " << std::strerror(errno) << std::endl;
+                update.removed += record != nullptr;
+                continue;
+            }
+            contents.advise_sequential();
+        }
+
+        if (state != IndexState::Stale) {
+            builder.keep_blocks(build, *old, *previous, remap);
+        }
+        if (contents.mapped()) {
+            update.bytes += builder.add_lines(build, contents.contents(), from);
+        }
+        if (state == IndexState::Unchanged) {
+            update.unchanged++;
+        } else {
+            (state == IndexState::Appended ? update.appended : update.indexed)++;
+        }
+        builds.push_back(std::move(build));
+    }
+
+    if (old != nullptr) {
+        builder.keep_postings(*old, remap);
+    }
+    // The old index stays mapped until the new one is complete, so it is never read half-replaced
+    builder.write(index_path, builds);
+    return update;
+}
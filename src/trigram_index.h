@@ -0,0 +1,126 @@
+// trigram_index.h
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "file_mapping.h"
+#include "literal_analysis.h"
+
+// One file as it was when indexed. Only whole lines are indexed, so indexed_length ends just
+// past a '\n'; a last line still being written is left for the search to read directly.
+struct IndexedFile {
+    uint64_t path_offset;     // Absolute path, in the index's string section
+    uint64_t path_length;
+    uint64_t device;
+    uint64_t inode;
+    int64_t mtime_ns;
+    uint64_t size;            // File size when indexed
+    uint64_t indexed_length;
+    uint64_t tail_hash;       // hash_bytes() of the kTailHashBytes (or fewer) before indexed_length
+    uint64_t line_count;      // Lines within indexed_length
+    uint32_t first_block;     // The file's blocks are [first_block, first_block + block_count)
+    uint32_t block_count;
+};
+
+// A run of whole lines of about TrigramIndex::kBlockSize bytes; a file's blocks cover
+// [0, indexed_length) in order
+struct IndexedBlock {
+    uint64_t offset;
+    uint64_t length;
+    uint64_t first_line;  // Number of the block's first line, from 1
+};
+
+// Where a trigram's posting list is; the table is sorted by trigram
+struct IndexedTrigram {
+    uint32_t trigram;
+    uint32_t count;   // Blocks in the list
+    uint64_t offset;  // Start of the list in the postings section; it ends where the next begins
+};
+
+// How a file on disk compares with its record
+enum class IndexState {
+    Unchanged,  // Same file, same size and modification time
+    Appended,   // Same file, grown, with the indexed lines still in place: only the rest is new
+    Stale,      // Replaced, truncated or rewritten: the record says nothing about it
+};
+
+// A trigram posting-list index over a set of files, mapped read-only. Each file is cut into
+// line-aligned blocks; for every trigram that occurs within a line, the index lists the
+// blocks holding it, as varint-coded gaps between increasing block ids. A query maps the
+// pattern's required literals to trigrams and keeps only the blocks holding all trigrams of
+// some literal. The file layout is a header, then the file, block and trigram tables, whose
+// entries are read in place, then the posting lists and the paths. Numbers are in host byte
+// order; like the pattern cache, an index belongs to one machine.
+class TrigramIndex {
+public:
+    static constexpr uint32_t kFormatVersion = 1;
+    static constexpr size_t kBlockSize = 128 * 1024;
+    static constexpr size_t kTailHashBytes = 4096;
+    static constexpr const char* kDefaultPath = ".grep-index";
+
+    // Maps the index at `path`; throws std::runtime_error if it is missing or malformed
+    explicit TrigramIndex(const std::string& path);
+
+    TrigramIndex(const TrigramIndex&) = delete;
+    TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+    // Sorted by path
+    std::span<const IndexedFile> files() const { return files_; }
+    std::string_view path(const IndexedFile& file) const;
+    std::span<const IndexedBlock> blocks(const IndexedFile& file) const;
+    size_t block_count() const { return blocks_.size(); }
+
+    // The record of the file at `absolute_path`, or nullptr
+    const IndexedFile* find(std::string_view absolute_path) const;
+
+    // Increasing ids of the blocks that may hold a line containing one of `literals`. Without
+    // literals, or with one shorter than a trigram, nothing is ruled out.
+    std::vector<uint32_t> candidate_blocks(const RequiredLiterals& literals) const;
+
+    // Replaces `ids` with the blocks holding `trigram`; throws std::runtime_error if the list is corrupt
+    void postings(uint32_t trigram, std::vector<uint32_t>& ids) const;
+
+    // Every trigram that has a posting list, in increasing order
+    std::vector<uint32_t> trigrams() const;
+
+private:
+    FileMapping mapping_;
+    std::span<const IndexedFile> files_;
+    std::span<const IndexedBlock> blocks_;
+    std::span<const IndexedTrigram> trigrams_;
+    std::string_view postings_;
+    std::string_view strings_;
+
+    void map_and_check(const std::string& path);
+    const IndexedTrigram* lookup(uint32_t trigram) const;
+    void decode(const IndexedTrigram& entry, std::vector<uint32_t>& ids) const;
+};
+
+// Compares the open file `fd` with its record; reads at most the kTailHashBytes before
+// indexed_length, and only when the file has grown
+IndexState check_indexed_file(int fd, const IndexedFile& file);
+
+// What update_index() did
+struct IndexUpdate {
+    size_t unchanged = 0;  // Files whose postings were kept as they were
+    size_t appended = 0;   // Files of which only the new lines were indexed
+    size_t indexed = 0;    // Files indexed from the start: new, replaced or rewritten
+    size_t removed = 0;    // Files dropped because they are gone or now look binary
+    uint64_t bytes = 0;    // Bytes read to build trigrams
+};
+
+// Creates or refreshes the index at `index_path` so that it covers `paths`, with directories
+// walked recursively, plus every file it already lists that still exists. Unchanged files keep
+// their posting lists without being read, appended ones have only their new lines indexed,
+// and the others are indexed again; the rest of the index is rewritten from the old one. Binary
+// files, symbolic links met while walking and .git directories are skipped. Files that cannot
+// be read are reported on stderr and left out. The new index replaces the old one atomically.
+// Throws std::runtime_error if the index cannot be written.
+IndexUpdate update_index(const std::string& index_path, const std::vector<std::string>& paths);
+
+#endif // TRIGRAM_INDEX_H
@@ -0,0 +1,165 @@
+// utf8.h
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// What UTF-8 mode needs to turn code point sets into byte-level automata. Everything is
+// constexpr, like the parser that uses it.
+
+constexpr uint32_t kMaxCodepoint = 0x10FFFF;
+constexpr size_t kMaxUtf8Length = 4;  // Bytes in the longest encoding
+
+// Inclusive range of code points
+struct CodepointRange {
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+};
+
+// A run of UTF-8 encodings: every byte string of `length` bytes whose i-th byte lies in
+// [lo[i], hi[i]]. The encodings of any code point range split into a few such runs.
+struct Utf8Sequence {
+    size_t length = 0;
+    unsigned char lo[kMaxUtf8Length]{};
+    unsigned char hi[kMaxUtf8Length]{};
+};
+
+// Decodes the code point at text[pos] and moves pos past it. Returns false, leaving pos alone,
+// for a truncated, overlong or surrogate encoding or one beyond kMaxCodepoint.
+constexpr bool decode_utf8(std::string_view text, size_t& pos, uint32_t& codepoint) {
+    if (pos >= text.length()) {
+        return false;
+    }
+    unsigned char lead = static_cast<unsigned char>(text[pos]);
+    size_t length = lead < 0x80 ? 1 : lead < 0xC2 ? 0 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : lead < 0xF5 ? 4 : 0;
+    if (length == 0 || pos + length > text.length()) {
+        return false;
+    }
+    uint32_t value = length == 1 ? lead : lead & (0x7F >> length);
+    for (size_t i = 1; i < length; i++) {
+        unsigned char next = static_cast<unsigned char>(text[pos + i]);
+        if ((next & 0xC0) != 0x80) {
+            return false;
+        }
+        value = (value << 6) | (next & 0x3F);
+    }
+    constexpr uint32_t kSmallest[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (value < kSmallest[length] || value > kMaxCodepoint || (value >= 0xD800 && value <= 0xDFFF)) {
+        return false;
+    }
+    pos += length;
+    codepoint = value;
+    return true;
+}
+
+// Writes the encoding of `codepoint` to `out` and returns its length
+constexpr size_t encode_utf8(uint32_t codepoint, unsigned char* out) {
+    if (codepoint < 0x80) {
+        out[0] = static_cast<unsigned char>(codepoint);
+        return 1;
+    }
+    size_t length = codepoint < 0x800 ? 2 : codepoint < 0x10000 ? 3 : 4;
+    for (size_t i = length - 1; i > 0; i--) {
+        out[i] = static_cast<unsigned char>(0x80 | (codepoint & 0x3F));
+        codepoint >>= 6;
+    }
+    constexpr unsigned char kLeadBits[] = {0, 0, 0xC0, 0xE0, 0xF0};
+    out[0] = static_cast<unsigned char>(kLeadBits[length] | codepoint);
+    return length;
+}
+
+// Sorts `ranges` and merges overlapping and adjacent ones
+constexpr void normalize_ranges(std::vector<CodepointRange>& ranges) {
+    std::sort(ranges.begin(), ranges.end(),
+              [](const CodepointRange& a, const CodepointRange& b) { return a.lo < b.lo; });
+    size_t kept = 0;
+    for (const CodepointRange& range : ranges) {
+        if (kept > 0 && range.lo <= ranges[kept - 1].hi + 1) {
+            ranges[kept - 1].hi = std::max(ranges[kept - 1].hi, range.hi);
+        } else {
+            ranges[kept++] = range;
+        }
+    }
+    ranges.resize(kept);
+}
+
+// The code points missing from normalized `ranges`
+constexpr std::vector<CodepointRange> complement_ranges(const std::vector<CodepointRange>& ranges) {
+    std::vector<CodepointRange> result;
+    uint32_t next = 0;
+    for (const CodepointRange& range : ranges) {
+        if (range.lo > next) {
+            result.push_back(CodepointRange{next, range.lo - 1});
+        }
+        next = range.hi + 1;
+    }
+    if (next <= kMaxCodepoint) {
+        result.push_back(CodepointRange{next, kMaxCodepoint});
+    }
+    return result;
+}
+
+// Splits normalized `ranges` into the runs of their UTF-8 encodings, in code point order, the
+// way RE2 and Rust's regex do: first at the boundaries between encoding lengths, then until
+// all but the leading byte of each piece cover full continuation ranges, at which point the
+// encodings of its two ends bound every byte. Surrogates are left out.
+constexpr std::vector<Utf8Sequence> utf8_sequences(const std::vector<CodepointRange>& ranges) {
+    std::vector<Utf8Sequence> sequences;
+    std::vector<CodepointRange> pending;  // A stack; the upper part of a split is pushed first
+    for (auto range = ranges.rbegin(); range != ranges.rend(); ++range) {
+        pending.push_back(*range);
+    }
+    while (!pending.empty()) {
+        CodepointRange range = pending.back();
+        pending.pop_back();
+        if (range.lo <= 0xDFFF && range.hi >= 0xD800) {
+            if (range.hi > 0xDFFF) {
+                pending.push_back(CodepointRange{0xE000, range.hi});
+            }
+            if (range.lo < 0xD800) {
+                pending.push_back(CodepointRange{range.lo, 0xD7FF});
+            }
+            continue;
+        }
+
+        bool split = false;
+        for (uint32_t boundary : {0x7Fu, 0x7FFu, 0xFFFFu}) {
+            if (range.lo <= boundary && boundary < range.hi) {
+                pending.push_back(CodepointRange{boundary + 1, range.hi});
+                pending.push_back(CodepointRange{range.lo, boundary});
+                split = true;
+                break;
+            }
+        }
+        for (uint32_t bits = 6; bits <= 18 && !split; bits += 6) {
+            uint32_t mask = (uint32_t{1} << bits) - 1;
+            if ((range.lo & ~mask) == (range.hi & ~mask)) {
+                continue;
+            }
+            if ((range.lo & mask) != 0) {
+                pending.push_back(CodepointRange{(range.lo | mask) + 1, range.hi});
+                pending.push_back(CodepointRange{range.lo, range.lo | mask});
+                split = true;
+            } else if ((range.hi & mask) != mask) {
+                pending.push_back(CodepointRange{range.hi & ~mask, range.hi});
+                pending.push_back(CodepointRange{range.lo, (range.hi & ~mask) - 1});
+                split = true;
+            }
+        }
+        if (split) {
+            continue;
+        }
+
+        Utf8Sequence sequence;
+        sequence.length = encode_utf8(range.lo, sequence.lo);
+        encode_utf8(range.hi, sequence.hi);
+        sequences.push_back(sequence);
+    }
+    return sequences;
+}
+
+#endif // UTF8_H
@@ -0,0 +1,173 @@
+// Warm matching must not touch the heap: the legacy matchers work on views and offsets, and a
+// CompiledPattern's per-thread engines stop allocating once the states a line needs are built.
+// Every global operator new is replaced here to count allocations while a check is running.
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "check.h"
+#include "grep_funcs.h"
+
+namespace {
+
+bool counting = false;
+size_t allocations = 0;
+
+void* allocate(size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* allocate_aligned(size_t size, std::align_val_t alignment) {
+    if (counting) {
+        allocations++;
+    }
+    size_t align = static_cast<size_t>(alignment);
+    size_t rounded = (size + align - 1) / align * align;
+    if (void* memory = std::aligned_alloc(align, rounded == 0 ? align : rounded)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+// Allocations made by `body`, which runs once first to warm every cache it uses
+template <typename Body>
+size_t warm_allocations(Body body) {
+    body();
+    allocations = 0;
+    counting = true;
+    body();
+    counting = false;
+    return allocations;
+}
+
+const std::vector<std::string> kLines = {
+    "",
+    "cat",
+    "the caaat sat on the tree ",
+    "id 42 and id 7 ok",
+    "cow x marks the spot",
+    "no digits or symbols here",
+    "2024-01-01 12:00:00 ERROR request 5123 failed: timeout after 30s",
+    std::string(100, 'a') + " trailing #",
+};
+
+// The matchers match_pattern() dispatches to, one pattern of each kind
+const std::vector<std::string> kLegacyPatterns = {
+    "a", "\\d", "\\w", "[#@!]", "[^a-z ]", "\\w\\w \\d\\d", "^the", "tree $", "ca+t", "ca?t", "c.t", "(cat|cow) x",
+};
+
+const std::vector<std::string> kCompiledPatterns = {
+    "timeout",
+    "ERROR|WARN",
+    "\\d+ failed",
+    "^\\d+-",
+    "[^a-z ]",
+    "(cat|cow) x",
+    "c.*t",
+    "(a+)\\1 trailing",
+    "request [0-9]+ (failed|ok)",
+};
+
+void check_legacy_matchers() {
+    for (const std::string& pattern : kLegacyPatterns) {
+        size_t count = warm_allocations([&]() {
+            for (const std::string& line : kLines) {
+                match_pattern(line, pattern);
+            }
+        });
+        if (count != 0) {
+            std::cerr << "match_pattern \"" << pattern << "\": " << count << " allocations" << std::endl;
+        }
+        CHECK(count == 0);
+    }
+}
+
+void check_compiled_pattern(const CompiledPattern& compiled, std::string_view name) {
+    std::string buffer;
+    for (const std::string& line : kLines) {
+        buffer += line + "\n";
+    }
+    std::vector<uint32_t> ids;
+    ids.reserve(compiled.patterns().size());
+
+    size_t count = warm_allocations([&]() {
+        for (const std::string& line : kLines) {
+            compiled.match(line);
+        }
+        LineCursor cursor;
+        for (size_t from = 0; from < buffer.length();) {
+            size_t hit = compiled.find_line(buffer, from, cursor);
+            if (hit == std::string_view::npos) {
+                break;
+            }
+            size_t start = hit == 0 ? 0 : buffer.rfind('\n', hit - 1) + 1;
+            size_t end = buffer.find('\n', hit);
+            std::string_view line = std::string_view(buffer).substr(start, end - start);
+            MatchSpan span;
+            for (size_t at = 0; at <= line.length() && compiled.find_span(line, at, span);) {
+                at = span.end > span.start ? span.end : span.end + 1;
+            }
+            ids.clear();
+            compiled.matching_patterns(line, ids);
+            from = end + 1;
+        }
+    });
+    if (count != 0) {
+        std::cerr << "CompiledPattern " << name << ": " << count << " allocations" << std::endl;
+    }
+    CHECK(count == 0);
+}
+
+} // namespace
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate_aligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate_aligned(size, alignment); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+
+int main() {
+    check_legacy_matchers();
+
+    for (const std::string& pattern : kCompiledPatterns) {
+        CompiledPattern compiled(pattern);
+        check_compiled_pattern(compiled, "\"" + pattern + "\"");
+        CompiledPattern utf8(pattern, kUtf8Mode);
+        check_compiled_pattern(utf8, "\"" + pattern + "\" (utf-8)");
+    }
+    CompiledPattern set(kCompiledPatterns);
+    check_compiled_pattern(set, "set");
+    return check_result();
+}
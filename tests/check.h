@@ -0,0 +1,27 @@
+// check.h
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+// The tests are plain executables: a failed CHECK prints where it failed and the run goes on,
+// then main() returns check_result(), which is non-zero if anything failed
+inline int check_failures = 0;
+
+#define CHECK(condition)                                                                         \
+    do {                                                                                         \
+        if (!(condition)) {                                                                      \
+            check_failures++;                                                                    \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #condition << std::endl; \
+        }                                                                                        \
+    } while (false)
+
+inline int check_result() {
+    if (check_failures > 0) {
+        std::cerr << check_failures << " checks failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,182 @@
+// -z: searching a compressed file must print what searching the uncompressed text prints, with
+// the same line numbers and byte offsets, across concatenated gzip members and zstd frames. A
+// truncated stream prints the lines decoded before the cut, then reports the error.
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+#include "check.h"
+#include "grep_funcs.h"
+#include "line_reader.h"
+#include "search.h"
+#ifdef GREP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef GREP_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+namespace fs = std::filesystem;
+
+const char* const kPatterns[] = {"error", "user=u4[0-9] ", "entry 5[0-9]*7 ", "nothing-here"};
+
+// About 3 MiB of log lines, so the decoded text spans several of the reader's buffers
+std::string log_text() {
+    std::ostringstream text;
+    for (size_t line = 1; line <= 60000; line++) {
+        text << "entry " << line << (line % 1000 == 0 ? " level=error" : " level=info") << " user=u" << line % 97
+             << " status=ok\n";
+    }
+    return text.str();
+}
+
+void write_file(const fs::path& path, std::string_view contents) {
+    std::ofstream(path, std::ios::binary).write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+// What a search of `path` prints, and the error it stopped with, if any
+std::string search(const CompiledPattern& pattern, const fs::path& path, bool decompress, std::string* error = nullptr) {
+    SearchOptions options;
+    options.line_number = true;
+    options.byte_offset = true;
+    options.decompress = decompress;
+    OutputBuffer out;
+    try {
+        search_file(pattern, path.string(), options, out);
+    } catch (const std::runtime_error& e) {
+        if (error != nullptr) {
+            *error = e.what();
+        }
+    }
+    return out.take();
+}
+
+// Checks that the compressed file searches like the plain one
+void check_same(const fs::path& compressed, const fs::path& plain) {
+    for (const char* text : kPatterns) {
+        CompiledPattern pattern(text);
+        std::string error;
+        std::string expected = search(pattern, plain, false);
+        if (search(pattern, compressed, true, &error) != expected || !error.empty()) {
+            std::cerr << compressed.filename().string() << ": search for '" << text << "' differs" << error << std::endl;
+            CHECK(false);
+        }
+    }
+}
+
+// Checks that a cut-off stream prints the lines of `decoded`, the text before the cut, then fails
+void check_truncated(const fs::path& compressed, const fs::path& decoded, std::string_view message) {
+    for (const char* text : kPatterns) {
+        CompiledPattern pattern(text);
+        std::string error;
+        std::string expected = search(pattern, decoded, false);
+        CHECK(search(pattern, compressed, true, &error) == expected);
+        CHECK(error.find(message) != std::string::npos);
+    }
+}
+
+#ifdef GREP_HAVE_ZLIB
+// One gzip member holding `text`
+std::string gzip(std::string_view text) {
+    z_stream stream{};
+    CHECK(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    std::string compressed(deflateBound(&stream, text.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    stream.avail_in = static_cast<uInt>(text.size());
+    stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+    stream.avail_out = static_cast<uInt>(compressed.size());
+    CHECK(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    return compressed;
+}
+
+// Everything zlib can decode from the front of a gzip stream that may be cut off
+std::string gunzip_prefix(std::string_view compressed) {
+    z_stream stream{};
+    CHECK(inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK);
+    std::string text;
+    std::vector<char> chunk(64 * 1024);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+    stream.avail_in = static_cast<uInt>(compressed.size());
+    int status = Z_OK;
+    while (status == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef*>(chunk.data());
+        stream.avail_out = static_cast<uInt>(chunk.size());
+        status = inflate(&stream, Z_NO_FLUSH);
+        text.append(chunk.data(), chunk.size() - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return text;
+}
+
+void check_gzip(const fs::path& directory, const std::string& text) {
+    // Members split mid-line, one of them empty
+    size_t third = text.size() / 3;
+    std::string members = gzip(text.substr(0, third)) + gzip("") + gzip(text.substr(third, third + 17)) +
+                          gzip(text.substr(2 * third + 17));
+    write_file(directory / "members.gz", members);
+    check_same(directory / "members.gz", directory / "plain.log");
+
+    // Cut in the middle of a single member
+    std::string whole = gzip(text);
+    std::string cut = whole.substr(0, whole.size() / 2);
+    std::string decoded = gunzip_prefix(cut);
+    CHECK(!decoded.empty() && decoded.size() < text.size());
+    CHECK(text.compare(0, decoded.size(), decoded) == 0);
+    write_file(directory / "cut.gz", cut);
+    write_file(directory / "cut.log", decoded);
+    check_truncated(directory / "cut.gz", directory / "cut.log", "Unexpected end of gzip data");
+}
+#endif
+
+#ifdef GREP_HAVE_ZSTD
+std::string zstd(std::string_view text) {
+    std::string compressed(ZSTD_compressBound(text.size()), '\0');
+    size_t length = ZSTD_compress(compressed.data(), compressed.size(), text.data(), text.size(), 3);
+    CHECK(!ZSTD_isError(length));
+    compressed.resize(length);
+    return compressed;
+}
+
+void check_zstd(const fs::path& directory, const std::string& text) {
+    size_t half = text.size() / 2 + 5;
+    std::string frames = zstd(text.substr(0, half)) + zstd("") + zstd(text.substr(half));
+    write_file(directory / "frames.zst", frames);
+    check_same(directory / "frames.zst", directory / "plain.log");
+
+    // Cut inside the second frame: the whole first frame is decoded, and perhaps some of the second
+    std::string first = zstd(text.substr(0, half));
+    std::string second = zstd(text.substr(half));
+    write_file(directory / "cut.zst", first + second.substr(0, 8));
+    write_file(directory / "cut.log", text.substr(0, half));
+    check_truncated(directory / "cut.zst", directory / "cut.log", "Unexpected end of zstd data");
+}
+#endif
+
+} // namespace
+
+int main() {
+    char directory_template[] = "/tmp/decompress_test.XXXXXX";
+    fs::path directory = ::mkdtemp(directory_template);
+    std::string text = log_text();
+    write_file(directory / "plain.log", text);
+
+    // Input that is not compressed passes through
+    check_same(directory / "plain.log", directory / "plain.log");
+#ifdef GREP_HAVE_ZLIB
+    check_gzip(directory, text);
+#endif
+#ifdef GREP_HAVE_ZSTD
+    check_zstd(directory, text);
+#endif
+
+    fs::remove_all(directory);
+    return check_result();
+}
@@ -0,0 +1,183 @@
+// glob_match, .gitignore rules and the -r --include/--exclude/--exclude-dir filters built on
+// them. Patterns with many stars must fail in polynomial time: the test would hang otherwise.
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "check.h"
+#include "grep_funcs.h"
+#include "ignore_rules.h"
+#include "line_reader.h"
+#include "recursive_search.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+void check_globs() {
+    CHECK(glob_match("*.log", "a.log"));
+    CHECK(glob_match("*.log", ".log"));
+    CHECK(!glob_match("*.log", "dir/a.log"));
+    CHECK(!glob_match("*.log", "a.log.1"));
+    CHECK(glob_match("a?c", "abc"));
+    CHECK(!glob_match("a?c", "a/c"));
+    CHECK(!glob_match("a?c", "ac"));
+    CHECK(glob_match("*ab", "aab"));
+    CHECK(glob_match("a*b*c", "abbbc"));
+    CHECK(!glob_match("a*b", "ab/b"));
+    CHECK(glob_match("a*/b", "axx/b"));
+
+    CHECK(glob_match("[abc].txt", "b.txt"));
+    CHECK(!glob_match("[abc].txt", "d.txt"));
+    CHECK(glob_match("[!abc].txt", "d.txt"));
+    CHECK(glob_match("[^abc].txt", "d.txt"));
+    CHECK(!glob_match("[!abc].txt", "a.txt"));
+    CHECK(glob_match("x[a-c]", "xb"));
+    CHECK(!glob_match("x[a-c]", "xd"));
+    CHECK(glob_match("x[]]", "x]"));
+    CHECK(!glob_match("a[!x]b", "a/b"));
+    CHECK(glob_match("[ab", "[ab"));  // Unterminated: a literal '['
+    CHECK(glob_match("\\*", "*"));
+    CHECK(!glob_match("\\*", "a"));
+    CHECK(glob_match("a\\?", "a?"));
+
+    // ** as a whole component spans components; anywhere else it is a plain *
+    CHECK(glob_match("**/foo", "foo"));
+    CHECK(glob_match("**/foo", "a/foo"));
+    CHECK(glob_match("**/foo", "a/b/foo"));
+    CHECK(!glob_match("**/foo", "afoo"));
+    CHECK(glob_match("a/**/b", "a/b"));
+    CHECK(glob_match("a/**/b", "a/x/b"));
+    CHECK(glob_match("a/**/b", "a/x/y/b"));
+    CHECK(!glob_match("a/**/b", "ab"));
+    CHECK(!glob_match("a/**/b", "a/xb"));
+    CHECK(glob_match("**/*.log", "a/b/c.log"));
+    CHECK(glob_match("a/**", "a/x"));
+    CHECK(glob_match("a/**", "a/x/y"));
+    CHECK(!glob_match("a/**", "b/x"));
+    CHECK(glob_match("**", "any/thing"));
+    CHECK(glob_match("a**b", "axxb"));
+    CHECK(!glob_match("a**b", "a/b"));
+
+    // Each extra star used to double the work
+    std::string as(64, 'a');
+    CHECK(!glob_match("*a*a*a*a*a*a*a*a*a*a*a*a*b", as));
+    CHECK(glob_match("*a*a*a*a*a*a*a*a*a*a*a*a*", as));
+    CHECK(!glob_match("**/*a*a*a*a*a*a*a*a*a*a*a*a*b", "x/y/z/" + as));
+    CHECK(glob_match("**/*a*a*a*a*a*a*a*a*a*a*a*a*b", "x/y/z/" + as + "b"));
+}
+
+void check_rules() {
+    IgnoreRules root("# comment\n"
+                     "*.log\n"
+                     "!keep.log\n"
+                     "build/\n"
+                     "/root.txt\n"
+                     "docs/*.md\n"
+                     "**/tmp/**\n"
+                     "\\!bang\n"
+                     "trailing   \n"
+                     "\n",
+                     "", nullptr);
+
+    // Unanchored rules match the name at any depth; the last matching rule decides
+    CHECK(root.ignored("x.log", false));
+    CHECK(root.ignored("sub/x.log", false));
+    CHECK(!root.ignored("keep.log", false));
+    CHECK(!root.ignored("sub/keep.log", false));
+    CHECK(!root.ignored("# comment", false));
+    CHECK(root.ignored("!bang", false));
+    CHECK(root.ignored("trailing", false));
+
+    // Directory-only rules
+    CHECK(root.ignored("build", true));
+    CHECK(root.ignored("sub/build", true));
+    CHECK(!root.ignored("build", false));
+
+    // A leading or inner '/' anchors a rule to the directory of the .gitignore
+    CHECK(root.ignored("root.txt", false));
+    CHECK(!root.ignored("sub/root.txt", false));
+    CHECK(root.ignored("docs/a.md", false));
+    CHECK(!root.ignored("sub/docs/a.md", false));
+    CHECK(!root.ignored("docs/x/a.md", false));
+    CHECK(root.ignored("tmp/x", false));
+    CHECK(root.ignored("a/b/tmp/x", false));
+    CHECK(!root.ignored("a/tmpx/y", false));
+
+    // A deeper file overrides the ones above it, and only below its own directory
+    auto parent = std::make_shared<const IgnoreRules>("*.log\nbuild/\n", "", nullptr);
+    IgnoreRules child("!*.log\n/only-here\n", "sub/", parent);
+    CHECK(!child.ignored("sub/x.log", false));
+    CHECK(!child.ignored("sub/deeper/x.log", false));
+    CHECK(child.ignored("x.log", false));
+    CHECK(child.ignored("other/x.log", false));
+    CHECK(child.ignored("sub/build", true));
+    CHECK(child.ignored("sub/only-here", false));
+    CHECK(!child.ignored("only-here", false));
+    CHECK(!child.ignored("sub/deeper/only-here", false));
+}
+
+// The names of the files -r finds with `walk`, in the order it prints them
+std::vector<std::string> walk_names(const fs::path& root, const WalkOptions& walk) {
+    CompiledPattern pattern("hit");
+    SearchOptions options;
+    options.with_filename = true;
+    OutputBuffer out;
+    recursive_search(pattern, {root.string()}, options, walk, 1, out);
+
+    std::vector<std::string> names;
+    std::istringstream lines(out.take());
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::string path = line.substr(0, line.find(':'));
+        names.push_back(path.substr(root.string().length() + 1));
+    }
+    return names;
+}
+
+void check_walk() {
+    char directory_template[] = "/tmp/ignore_rules_test.XXXXXX";
+    fs::path root = ::mkdtemp(directory_template);
+    fs::create_directory(root / "sub");
+    fs::create_directory(root / "skip");
+    for (const char* name : {"a.txt", "b.log", "keep.log", "sub/c.txt", "sub/d.log", "skip/e.txt"}) {
+        std::ofstream(root / name) << "a hit\n";
+    }
+    std::ofstream(root / ".gitignore") << "*.log\n!keep.log\n";
+
+    using Names = std::vector<std::string>;
+    WalkOptions walk;
+    CHECK(walk_names(root, walk) == (Names{"a.txt", "keep.log", "skip/e.txt", "sub/c.txt"}));
+
+    walk.include = {"*.txt"};
+    CHECK(walk_names(root, walk) == (Names{"a.txt", "skip/e.txt", "sub/c.txt"}));
+
+    walk.include = {"*.txt", "k*"};
+    walk.exclude = {"c.*"};
+    CHECK(walk_names(root, walk) == (Names{"a.txt", "keep.log", "skip/e.txt"}));
+
+    walk.include.clear();
+    walk.exclude = {"[ab].*"};
+    walk.exclude_dir = {"sk*"};
+    CHECK(walk_names(root, walk) == (Names{"keep.log", "sub/c.txt"}));
+
+    walk.exclude.clear();
+    walk.exclude_dir.clear();
+    walk.use_ignore_files = false;
+    CHECK(walk_names(root, walk) == (Names{"a.txt", "b.log", "keep.log", "skip/e.txt", "sub/c.txt", "sub/d.log"}));
+
+    fs::remove_all(root);
+}
+
+} // namespace
+
+int main() {
+    check_globs();
+    check_rules();
+    check_walk();
+    return check_result();
+}
@@ -0,0 +1,75 @@
+// The pattern cache may live in a shared directory such as /tmp: pruning evicts only its own
+// entries and stale temporary files, and leaves every other file alone whatever its name.
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include "check.h"
+#include "grep_funcs.h"
+#include "pattern_cache.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+void write_file(const fs::path& path, long age_seconds) {
+    std::ofstream(path) << "not a cache entry\n";
+    fs::last_write_time(path, fs::file_time_type::clock::now() - std::chrono::seconds(age_seconds));
+}
+
+size_t count_entries(const fs::path& directory) {
+    size_t count = 0;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        bool key = name.find_first_not_of("0123456789abcdef") == 16;
+        count += key && name.length() == 20 && name.ends_with(".gpc") ? 1 : 0;
+    }
+    return count;
+}
+
+} // namespace
+
+int main() {
+    char directory_template[] = "/tmp/pattern_cache_test.XXXXXX";
+    fs::path directory = ::mkdtemp(directory_template);
+
+    // Foreign files, some of them old enough that the cache's own would be pruned
+    const long kHours = 3 * 3600;
+    write_file(directory / "foo.tmp", kHours);
+    write_file(directory / "foo.gpc", kHours);
+    write_file(directory / "0123456789abcdef.gpc.tmp", kHours);
+    write_file(directory / "0123456789ABCDEF.gpc", kHours);
+    write_file(directory / "0123456789abcdef.gpc.12x.tmp", kHours);
+    // A temporary file left by a crashed run, and one still being written
+    write_file(directory / "0123456789abcdef.gpc.4242.tmp", kHours);
+    write_file(directory / "fedcba9876543210.gpc.4243.tmp", 0);
+
+    {
+        PatternCache cache(directory.string(), 2);
+        for (const char* pattern : {"first", "second", "third", "fourth"}) {
+            std::unique_ptr<CompiledPattern> compiled = cache.load({pattern});
+            CHECK(compiled->match(std::string("a ") + pattern + " line"));
+        }
+        CHECK(cache.misses() == 4);
+        CHECK(cache.evictions() == 2);
+
+        // The two most recent entries are the ones kept
+        std::unique_ptr<CompiledPattern> kept = cache.load({"fourth"});
+        CHECK(cache.hits() == 1);
+    }
+    CHECK(count_entries(directory) == 2);
+
+    for (const char* name : {"foo.tmp", "foo.gpc", "0123456789abcdef.gpc.tmp", "0123456789ABCDEF.gpc",
+                             "0123456789abcdef.gpc.12x.tmp", "fedcba9876543210.gpc.4243.tmp"}) {
+        if (!fs::exists(directory / name)) {
+            std::cerr << name << " was removed" << std::endl;
+        }
+        CHECK(fs::exists(directory / name));
+    }
+    CHECK(!fs::exists(directory / "0123456789abcdef.gpc.4242.tmp"));
+
+    fs::remove_all(directory);
+    return check_result();
+}
@@ -0,0 +1,137 @@
+// static_regex and CompiledPattern share one table of patterns and lines. Each case states the
+// expected outcome for its own lines, which static_assert checks against the compile-time
+// matcher; at run time both matchers must give those outcomes and agree on every line of
+// every case, which also runs the prefilter and class-scan paths that constant evaluation skips.
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "check.h"
+#include "grep_funcs.h"
+#include "static_regex.h"
+
+namespace {
+
+struct Example {
+    std::string_view line;
+    bool matches;
+};
+
+using CaseCheck = void (*)(std::span<const Example>, const std::vector<std::string>&);
+
+struct Case {
+    std::string_view pattern;
+    std::span<const Example> examples;
+    CaseCheck check;
+};
+
+std::vector<Case>& cases() {
+    static std::vector<Case> all;
+    return all;
+}
+
+template <grep::fixed_string Pattern>
+constexpr bool static_agrees(std::span<const Example> examples) {
+    for (const Example& example : examples) {
+        if (grep::static_regex<Pattern>::match(example.line) != example.matches) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <grep::fixed_string Pattern>
+void check_case(std::span<const Example> examples, const std::vector<std::string>& lines) {
+    const CompiledPattern compiled(Pattern.view());
+    for (const Example& example : examples) {
+        bool fixed = grep::static_regex<Pattern>::match(example.line);
+        bool runtime = compiled.match(example.line);
+        if (fixed != example.matches || runtime != example.matches) {
+            std::cerr << "\"" << Pattern.view() << "\" on \"" << example.line << "\": static " << fixed
+                      << ", runtime " << runtime << ", expected " << example.matches << std::endl;
+        }
+        CHECK(fixed == example.matches);
+        CHECK(runtime == example.matches);
+    }
+    for (const std::string& line : lines) {
+        bool fixed = grep::static_regex<Pattern>::match(line);
+        bool runtime = compiled.match(line);
+        if (fixed != runtime) {
+            std::cerr << "\"" << Pattern.view() << "\" on \"" << line << "\": static " << fixed << ", runtime "
+                      << runtime << std::endl;
+        }
+        CHECK(fixed == runtime);
+    }
+}
+
+template <grep::fixed_string Pattern>
+bool add_case(std::span<const Example> examples) {
+    cases().push_back(Case{Pattern.view(), examples, &check_case<Pattern>});
+    return true;
+}
+
+} // namespace
+
+#define DIFFERENTIAL_CASE(name, pattern, ...)                             \
+    constexpr Example name[] = {__VA_ARGS__};                             \
+    static_assert(static_agrees<pattern>(name), "static_regex " pattern); \
+    const bool name##_added = add_case<pattern>(name)
+
+DIFFERENTIAL_CASE(kLiteral, "error",
+                  {"error", true}, {"an error occurred", true}, {"erro r", false}, {"", false}, {"ERROR", false});
+DIFFERENTIAL_CASE(kAnchoredDigits, "^error_\\d+$",
+                  {"error_42", true}, {"error_", false}, {"xerror_42", false}, {"error_42x", false},
+                  {"error_0123456789", true});
+DIFFERENTIAL_CASE(kWordThenNumber, "need[a-z]+ \\d+",
+                  {"we needle 42", true}, {"need 42", false}, {"needs 7 more", true}, {"needZ 7", false});
+DIFFERENTIAL_CASE(kMethodPath, "(GET|POST) /var/\\w+",
+                  {"GET /var/log", true}, {"POST /var/x", true}, {"PUT /var/log", false}, {"GET /var/", false});
+DIFFERENTIAL_CASE(kNumberWord, "[0-9]+ [a-z]+x",
+                  {"12 box", true}, {"12 bo", false}, {"x 12 abcx y", true}, {"12  box", false});
+DIFFERENTIAL_CASE(kOptional, "ca?t",
+                  {"cat", true}, {"ct", true}, {"caat", false}, {"scatter", true});
+DIFFERENTIAL_CASE(kWildcard, "c.t",
+                  {"cut", true}, {"ct", false}, {"c\tt", true}, {"cat and cot", true});
+DIFFERENTIAL_CASE(kPlusGroup, "(ab)+c",
+                  {"abc", true}, {"ababc", true}, {"ac", false}, {"aabbc", false});
+DIFFERENTIAL_CASE(kWholeLine, "^(cat|dog)s?$",
+                  {"cat", true}, {"dogs", true}, {"cats!", false}, {"a dog", false}, {"", false});
+DIFFERENTIAL_CASE(kEmptyLine, "^$",
+                  {"", true}, {" ", false});
+DIFFERENTIAL_CASE(kNegatedClass, "[^a-z ]",
+                  {"abc def", false}, {"abc Def", true}, {"", false}, {"abc.", true});
+DIFFERENTIAL_CASE(kEscapes, "\\w\\w \\d\\d",
+                  {"id 42", true}, {"i 42", false}, {"id 4", false}, {"x_ 00", true});
+DIFFERENTIAL_CASE(kEndAnchor, "tree $",
+                  {"a tree ", true}, {"a tree", false}, {"tree  ", false});
+DIFFERENTIAL_CASE(kStar, "ab*c",
+                  {"ac", true}, {"abbbbc", true}, {"abd", false});
+DIFFERENTIAL_CASE(kAlternatives, "cat|dog|bird",
+                  {"hotdog", true}, {"birds", true}, {"cow", false});
+
+// Long lines, so the SIMD class scans and the literal prefilter run on more than one block
+const std::vector<std::string> kLongLines = {
+    std::string(200, 'a') + "error_42",
+    "error_42" + std::string(200, ' '),
+    std::string(300, 'z') + " needle 42 " + std::string(300, 'z'),
+    std::string(100, '.') + "GET /var/" + std::string(100, '_'),
+    std::string(64, 'x') + "12 abcx",
+    std::string(70, 'a') + "b" + std::string(70, 'c'),
+    std::string(90, 'a') + " tree ",
+    std::string(128, '\xc3'),
+};
+
+int main() {
+    std::vector<std::string> lines = kLongLines;
+    for (const Case& entry : cases()) {
+        lines.emplace_back(entry.pattern);
+        for (const Example& example : entry.examples) {
+            lines.emplace_back(example.line);
+        }
+    }
+    for (const Case& entry : cases()) {
+        entry.check(entry.examples, lines);
+    }
+    return check_result();
+}
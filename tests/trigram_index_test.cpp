@@ -0,0 +1,225 @@
+// An index is built, then its files are appended to, rotated, deleted and rewritten. After
+// each step update_index() must report what it reused, and an indexed search must print what a
+// plain search of the same files prints. Candidate blocks must be exactly those holding every
+// trigram of some literal.
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "check.h"
+#include "grep_funcs.h"
+#include "indexed_search.h"
+#include "line_reader.h"
+#include "literal_analysis.h"
+#include "search.h"
+#include "trigram_index.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+const char* const kPatterns[] = {"needle-alpha", "needle-(alpha|gamma)", "entry 7[0-9]+ ", "zebra", "appended",
+                                 "nothing-here"};
+
+// About 300 KiB of log lines, so each file spans several blocks; `markers` go in at the given line numbers
+std::string log_lines(const std::string& name, std::vector<std::pair<size_t, std::string>> markers) {
+    std::ostringstream text;
+    for (size_t line = 1; line <= 6000; line++) {
+        text << name << " entry " << line << " level=info user=u" << line % 97 << " status=ok";
+        for (const auto& [at, marker] : markers) {
+            if (at == line) {
+                text << ' ' << marker;
+            }
+        }
+        text << '\n';
+    }
+    return text.str();
+}
+
+void write_file(const fs::path& path, const std::string& contents, std::ios::openmode mode = std::ios::trunc) {
+    std::ofstream(path, std::ios::binary | mode) << contents;
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+bool same_counts(const IndexUpdate& update, size_t unchanged, size_t appended, size_t indexed, size_t removed) {
+    bool same = update.unchanged == unchanged && update.appended == appended && update.indexed == indexed &&
+                update.removed == removed;
+    if (!same) {
+        std::cerr << "update: " << update.unchanged << " unchanged, " << update.appended << " appended, "
+                  << update.indexed << " indexed, " << update.removed << " removed" << std::endl;
+    }
+    return same;
+}
+
+// Checks every pattern against the index, for `files`, or for all it lists if there are none
+void check_searches(const std::string& index_path, const std::vector<std::string>& files) {
+    TrigramIndex index(index_path);
+    std::vector<std::string> paths = files;
+    if (paths.empty()) {
+        for (const IndexedFile& file : index.files()) {
+            paths.emplace_back(index.path(file));
+        }
+    }
+
+    SearchOptions options;
+    options.with_filename = true;
+    options.line_number = true;
+    for (const char* text : kPatterns) {
+        CompiledPattern pattern(text);
+        OutputBuffer indexed;
+        indexed_search(pattern, index, files, options, indexed);
+        OutputBuffer plain;
+        for (const std::string& path : paths) {
+            search_file(pattern, path, options, plain);
+        }
+        std::string expected = plain.take();
+        if (indexed.take() != expected) {
+            std::cerr << "indexed search for '" << text << "' differs" << std::endl;
+            CHECK(false);
+        }
+    }
+}
+
+// The blocks holding all trigrams of some literal, found by reading every block
+std::vector<uint32_t> expected_candidates(const TrigramIndex& index, const std::vector<std::string>& literals) {
+    std::vector<uint32_t> expected;
+    for (const IndexedFile& file : index.files()) {
+        std::string contents = read_file(std::string(index.path(file)));
+        for (uint32_t i = 0; i < file.block_count; i++) {
+            const IndexedBlock& block = index.blocks(file)[i];
+            std::set<std::string> trigrams;
+            for (size_t pos = block.offset; pos + 3 <= block.offset + block.length; pos++) {
+                std::string trigram = contents.substr(pos, 3);
+                if (trigram.find('\n') == std::string::npos) {
+                    trigrams.insert(trigram);
+                }
+            }
+            bool any = std::any_of(literals.begin(), literals.end(), [&](const std::string& literal) {
+                for (size_t pos = 0; pos + 3 <= literal.length(); pos++) {
+                    if (trigrams.count(literal.substr(pos, 3)) == 0) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            if (any) {
+                expected.push_back(file.first_block + i);
+            }
+        }
+    }
+    return expected;
+}
+
+void check_candidates(const std::string& index_path) {
+    TrigramIndex index(index_path);
+    CHECK(index.block_count() > index.files().size());
+
+    std::vector<uint32_t> all(index.block_count());
+    for (uint32_t id = 0; id < all.size(); id++) {
+        all[id] = id;
+    }
+    CHECK(index.candidate_blocks(RequiredLiterals{}) == all);
+    CHECK(index.candidate_blocks(RequiredLiterals{{"ab"}, false}) == all);
+    CHECK(index.candidate_blocks(RequiredLiterals{{"needle-alpha", "ok"}, false}) == all);
+
+    const std::vector<std::vector<std::string>> cases = {
+        {"needle-alpha"}, {"needle-gamma"}, {"needle-alpha", "needle-gamma"}, {"zebra"}, {"quokka"},
+        {"zebraquokka"},  {"entry 5999 "}, {"nothing-here"}, {"status=ok"},
+    };
+    for (const std::vector<std::string>& literals : cases) {
+        std::vector<uint32_t> candidates = index.candidate_blocks(RequiredLiterals{literals, false});
+        if (candidates != expected_candidates(index, literals)) {
+            std::cerr << "candidate blocks for '" << literals[0] << "' differ" << std::endl;
+            CHECK(false);
+        }
+    }
+
+    // AND within a literal: zebra and quokka share a block, on separate lines, so neither
+    // half rules it out, but the whole literal does
+    std::vector<uint32_t> zebra = index.candidate_blocks(RequiredLiterals{{"zebra"}, false});
+    CHECK(zebra.size() == 1);
+    CHECK(index.candidate_blocks(RequiredLiterals{{"quokka"}, false}) == zebra);
+    CHECK(index.candidate_blocks(RequiredLiterals{{"zebraquokka"}, false}).empty());
+
+    // OR across literals: the blocks of either
+    std::vector<uint32_t> alpha = index.candidate_blocks(RequiredLiterals{{"needle-alpha"}, false});
+    std::vector<uint32_t> gamma = index.candidate_blocks(RequiredLiterals{{"needle-gamma"}, false});
+    std::vector<uint32_t> either;
+    std::set_union(alpha.begin(), alpha.end(), gamma.begin(), gamma.end(), std::back_inserter(either));
+    CHECK(!alpha.empty() && !gamma.empty() && alpha != gamma);
+    CHECK(index.candidate_blocks(RequiredLiterals{{"needle-alpha", "needle-gamma"}, false}) == either);
+}
+
+} // namespace
+
+int main() {
+    char directory_template[] = "/tmp/trigram_index_test.XXXXXX";
+    fs::path directory = ::mkdtemp(directory_template);
+    fs::path logs = directory / "logs";
+    fs::create_directory(logs);
+    std::string index_path = (directory / "index").string();
+    std::string a = (logs / "a.log").string();
+    std::string b = (logs / "b.log").string();
+    std::string c = (logs / "c.log").string();
+
+    write_file(a, log_lines("a", {{10, "needle-alpha"}}));
+    write_file(b, log_lines("b", {{5900, "needle-gamma"}}));
+    write_file(c, log_lines("c", {{3000, "zebra"}, {3001, "quokka"}}));
+
+    // A new index reads everything; a second run reads nothing
+    IndexUpdate update = update_index(index_path, {logs.string()});
+    CHECK(same_counts(update, 0, 0, 3, 0));
+    CHECK(update.bytes == fs::file_size(a) + fs::file_size(b) + fs::file_size(c));
+    check_searches(index_path, {});
+    check_candidates(index_path);
+
+    update = update_index(index_path, {logs.string()});
+    CHECK(same_counts(update, 3, 0, 0, 0));
+    CHECK(update.bytes == 0);
+
+    // Appended lines, and a last line still being written, are searched before the refresh
+    const std::string appended = "a entry 6001 appended needle-alpha\na entry 6002 appended";
+    write_file(a, appended, std::ios::app);
+    check_searches(index_path, {a, b, c});
+    check_searches(index_path, {});
+    update = update_index(index_path, {logs.string()});
+    CHECK(same_counts(update, 2, 1, 0, 0));
+    CHECK(update.bytes == appended.find('\n') + 1);
+    check_searches(index_path, {});
+
+    // Rotation: b.log moves to b.log.1 and keeps its blocks; the new b.log is indexed
+    fs::rename(b, b + ".1");
+    write_file(b, "b entry 1 needle-gamma again\n");
+    check_searches(index_path, {a, b, b + ".1", c});
+    update = update_index(index_path, {logs.string()});
+    CHECK(same_counts(update, 3, 0, 1, 0));
+    check_searches(index_path, {});
+
+    // A deleted file drops out of the index
+    fs::remove(c);
+    update = update_index(index_path, {logs.string()});
+    CHECK(same_counts(update, 3, 0, 0, 1));
+    CHECK(TrigramIndex(index_path).find(c) == nullptr);
+    check_searches(index_path, {});
+
+    // A new file is indexed, as is one whose last indexed lines changed before it grew
+    write_file(c, log_lines("c", {{3000, "zebra"}, {3001, "quokka"}}));
+    std::string rewritten = read_file(a);
+    rewritten.replace(rewritten.find("6001 appended"), 4, "6101");
+    write_file(a, rewritten + "\na entry 6003 appended\n");
+    update = update_index(index_path, {logs.string()});
+    CHECK(same_counts(update, 2, 0, 2, 0));
+    check_searches(index_path, {});
+    check_candidates(index_path);
+
+    fs::remove_all(directory);
+    return check_result();
+}